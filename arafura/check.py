@@ -0,0 +1,291 @@
+"""
+Validation without code generation.
+
+check() walks the tree once and reports every structural error the
+transpiler would raise on, each with its line, instead of stopping at the
+first. It builds no output, so it is cheap enough to run on every save.
+Checks that depend on declared types and decorators (builtin arity,
+ndview ranks and layouts, conversions, @alias_versioned extents) call the
+transpiler's own validation helpers, with the checker keeping the
+declarations those helpers look up. Errors inside other type annotations
+are still only found by transpiling.
+"""
+
+import ast
+from typing import NamedTuple
+
+from arafura import lib
+from arafura.regex import parse
+from arafura.transpiler import (AUGASSIGN_OPERATORS, BINOP_PRECEDENCE, COMPARE_PRECEDENCE, FASTDIV_TYPES, REGEX_BUILTINS,
+                                CTranspiler)
+
+# Expression nodes CTranspiler.emit_expr handles
+EXPRESSION_NODES = frozenset((
+    ast.Constant, ast.Name, ast.BinOp, ast.UnaryOp, ast.Compare, ast.BoolOp, ast.IfExp,
+    ast.Call, ast.Attribute, ast.Subscript, ast.Slice, ast.List, ast.Dict, ast.Tuple, ast.NamedExpr,
+))
+
+
+class CheckError(NamedTuple):
+    line: int
+    column: int
+    message: str
+
+    def format(self, filename: str) -> str:
+        return f"{filename}:{self.line}:{self.column}: error: {self.message}"
+
+
+class StructureChecker(ast.NodeVisitor):
+    """Collect structural errors; mirrors the checks CTranspiler raises on."""
+
+    def __init__(self):
+        self.errors: list[CheckError] = []
+        # Declarations only (scopes, struct fields, type aliases), for the
+        # transpiler's validation helpers; it never emits
+        self.types = CTranspiler()
+
+    def error(self, node: ast.AST, message: str):
+        self.errors.append(CheckError(node.lineno, node.col_offset + 1, message))
+
+    def validate(self, node: ast.AST, check, *args):
+        """Run a CTranspiler validation helper, reporting its ValueError at node."""
+        try:
+            check(*args)
+        except ValueError as e:
+            self.error(node, str(e))
+
+    def view_of(self, node: ast.AST) -> tuple | None:
+        """(element, rank, contiguous) if node is declared as an ndview; bad view types are reported where declared."""
+        try:
+            return self.types.view_info(self.types.static_type(node))
+        except ValueError:
+            return None
+
+    def check_annotation(self, node: ast.AST, annotation: ast.AST | None):
+        """Report malformed ndview[...] and fastdiv[...] types in an annotation."""
+        while isinstance(annotation, ast.UnaryOp):  # pointer types
+            annotation = annotation.operand
+        if annotation is None or isinstance(annotation, (ast.Name, ast.Constant)):
+            return
+        for part in ast.walk(annotation):
+            if isinstance(part, ast.Subscript) and isinstance(part.value, ast.Name):
+                if part.value.id == 'ndview':
+                    self.validate(node, self.types.view_info, part)
+                elif part.value.id == 'fastdiv' and not (isinstance(part.slice, ast.Name)
+                                                         and part.slice.id in FASTDIV_TYPES):
+                    self.error(node, f"fastdiv takes {' or '.join(FASTDIV_TYPES)}")
+
+    def check_value(self, value: ast.expr | None, target: ast.AST | None):
+        """Check a value stored to a variable declared as target (views are built from it)."""
+        view = None
+        if target is not None:
+            try:
+                view = self.types.view_info(self.types.resolve_type(target))
+            except ValueError:
+                pass
+        if view is not None and isinstance(value, ast.Call) and isinstance(value.func, ast.Name) \
+                and value.func.id == 'ndview':
+            rank = view[1]
+            self.validate(value, CTranspiler.require_args, value, rank + 1,
+                          f"ndview of rank {rank} needs a pointer and {rank} extents")
+            for arg in value.args:
+                self.check_expr(arg)
+            return
+        source = self.view_of(value.value) if view is not None and isinstance(value, ast.Subscript) else None
+        if source is not None:
+            self.validate(value, self.types.check_view_subscript, value, source, view)
+            self.check_expr(value.value)
+            self.check_expr(value.slice)
+            return
+        self.check_expr(value)
+
+    def declare_types(self, body: list[ast.stmt]):
+        """Record the struct fields and type aliases of body (a module or an imported standard module)."""
+        for stmt in body:
+            if isinstance(stmt, ast.ClassDef):
+                names = {stmt.name}
+                typedef = CTranspiler.find_decorator(stmt, 'typedef')
+                if isinstance(typedef, ast.Call) and typedef.args and isinstance(typedef.args[0], ast.Name):
+                    names.add(typedef.args[0].id)
+                for field in stmt.body:
+                    if isinstance(field, ast.AnnAssign) and isinstance(field.target, ast.Name):
+                        for name in names:
+                            self.types.fields.setdefault(name, {})[field.target.id] = field.annotation
+            elif isinstance(stmt, ast.TypeAlias) and isinstance(stmt.name, ast.Name):
+                self.types.type_aliases[stmt.name.id] = stmt.value
+
+    # ========================================================================
+    # Expressions
+    # ========================================================================
+
+    def check_expr(self, node: ast.expr | None):
+        """Report unsupported expression kinds and operators in node."""
+        if node is None:
+            return
+        kind = type(node)
+        if kind not in EXPRESSION_NODES:
+            self.error(node, f"Unsupported expression: {kind.__name__}")
+            return
+        if kind is ast.BinOp:
+            if type(node.op) not in BINOP_PRECEDENCE:
+                self.error(node, f"Unsupported binary operator: {type(node.op).__name__}")
+            elif (isinstance(node.op, (ast.Div, ast.FloorDiv, ast.Mod))
+                  and not (isinstance(node.right, ast.Name) and node.right.id == '_')):
+                self.validate(node, self.types.check_fastdiv, node.left, node.right)
+        elif kind is ast.Compare:
+            for op in node.ops:
+                if type(op) not in COMPARE_PRECEDENCE:
+                    self.error(node, f"Unsupported comparison operator: {type(op).__name__}")
+        elif kind is ast.Call:
+            if (isinstance(node.func, ast.Name) and node.func.id in REGEX_BUILTINS
+                    and node.args and isinstance(node.args[0], ast.Constant) and isinstance(node.args[0].value, str)):
+                try:
+                    parse(node.args[0].value, REGEX_BUILTINS[node.func.id])
+                except ValueError as e:
+                    self.error(node, str(e))
+            self.validate(node, self.types.check_call, node)
+        elif kind is ast.Subscript:
+            view = self.view_of(node.value)
+            if view is not None:
+                self.validate(node, self.types.check_view_subscript, node, view)
+        elif kind is ast.Name or kind is ast.Constant:
+            return
+        for field in node._fields:
+            child = getattr(node, field, None)
+            if isinstance(child, ast.expr):
+                self.check_expr(child)
+            elif isinstance(child, list):
+                for item in child:
+                    if isinstance(item, ast.expr):
+                        self.check_expr(item)
+                    elif isinstance(item, ast.keyword):
+                        self.check_expr(item.value)
+
+    # ========================================================================
+    # Statements
+    # ========================================================================
+
+    def visit_Expr(self, node: ast.Expr):
+        self.check_expr(node.value)
+
+    def visit_Assign(self, node: ast.Assign):
+        for target in node.targets:
+            self.check_expr(target)
+        target = node.targets[0] if len(node.targets) == 1 else None
+        self.check_value(node.value, self.types.static_type(target) if target is not None else None)
+
+    def visit_AugAssign(self, node: ast.AugAssign):
+        if type(node.op) not in AUGASSIGN_OPERATORS:
+            self.error(node, f"Unsupported augmented assignment operator: {type(node.op).__name__}")
+        self.check_expr(node.target)
+        self.check_expr(node.value)
+        if isinstance(node.op, (ast.Div, ast.FloorDiv, ast.Mod)):
+            self.validate(node, self.types.check_fastdiv, node.target, node.value)
+
+    def visit_AnnAssign(self, node: ast.AnnAssign):
+        # The annotation is a type, not an expression
+        self.check_annotation(node, node.annotation)
+        if isinstance(node.target, ast.Name):
+            self.types.declare_var(node.target.id, node.annotation)
+        self.check_value(node.value, node.annotation)
+
+    def visit_Return(self, node: ast.Return):
+        self.check_expr(node.value)
+
+    def visit_If(self, node: ast.If):
+        self.check_expr(node.test)
+        for stmt in node.body:
+            self.visit(stmt)
+        if (CTranspiler.is_preprocessor_test(node.test) and len(node.orelse) == 1
+                and isinstance(node.orelse[0], ast.If)
+                and not CTranspiler.is_preprocessor_test(node.orelse[0].test)):
+            self.error(node.orelse[0], "Mixed regular and preprocessor conditionals in elif chain")
+        for stmt in node.orelse:
+            self.visit(stmt)
+
+    def visit_While(self, node: ast.While):
+        self.check_expr(node.test)
+        for stmt in node.body + node.orelse:
+            self.visit(stmt)
+
+    def visit_For(self, node: ast.For):
+        parts = CTranspiler.for_loop_parts(node)
+        if parts is None:
+            self.error(node, "Invalid for loop pattern: expected for VARS in TYPES(INIT)(COND)(STEP)")
+        else:
+            _types, init, cond, step = parts
+            targets = node.target.elts if isinstance(node.target, ast.Tuple) else [node.target]
+            if not all(isinstance(target, ast.Name) for target in targets):
+                self.error(node.target, "Invalid for loop pattern: loop variables must be names")
+            for expr in (init, cond, step):
+                self.check_expr(expr)
+        for stmt in node.body + node.orelse:
+            self.visit(stmt)
+
+    def visit_Raise(self, node: ast.Raise):
+        if not isinstance(node.exc, ast.Name):
+            self.error(node, "Invalid goto pattern: expected raise LABEL")
+
+    def visit_Delete(self, node: ast.Delete):
+        for target in node.targets:
+            if not isinstance(target, ast.Name):
+                self.error(target, "Invalid #undef target: expected a name")
+
+    def visit_Match(self, node: ast.Match):
+        self.check_expr(node.subject)
+        for case in node.cases:
+            if not CTranspiler.is_switch_pattern(case.pattern):
+                self.error(case.pattern, f"Unsupported match pattern: {type(case.pattern).__name__}")
+            elif isinstance(case.pattern, ast.MatchValue):
+                self.check_expr(case.pattern.value)
+            for stmt in case.body:
+                self.visit(stmt)
+
+    def visit_FunctionDef(self, node: ast.FunctionDef):
+        if CTranspiler.definition_kind(node) is None:
+            self.error(node, f"Invalid function/macro definition: {node.name} "
+                             "(annotate the return and every parameter, or none of them)")
+        for arg in node.args.args:
+            self.check_annotation(arg, arg.annotation)
+        self.check_annotation(node, node.returns)
+        versioned = CTranspiler.find_decorator(node, 'alias_versioned')
+        if versioned is not None:
+            self.validate(node, CTranspiler.alias_versioned_extents, node, versioned)
+        self.types.scopes.append({arg.arg: arg.annotation for arg in node.args.args})
+        for stmt in node.body:
+            self.visit(stmt)
+        self.types.scopes.pop()
+
+    def visit_ClassDef(self, node: ast.ClassDef):
+        # Fields are annotations; methods and nested definitions are checked
+        self.declare_types([node])
+        for stmt in node.body:
+            if isinstance(stmt, ast.FunctionDef):
+                self.visit_FunctionDef(CTranspiler.method_function(node.name, stmt))
+            elif isinstance(stmt, ast.AnnAssign):
+                self.check_annotation(stmt, stmt.annotation)
+            else:
+                self.visit(stmt)
+
+    def visit_ImportFrom(self, node: ast.ImportFrom):
+        if node.module and node.module.startswith('arafura.'):
+            name = node.module.removeprefix('arafura.')
+            if name not in lib.names():
+                self.error(node, f"Unknown standard module: arafura.{name}")
+            else:
+                # Its structs and aliases type the module's uses of them
+                self.declare_types(ast.parse(lib.source(name)).body)
+
+    def visit_TypeAlias(self, node: ast.TypeAlias):
+        self.declare_types([node])
+
+
+def check(source: str) -> list[CheckError]:
+    """All structural errors in source, in source order."""
+    try:
+        tree = ast.parse(source)
+    except SyntaxError as e:
+        return [CheckError(e.lineno or 1, e.offset or 1, f"Syntax error: {e.msg}")]
+    checker = StructureChecker()
+    checker.visit(tree)
+    return sorted(checker.errors)
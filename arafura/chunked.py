@@ -0,0 +1,131 @@
+"""
+Transpilation of large modules one top-level statement at a time.
+
+transpile() parses the whole source into one AST, which for generated
+modules of hundreds of MB needs many GB. transpile_chunked() instead splits
+the source at top-level statement boundaries with tokenize, parses and emits
+each statement separately, and writes its C before reading the next, so
+peak memory follows the largest definition rather than the file.
+
+The source is read twice: a first pass collects struct/union/enum names from
+the class headers (as visit_Module does), the second emits. The output is
+identical to transpile(), except that infer_const, which needs every
+function at once, is not available.
+"""
+
+import ast
+import io
+import tokenize
+from typing import Callable, Iterator, TextIO
+
+from arafura.transpiler import CTranspiler
+
+# Keywords that continue the compound statement before them
+CONTINUATION_KEYWORDS = {'elif', 'else', 'except', 'finally'}
+
+
+def toplevel_chunks(readline: Callable[[], str]) -> Iterator[tuple[int, str]]:
+    """
+    Split source into top-level statements without parsing it, yielding
+    (first line number, text). Decorators stay with their definition; blank
+    lines and comments go with the statement before them.
+    """
+    lines = []   # Physical lines read but not yet yielded
+    first = 1    # Line number of lines[0]
+
+    def record() -> str:
+        line = readline()
+        lines.append(line)
+        return line
+
+    depth = 0
+    at_line_start = True
+    decorated = False
+    for token in tokenize.generate_tokens(record):
+        if token.type == tokenize.INDENT:
+            depth += 1
+        elif token.type == tokenize.DEDENT:
+            depth -= 1
+        elif token.type == tokenize.NEWLINE:
+            at_line_start = True
+        elif token.type not in (tokenize.NL, tokenize.COMMENT, tokenize.ENDMARKER):
+            if at_line_start and depth == 0 and token.string not in CONTINUATION_KEYWORDS:
+                start = token.start[0]
+                if not decorated and start > first:
+                    yield first, "".join(lines[:start - first])
+                    del lines[:start - first]
+                    first = start
+                decorated = token.string == '@'
+            at_line_start = False
+    if any(line.strip() for line in lines):
+        yield first, "".join(lines)
+
+
+def class_headers(readline: Callable[[], str]) -> Iterator[str]:
+    """
+    Source of each top-level class header, as 'class NAME(BASES): pass',
+    found from tokens alone.
+    """
+    depth = 0
+    at_line_start = True
+    header = None   # Tokens of the header being collected
+    brackets = 0
+    for token in tokenize.generate_tokens(readline):
+        if token.type == tokenize.INDENT:
+            depth += 1
+        elif token.type == tokenize.DEDENT:
+            depth -= 1
+        elif token.type == tokenize.NEWLINE:
+            at_line_start = True
+        elif token.type not in (tokenize.NL, tokenize.COMMENT):
+            if at_line_start and depth == 0 and token.string == 'class':
+                header = []
+            if header is not None:
+                header.append(token.string)
+                if token.string in ('(', '[', '{'):
+                    brackets += 1
+                elif token.string in (')', ']', '}'):
+                    brackets -= 1
+                elif token.string == ':' and brackets == 0:
+                    yield " ".join(header) + " pass"
+                    header = None
+            at_line_start = False
+
+
+def transpile_chunked(open_source: Callable[[], TextIO], out: TextIO, **options):
+    """
+    Transpile the source returned by open_source() (called twice) to out,
+    one top-level statement at a time. Options are those of transpile().
+    """
+    if options.get('infer_const'):
+        raise ValueError("infer_const needs the whole module; it is not available when transpiling in chunks")
+    transpiler = CTranspiler(**options)
+
+    with open_source() as source:
+        for header in class_headers(source.readline):
+            transpiler.collect_type_names(ast.parse(header).body)
+
+    written = False
+    with open_source() as source:
+        for lineno, text in toplevel_chunks(source.readline):
+            try:
+                chunk = ast.parse(text)
+            except SyntaxError as e:
+                e.lineno += lineno - 1
+                raise
+            ast.increment_lineno(chunk, lineno - 1)
+            for stmt in chunk.body:
+                transpiler.visit_toplevel(stmt)
+            if transpiler.output:
+                if written:
+                    out.write("\n")
+                out.write(transpiler.get_output())
+                transpiler.output = []
+                written = True
+
+
+def transpile_source_chunked(source_code: str, **options) -> str:
+    """transpile_chunked() on a string; the result equals transpile(source_code)."""
+    out = io.StringIO()
+    transpile_chunked(lambda: io.StringIO(source_code), out, **options)
+    return out.getvalue()
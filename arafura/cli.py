@@ -2,10 +2,17 @@
 """Command-line interface for Arafura transpiler."""
 
 import argparse
+import subprocess
 import sys
 from pathlib import Path
 
+from arafura.check import check
+from arafura.chunked import transpile_chunked
+from arafura.prelude import make_prelude, read_prelude
+from arafura.report import MAX_CODE, MAX_STACK, format_report, size_report
+from arafura.shard import transpile_sharded
 from arafura.transpiler import transpile
+from arafura.verify import verify_minimal_parens
 
 
 def main() -> int:
@@ -18,14 +25,18 @@ def main() -> int:
 Examples:
   arafura input.py                # Print C code to stdout
   arafura input.py -o output.c    # Write C code to file
-  arafura input.py --check        # Check syntax without output
+  arafura input.py --check        # Report all errors, no output
+  arafura --make-prelude prelude.h a.py b.py   # Shared system includes
+  arafura a.py --prelude prelude.h -o a.c      # Include the prelude first
+  arafura a.py --report-size --max-stack 1024  # Stack and code size per def
         """,
     )
 
     parser.add_argument(
         "input",
         type=Path,
-        help="Input Python file to transpile",
+        nargs="+",
+        help="Input Python file to transpile (all project modules with --make-prelude)",
     )
 
     parser.add_argument(
@@ -38,7 +49,87 @@ Examples:
     parser.add_argument(
         "--check",
         action="store_true",
-        help="Check if input can be transpiled without generating output",
+        help="Report every structural error (for patterns, definitions, match cases) without generating output",
+    )
+
+    parser.add_argument(
+        "--infer-const",
+        action="store_true",
+        help="Emit pointer parameters that are only read as const T *",
+    )
+
+    parser.add_argument(
+        "--minimal-parens",
+        action="store_true",
+        help="Emit only the parentheses C operator precedence requires",
+    )
+
+    parser.add_argument(
+        "--verify-parens",
+        action="store_true",
+        help="Emit minimal parentheses after checking with GCC that they parse like the full form",
+    )
+
+    parser.add_argument(
+        "--precise-math",
+        action="store_true",
+        help="Lower fast_exp, fast_log, rsqrt and fast_tanh to libm instead of approximations",
+    )
+
+    parser.add_argument(
+        "--chunked",
+        action="store_true",
+        help="Parse and emit one top-level statement at a time, for modules too large to parse whole",
+    )
+
+    parser.add_argument(
+        "--visibility",
+        choices=("default", "hidden"),
+        default="default",
+        help="Symbol visibility of functions not marked @export (hidden for shared libraries)",
+    )
+
+    parser.add_argument(
+        "--shards",
+        type=int,
+        metavar="N",
+        help="Split the output into OUTPUT's .h and N .c files (OUT_0.c ...) to compile in parallel",
+    )
+
+    parser.add_argument(
+        "--report-size",
+        action="store_true",
+        help="Compile with GCC and report each function's stack usage and code size by source line",
+    )
+
+    parser.add_argument(
+        "--max-stack",
+        type=int,
+        default=MAX_STACK,
+        metavar="BYTES",
+        help=f"With --report-size, flag functions whose frame exceeds BYTES (default: {MAX_STACK})",
+    )
+
+    parser.add_argument(
+        "--max-code",
+        type=int,
+        default=MAX_CODE,
+        metavar="BYTES",
+        help=f"With --report-size, flag functions whose code exceeds BYTES (default: {MAX_CODE})",
+    )
+
+    parser.add_argument(
+        "--make-prelude",
+        type=Path,
+        metavar="HEADER",
+        help="Write the system includes of all inputs to HEADER, for precompilation",
+    )
+
+    parser.add_argument(
+        "--prelude",
+        type=Path,
+        metavar="HEADER",
+        help="Include HEADER (made by --make-prelude) first and omit the system headers it covers",
     )
 
     parser.add_argument(
@@ -49,6 +140,24 @@ Examples:
 
     args = parser.parse_args()
 
+    if args.make_prelude:
+        return main_make_prelude(args)
+    if len(args.input) > 1:
+        parser.error("only one input file is allowed without --make-prelude")
+    args.input = args.input[0]
+
+    prelude = {}
+    if args.prelude:
+        try:
+            prelude_includes = read_prelude(args.prelude.read_text(encoding="utf-8"))
+        except IOError as e:
+            print(f"Error reading prelude: {e}", file=sys.stderr)
+            return 1
+        prelude = {"prelude": args.prelude.name, "prelude_includes": prelude_includes}
+
+    if args.chunked:
+        return main_chunked(args, prelude)
+
     # Read input file
     try:
         source = args.input.read_text(encoding="utf-8")
@@ -59,18 +168,37 @@ Examples:
         print(f"Error reading input file: {e}", file=sys.stderr)
         return 1
 
+    # Check mode: validate only, reporting every error
+    if args.check:
+        errors = check(source)
+        for error in errors:
+            print(error.format(str(args.input)), file=sys.stderr)
+        if errors:
+            return 1
+        print(f"OK: {args.input} passes all checks")
+        return 0
+
     # Transpile
+    options = {
+        "infer_const": args.infer_const,
+        "minimal_parens": args.minimal_parens,
+        "precise_math": args.precise_math,
+        "visibility": args.visibility,
+        **prelude,
+    }
+    if args.shards is not None:
+        return main_sharded(args, source, options)
+    if args.report_size:
+        return main_report_size(args, source, options)
     try:
-        c_code = transpile(source)
+        if args.verify_parens:
+            c_code = verify_minimal_parens(source, **options)
+        else:
+            c_code = transpile(source, **options)
     except Exception as e:
         print(f"Transpilation error: {e}", file=sys.stderr)
         return 1
 
-    # Handle check mode
-    if args.check:
-        print(f"OK: {args.input} transpiles successfully")
-        return 0
-
     # Write output
     if args.output:
         try:
@@ -85,5 +213,86 @@ Examples:
         return 0
 
 
+def main_sharded(args: argparse.Namespace, source: str, options: dict) -> int:
+    """Write OUTPUT's header and N .c shards next to it."""
+    if not args.output:
+        print("Error: --shards needs -o OUTPUT.c to name the header and shards", file=sys.stderr)
+        return 1
+    header = args.output.with_suffix(".h")
+    try:
+        sharded = transpile_sharded(source, args.shards, header.name, **options)
+    except Exception as e:
+        print(f"Transpilation error: {e}", file=sys.stderr)
+        return 1
+    try:
+        header.write_text(sharded.header, encoding="utf-8")
+        for index, text in enumerate(sharded.shards):
+            args.output.with_name(f"{args.output.stem}_{index}.c").write_text(text, encoding="utf-8")
+    except IOError as e:
+        print(f"Error writing output file: {e}", file=sys.stderr)
+        return 1
+    print(f"OK: Generated {header} and {args.shards} shards")
+    return 0
+
+
+def main_report_size(args: argparse.Namespace, source: str, options: dict) -> int:
+    """Print the stack and code size report; fail if any function is flagged."""
+    try:
+        report = size_report(source, **options)
+    except subprocess.CalledProcessError as e:
+        print(f"Compilation error: {e.stderr}", file=sys.stderr)
+        return 1
+    except Exception as e:
+        print(f"Transpilation error: {e}", file=sys.stderr)
+        return 1
+    lines, warnings = format_report(report, str(args.input), args.max_stack, args.max_code)
+    print("\n".join(lines))
+    return 1 if warnings else 0
+
+
+def main_make_prelude(args: argparse.Namespace) -> int:
+    """Write the shared prelude header for all input modules."""
+    try:
+        sources = [path.read_text(encoding="utf-8") for path in args.input]
+        args.make_prelude.write_text(make_prelude(sources), encoding="utf-8")
+    except IOError as e:
+        print(f"Error: {e}", file=sys.stderr)
+        return 1
+    except SyntaxError as e:
+        print(f"Transpilation error: {e}", file=sys.stderr)
+        return 1
+    print(f"OK: Generated {args.make_prelude}")
+    return 0
+
+
+def main_chunked(args: argparse.Namespace, prelude: dict) -> int:
+    """Transpile in chunks, streaming to the output file or stdout."""
+    if not args.input.exists():
+        print(f"Error: Input file '{args.input}' not found", file=sys.stderr)
+        return 1
+    if args.check or args.verify_parens or args.shards is not None:
+        print("Error: --chunked cannot be combined with --check, --verify-parens or --shards", file=sys.stderr)
+        return 1
+    options = {
+        "infer_const": args.infer_const,
+        "minimal_parens": args.minimal_parens,
+        "precise_math": args.precise_math,
+        "visibility": args.visibility,
+        **prelude,
+    }
+    try:
+        if args.output:
+            with args.output.open("w", encoding="utf-8") as out:
+                transpile_chunked(lambda: args.input.open(encoding="utf-8"), out, **options)
+            print(f"OK: Generated {args.output}")
+        else:
+            transpile_chunked(lambda: args.input.open(encoding="utf-8"), sys.stdout, **options)
+            print()
+    except Exception as e:
+        print(f"Transpilation error: {e}", file=sys.stderr)
+        return 1
+    return 0
+
+
 if __name__ == "__main__":
     sys.exit(main())
@@ -0,0 +1,23 @@
+"""
+Standard modules, written in arafura itself.
+
+`from arafura.NAME import *` includes the transpiled module in place (once per
+translation unit). Module functions are static inline, so every file that
+uses a module can carry its own copy.
+"""
+
+from pathlib import Path
+
+LIB_DIR = Path(__file__).parent
+
+
+def names() -> list[str]:
+    """Names of the available modules."""
+    return sorted(path.stem for path in LIB_DIR.glob("*.py") if path.stem != "__init__")
+
+
+def source(name: str) -> str:
+    """Source text of a module."""
+    if name not in names():
+        raise ValueError(f"Unknown standard module: arafura.{name} (available: {', '.join(names())})")
+    return (LIB_DIR / f"{name}.py").read_text(encoding="utf-8")
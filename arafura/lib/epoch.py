@@ -0,0 +1,147 @@
+# Epoch-based reclamation (Fraser, 2004) for lock-free structures: a node
+# unlinked while other threads may still be reading it is retired instead of
+# freed, and freed once no thread can hold a reference to it.
+#
+# Each thread registers once and brackets every access to the shared
+# structure with epoch_enter()/epoch_exit(). Entering announces the global
+# epoch the thread saw. The global epoch advances only when every thread
+# inside a critical section has announced the current one, so a node retired
+# at epoch e is unreachable to all readers once the epoch reaches e + 2.
+# Retired nodes wait in per-thread lists, one per epoch modulo 3, and are
+# freed in batches: every EPOCH_BATCH retires, the thread tries to advance
+# the epoch and frees the lists that have become safe. Readers write only
+# their own announcement, which sits on its own cache line.
+#
+#     t: -epoch_thread = epoch_register(_.domain)
+#     epoch_enter(t)
+#     ... find, unlink old: -Node ...
+#     epoch_exit(t)
+#     epoch_retire(t, old, free)      # or a destroy function of your own
+
+from stdint import *
+from stddef import *
+from stdlib import *
+from string import *
+
+EPOCH_MAX_THREADS: macro = 64
+EPOCH_BATCH: macro = 64
+EPOCH_ACTIVE: macro = 1     # Announcement: epoch << 1 | EPOCH_ACTIVE inside a critical section
+
+type epoch_destroy_fn = -(-void,)(void)
+
+@typedef(epoch_retired)
+class epoch_retired:
+    ptr: -void
+    destroy: epoch_destroy_fn
+
+@typedef(epoch_limbo)
+class epoch_limbo:
+    epoch: uint64_t         # Global epoch when these were retired
+    items: -epoch_retired
+    count: size_t
+    capacity: size_t
+
+@typedef(epoch_thread)
+class epoch_thread:
+    announce: alignas[64, uint64_t]     # Scanned by other threads
+    in_use: int
+    domain: alignas[64, -type[epoch_domain]]    # From here on, owner only
+    pending: size_t                     # Retired since the last reclaim
+    limbo: epoch_limbo[3]               # Indexed by epoch % 3
+
+@typedef(epoch_domain)
+class epoch_domain:
+    epoch: alignas[64, uint64_t]
+    count: uint32_t         # Slots ever claimed; only these are scanned
+    threads: epoch_thread[EPOCH_MAX_THREADS]
+
+def epoch_init(d: -epoch_domain) -> static[inline[void]]:
+    memset(d, 0, sizeof(epoch_domain))
+    for i in int(i := 0)(i < EPOCH_MAX_THREADS)(i ** _):
+        d._.threads[i].domain = d
+
+def epoch_register(d: -epoch_domain) -> static[inline[-epoch_thread]]:
+    # A record for the calling thread, or NULL if EPOCH_MAX_THREADS are in
+    # use. A slot freed by epoch_unregister is reused, with any nodes still
+    # waiting in it.
+    for i in uint32_t(i := 0)(i < EPOCH_MAX_THREADS)(i ** _):
+        t: -epoch_thread = d._.threads + i
+        expected: int = 0
+        if ____atomic_compare_exchange_n(_.t._.in_use, _.expected, 1, 0, ____ATOMIC_ACQUIRE, ____ATOMIC_RELAXED):
+            count: uint32_t = ____atomic_load_n(_.d._.count, ____ATOMIC_RELAXED)
+            while count <= i and not ____atomic_compare_exchange_n(_.d._.count, _.count, i + 1, 1,
+                                                                    ____ATOMIC_RELEASE, ____ATOMIC_RELAXED):
+                pass
+            return t
+    return NULL
+
+def epoch_unregister(t: -epoch_thread) -> static[inline[void]]:
+    # The thread must be outside a critical section.
+    ____atomic_store_n(_.t._.in_use, 0, ____ATOMIC_RELEASE)
+
+def epoch_enter(t: -epoch_thread) -> static[inline[void]]:
+    # Starts a critical section: nodes reachable now stay allocated until
+    # epoch_exit. Sections do not nest.
+    e: uint64_t = ____atomic_load_n(_.t._.domain._.epoch, ____ATOMIC_RELAXED)
+    ____atomic_store_n(_.t._.announce, e << 1 | EPOCH_ACTIVE, ____ATOMIC_RELAXED)
+    # The announcement must be visible before the structure is read
+    ____atomic_thread_fence(____ATOMIC_SEQ_CST)
+
+def epoch_exit(t: -epoch_thread) -> static[inline[void]]:
+    ____atomic_store_n(_.t._.announce, t._.announce & ~[uint64_t](EPOCH_ACTIVE), ____ATOMIC_RELEASE)
+
+def epoch_try_advance(d: -epoch_domain) -> static[inline[uint64_t]]:
+    # Moves the global epoch on if every active thread has seen it; returns
+    # the (possibly new) epoch.
+    e: uint64_t = ____atomic_load_n(_.d._.epoch, ____ATOMIC_SEQ_CST)
+    count: uint32_t = ____atomic_load_n(_.d._.count, ____ATOMIC_ACQUIRE)
+    for i in uint32_t(i := 0)(i < count)(i ** _):
+        a: uint64_t = ____atomic_load_n(_.d._.threads[i].announce, ____ATOMIC_SEQ_CST)
+        if (a & EPOCH_ACTIVE) and a >> 1 != e:
+            return e
+    if ____atomic_compare_exchange_n(_.d._.epoch, _.e, e + 1, 0, ____ATOMIC_SEQ_CST, ____ATOMIC_SEQ_CST):
+        return e + 1
+    return e    # Another thread advanced it; e now holds the new epoch
+
+def epoch_free_limbo(limbo: -epoch_limbo) -> static[inline[void]]:
+    for i in size_t(i := 0)(i < limbo._.count)(i ** _):
+        limbo._.items[i].destroy(limbo._.items[i].ptr)
+    limbo._.count = 0
+
+def epoch_reclaim(t: -epoch_thread) -> static[inline[void]]:
+    # Frees this thread's retired nodes that no reader can still reach.
+    e: uint64_t = epoch_try_advance(t._.domain)
+    for i in int(i := 0)(i < 3)(i ** _):
+        limbo: -epoch_limbo = t._.limbo + i
+        if limbo._.count and limbo._.epoch + 2 <= e:
+            epoch_free_limbo(limbo)
+    t._.pending = 0
+
+def epoch_retire(t: -epoch_thread, ptr: -void, destroy: epoch_destroy_fn) -> static[inline[void]]:
+    # Calls destroy(ptr) once no thread can still be reading ptr, which must
+    # already be unlinked from the shared structure.
+    e: uint64_t = ____atomic_load_n(_.t._.domain._.epoch, ____ATOMIC_SEQ_CST)
+    limbo: -epoch_limbo = t._.limbo + e % 3
+    if limbo._.epoch != e:
+        # Holds nodes from epoch e - 3 or before, which are safe by now
+        epoch_free_limbo(limbo)
+        limbo._.epoch = e
+    if limbo._.count == limbo._.capacity:
+        limbo._.capacity = limbo._.capacity * 2 if limbo._.capacity else EPOCH_BATCH
+        limbo._.items = realloc(limbo._.items, limbo._.capacity * sizeof(epoch_retired))
+    limbo._.items[limbo._.count].ptr = ptr
+    limbo._.items[limbo._.count].destroy = destroy
+    limbo._.count += 1
+    t._.pending += 1
+    if t._.pending >= EPOCH_BATCH:
+        epoch_reclaim(t)
+
+def epoch_destroy(d: -epoch_domain) -> static[inline[void]]:
+    # Frees every node still retired. No thread may use d any more.
+    for i in int(i := 0)(i < EPOCH_MAX_THREADS)(i ** _):
+        t: -epoch_thread = d._.threads + i
+        for k in int(k := 0)(k < 3)(k ** _):
+            epoch_free_limbo(t._.limbo + k)
+            free(t._.limbo[k].items)
+            t._.limbo[k].items = NULL
+            t._.limbo[k].capacity = 0
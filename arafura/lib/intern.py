@@ -0,0 +1,179 @@
+# String interning: each distinct string is stored once, in an arena, and
+# named by a dense 32-bit ID, so comparing interned strings is comparing
+# integers. IDs and the string pointers behind them stay valid until
+# intern_destroy().
+#
+# Lookups (intern_find, intern_str, intern_len) take no lock and can run on
+# any number of threads while others intern new strings; inserts are
+# serialized by a mutex. The hash table keeps (hash, id) in one 64-bit word
+# per slot, published with a release store after the string it names. A
+# grown table replaces the old one by a pointer swap, and old tables are
+# kept until intern_destroy(), so a reader still probing one stays safe (it
+# just may not see the newest strings). IDs map to strings through pages of
+# entries that never move.
+
+from stdint import *
+from stddef import *
+from stdlib import *
+from string import *
+from pthread import *
+
+INTERN_NONE: macro = UINT32_MAX
+INTERN_PAGE_BITS: macro = 12
+INTERN_PAGE_SIZE: macro = 4096
+INTERN_PAGES: macro = 65536     # 2^28 IDs
+INTERN_CHUNK: macro = 65536     # Arena block size
+
+@typedef(intern_entry)
+class intern_entry:
+    str: -const[char]
+    len: size_t
+
+@typedef(intern_slots)
+class intern_slots:
+    mask: size_t
+    retired: -type[intern_slots]    # The table this one replaced
+    words: list[uint64_t]           # hash << 32 | (id + 1); 0 is empty
+
+@typedef(intern_table)
+class intern_table:
+    slots: -intern_slots        # Current hash table
+    pages: --intern_entry       # ID -> entry, INTERN_PAGE_SIZE per page
+    count: uint32_t
+    block: -char                # Arena: free space in the newest block
+    left: size_t
+    blocks: -void               # Arena blocks, linked through their first word
+    lock: pthread_mutex_t
+
+def intern_hash(s: -const[char], n: size_t) -> static[inline[uint32_t]]:
+    return hash64(s, n) >> 32
+
+def intern_slots_new(mask: size_t) -> static[inline[-intern_slots]]:
+    slots: -intern_slots = calloc(1, sizeof(intern_slots) + (mask + 1) * sizeof(uint64_t))
+    slots._.mask = mask
+    return slots
+
+def intern_init(t: -intern_table) -> static[inline[void]]:
+    t._.slots = intern_slots_new(63)
+    t._.pages = calloc(INTERN_PAGES, sizeof(t._.pages._))
+    t._.count = 0
+    t._.block = NULL
+    t._.left = 0
+    t._.blocks = NULL
+    pthread_mutex_init(_.t._.lock, NULL)
+
+def intern_destroy(t: -intern_table) -> static[inline[void]]:
+    # No other thread may use t any more.
+    slots: -intern_slots = t._.slots
+    while slots:
+        retired: -intern_slots = slots._.retired
+        free(slots)
+        slots = retired
+    for i in size_t(i := 0)(i < INTERN_PAGES)(i ** _):
+        free(t._.pages[i])
+    free(t._.pages)
+    block: -void = t._.blocks
+    while block:
+        next: -void = [--void](block)._
+        free(block)
+        block = next
+    pthread_mutex_destroy(_.t._.lock)
+
+def intern_entry_of(t: -intern_table, id: uint32_t) -> static[inline[-intern_entry]]:
+    page: -intern_entry = ____atomic_load_n(t._.pages + (id >> INTERN_PAGE_BITS), ____ATOMIC_ACQUIRE)
+    return page + (id & INTERN_PAGE_SIZE - 1)
+
+def intern_str(t: -intern_table, id: uint32_t) -> static[inline[-const[char]]]:
+    # The NUL-terminated string of an ID returned by intern().
+    return intern_entry_of(t, id)._.str
+
+def intern_len(t: -intern_table, id: uint32_t) -> static[inline[size_t]]:
+    return intern_entry_of(t, id)._.len
+
+def intern_count(t: -intern_table) -> static[inline[uint32_t]]:
+    return ____atomic_load_n(_.t._.count, ____ATOMIC_ACQUIRE)
+
+def intern_lookup(t: -intern_table, slots: -intern_slots, s: -const[char], n: size_t, h: uint32_t) -> static[inline[uint32_t]]:
+    i: size_t = h & slots._.mask
+    while True:
+        word: uint64_t = ____atomic_load_n(slots._.words + i, ____ATOMIC_ACQUIRE)
+        if word == 0:
+            return INTERN_NONE
+        if word >> 32 == h:
+            entry: -intern_entry = intern_entry_of(t, [uint32_t](word) - 1)
+            if entry._.len == n and memcmp(entry._.str, s, n) == 0:
+                return [uint32_t](word) - 1
+        i = i + 1 & slots._.mask
+
+def intern_find(t: -intern_table, s: -const[char], n: size_t) -> static[inline[uint32_t]]:
+    # ID of s[0..n) if it is interned, else INTERN_NONE. Takes no lock.
+    slots: -intern_slots = ____atomic_load_n(_.t._.slots, ____ATOMIC_ACQUIRE)
+    return intern_lookup(t, slots, s, n, intern_hash(s, n))
+
+def intern_copy(t: -intern_table, s: -const[char], n: size_t) -> static[inline[-char]]:
+    # Copies s[0..n) and a NUL into the arena.
+    if n + 1 > t._.left:
+        size: size_t = INTERN_CHUNK if n + 1 + sizeof(t._.blocks) <= INTERN_CHUNK else n + 1 + sizeof(t._.blocks)
+        block: -void = malloc(size)
+        [--void](block)._ = t._.blocks
+        t._.blocks = block
+        t._.block = [-char](block) + sizeof(t._.blocks)
+        t._.left = size - sizeof(t._.blocks)
+    copy: -char = t._.block
+    memcpy(copy, s, n)
+    copy[n] = 0
+    t._.block += n + 1
+    t._.left -= n + 1
+    return copy
+
+def intern_place(slots: -intern_slots, word: uint64_t) -> static[inline[void]]:
+    i: size_t = (word >> 32) & slots._.mask
+    while slots._.words[i]:
+        i = i + 1 & slots._.mask
+    ____atomic_store_n(slots._.words + i, word, ____ATOMIC_RELEASE)
+
+def intern_grow(t: -intern_table) -> static[inline[-intern_slots]]:
+    # Doubles the table; the old one stays readable until intern_destroy.
+    old: -intern_slots = t._.slots
+    slots: -intern_slots = intern_slots_new(old._.mask * 2 + 1)
+    for i in size_t(i := 0)(i <= old._.mask)(i ** _):
+        if old._.words[i]:
+            intern_place(slots, old._.words[i])
+    slots._.retired = old
+    ____atomic_store_n(_.t._.slots, slots, ____ATOMIC_RELEASE)
+    return slots
+
+def intern_insert(t: -intern_table, s: -const[char], n: size_t, h: uint32_t) -> static[inline[uint32_t]]:
+    # Adds a string known to be absent; the lock is held.
+    id: uint32_t = t._.count
+    page: size_t = id >> INTERN_PAGE_BITS
+    if page >= INTERN_PAGES:
+        return INTERN_NONE
+    if not t._.pages[page]:
+        ____atomic_store_n(t._.pages + page, calloc(INTERN_PAGE_SIZE, sizeof(intern_entry)), ____ATOMIC_RELEASE)
+    entry: -intern_entry = t._.pages[page] + (id & INTERN_PAGE_SIZE - 1)
+    entry._.str = intern_copy(t, s, n)
+    entry._.len = n
+    slots: -intern_slots = t._.slots
+    if (id + 1) * 2 > slots._.mask + 1:
+        slots = intern_grow(t)
+    intern_place(slots, [uint64_t](h) << 32 | id + 1)
+    ____atomic_store_n(_.t._.count, id + 1, ____ATOMIC_RELEASE)
+    return id
+
+def intern(t: -intern_table, s: -const[char], n: size_t) -> static[inline[uint32_t]]:
+    # ID of s[0..n), interning a copy if it is new. INTERN_NONE once 2^28
+    # strings are interned.
+    h: uint32_t = intern_hash(s, n)
+    id: uint32_t = intern_lookup(t, ____atomic_load_n(_.t._.slots, ____ATOMIC_ACQUIRE), s, n, h)
+    if id != INTERN_NONE:
+        return id
+    pthread_mutex_lock(_.t._.lock)
+    id = intern_lookup(t, t._.slots, s, n, h)
+    if id == INTERN_NONE:
+        id = intern_insert(t, s, n, h)
+    pthread_mutex_unlock(_.t._.lock)
+    return id
+
+def intern_cstr(t: -intern_table, s: -const[char]) -> static[inline[uint32_t]]:
+    return intern(t, s, strlen(s))
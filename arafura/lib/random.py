@@ -0,0 +1,180 @@
+# Fast pseudo-random numbers: xoshiro256** (Blackman & Vigna) and PCG32
+# (O'Neill). Each generator is a small state struct owned by the caller, so
+# threads use separate states and nothing is locked. jump() and advance()
+# split one seed into non-overlapping parallel streams.
+
+from stdint import *
+from stddef import *
+from string import *
+
+# ============================================================================
+# xoshiro256**: 256-bit state, 64-bit output, period 2^256 - 1
+# ============================================================================
+
+@typedef(xoshiro256)
+class xoshiro256:
+    s: uint64_t[4]
+
+def rotl64(x: uint64_t, k: int) -> static[inline[uint64_t]]:
+    return x << k | x >> (64 - k)
+
+def splitmix64(x: -uint64_t) -> static[inline[uint64_t]]:
+    # Expands a 64-bit seed into well-mixed state words.
+    x._ += 0x9E3779B97F4A7C15
+    z: uint64_t = x._
+    z = (z ^ z >> 30) * 0xBF58476D1CE4E5B9
+    z = (z ^ z >> 27) * 0x94D049BB133111EB
+    return z ^ z >> 31
+
+def xoshiro256_seed(rng: -xoshiro256, seed: uint64_t) -> static[inline[void]]:
+    for i in int(i := 0)(i < 4)(i ** _):
+        rng._.s[i] = splitmix64(_.seed)
+
+def xoshiro256_next(rng: -xoshiro256) -> static[inline[uint64_t]]:
+    s: -uint64_t = rng._.s
+    result: uint64_t = rotl64(s[1] * 5, 7) * 9
+    t: uint64_t = s[1] << 17
+    s[2] ^= s[0]
+    s[3] ^= s[1]
+    s[1] ^= s[2]
+    s[0] ^= s[3]
+    s[2] ^= t
+    s[3] = rotl64(s[3], 45)
+    return result
+
+def xoshiro256_jump(rng: -xoshiro256) -> static[inline[void]]:
+    # Advances by 2^128 calls: gives 2^128 non-overlapping streams.
+    JUMP: static[const[uint64_t[4]]] = [0x180EC6D33CFD0ABA, 0xD5A61266F0C9392C, 0xA9582618E03FC9AA, 0x39ABDC4529B1661C]
+    t: uint64_t[4] = [0, 0, 0, 0]
+    for i in int(i := 0)(i < 4)(i ** _):
+        for b in int(b := 0)(b < 64)(b ** _):
+            if JUMP[i] & [uint64_t](1) << b:
+                for j in int(j := 0)(j < 4)(j ** _):
+                    t[j] ^= rng._.s[j]
+            xoshiro256_next(rng)
+    memcpy(rng._.s, t, sizeof(t))
+
+def uniform_from_bits(bits: uint64_t) -> static[inline[double]]:
+    # Top 52 bits as a double in [0, 1): exponent of 1.0, minus 1.0.
+    bits = bits >> 12 | 0x3FF0000000000000
+    d: double
+    memcpy(_.d, _.bits, sizeof(d))
+    return d - 1.0
+
+def xoshiro256_double(rng: -xoshiro256) -> static[inline[double]]:
+    return uniform_from_bits(xoshiro256_next(rng))
+
+# ============================================================================
+# Four interleaved xoshiro256** streams for bulk generation. The state is
+# stored word-major (s[word][lane]) so each step is a loop over four lanes
+# that compilers vectorize (two AVX2 registers per word).
+# ============================================================================
+
+XOSHIRO_LANES: macro = 4
+
+@typedef(xoshiro256x4)
+class xoshiro256x4:
+    s: uint64_t[4][XOSHIRO_LANES]
+
+def xoshiro256x4_seed(rng: -xoshiro256x4, seed: uint64_t) -> static[inline[void]]:
+    # Lane k starts k jumps (k * 2^128 steps) into the stream of seed.
+    one: xoshiro256
+    xoshiro256_seed(_.one, seed)
+    for lane in int(lane := 0)(lane < XOSHIRO_LANES)(lane ** _):
+        for i in int(i := 0)(i < 4)(i ** _):
+            rng._.s[i][lane] = one.s[i]
+        xoshiro256_jump(_.one)
+
+def xoshiro256x4_next(rng: -xoshiro256x4, out: -uint64_t) -> static[inline[void]]:
+    # Writes one output per lane to out[0..XOSHIRO_LANES).
+    for k in int(k := 0)(k < XOSHIRO_LANES)(k ** _):
+        s0: uint64_t = rng._.s[0][k]
+        s1: uint64_t = rng._.s[1][k]
+        s2: uint64_t = rng._.s[2][k] ^ s0
+        s3: uint64_t = rng._.s[3][k] ^ s1
+        x: uint64_t = s1 * 5
+        out[k] = (x << 7 | x >> 57) * 9
+        rng._.s[0][k] = s0 ^ s3
+        rng._.s[1][k] = s1 ^ s2
+        rng._.s[2][k] = s2 ^ s1 << 17
+        rng._.s[3][k] = s3 << 45 | s3 >> 19
+
+def fill_uniform(rng: -xoshiro256x4, buf: -double, n: size_t) -> static[inline[void]]:
+    # Fills buf[0..n) with doubles in [0, 1).
+    bits: uint64_t[XOSHIRO_LANES]
+    i: size_t = 0
+    while i + XOSHIRO_LANES <= n:
+        xoshiro256x4_next(rng, bits)
+        for k in int(k := 0)(k < XOSHIRO_LANES)(k ** _):
+            buf[i + k] = uniform_from_bits(bits[k])
+        i += XOSHIRO_LANES
+    if i < n:
+        xoshiro256x4_next(rng, bits)
+        for k in int(k := 0)(i + k < n)(k ** _):
+            buf[i + k] = uniform_from_bits(bits[k])
+
+def fill_u64(rng: -xoshiro256x4, buf: -uint64_t, n: size_t) -> static[inline[void]]:
+    # Fills buf[0..n) with raw 64-bit outputs.
+    bits: uint64_t[XOSHIRO_LANES]
+    i: size_t = 0
+    while i + XOSHIRO_LANES <= n:
+        xoshiro256x4_next(rng, buf + i)
+        i += XOSHIRO_LANES
+    if i < n:
+        xoshiro256x4_next(rng, bits)
+        memcpy(buf + i, bits, (n - i) * sizeof(uint64_t))
+
+# ============================================================================
+# PCG32: 64-bit LCG state, 32-bit permuted output, 2^63 selectable streams
+# ============================================================================
+
+PCG32_MULT: macro = 6364136223846793005
+
+@typedef(pcg32)
+class pcg32:
+    state: uint64_t
+    inc: uint64_t
+
+def pcg32_next(rng: -pcg32) -> static[inline[uint32_t]]:
+    old: uint64_t = rng._.state
+    rng._.state = old * PCG32_MULT + rng._.inc
+    xorshifted: uint32_t = ((old >> 18) ^ old) >> 27
+    rot: uint32_t = old >> 59
+    return xorshifted >> rot | xorshifted << (-rot & 31)
+
+def pcg32_seed(rng: -pcg32, seed: uint64_t, stream: uint64_t) -> static[inline[void]]:
+    rng._.state = 0
+    rng._.inc = stream << 1 | 1
+    pcg32_next(rng)
+    rng._.state += seed
+    pcg32_next(rng)
+
+def pcg32_advance(rng: -pcg32, delta: uint64_t) -> static[inline[void]]:
+    # Skips delta outputs in O(log delta) (Brown's LCG jump-ahead).
+    mult: uint64_t = PCG32_MULT
+    plus: uint64_t = rng._.inc
+    acc_mult: uint64_t = 1
+    acc_plus: uint64_t = 0
+    while delta > 0:
+        if delta & 1:
+            acc_mult *= mult
+            acc_plus = acc_plus * mult + plus
+        plus = (mult + 1) * plus
+        mult *= mult
+        delta >>= 1
+    rng._.state = acc_mult * rng._.state + acc_plus
+
+def pcg32_bounded(rng: -pcg32, bound: uint32_t) -> static[inline[uint32_t]]:
+    # Uniform in [0, bound) without modulo bias (Lemire's method).
+    m: uint64_t = [uint64_t](pcg32_next(rng)) * bound
+    low: uint32_t = m
+    if low < bound:
+        threshold: uint32_t = -bound % bound
+        while low < threshold:
+            m = [uint64_t](pcg32_next(rng)) * bound
+            low = m
+    return m >> 32
+
+def pcg32_float(rng: -pcg32) -> static[inline[float]]:
+    # Top 24 bits as a float in [0, 1).
+    return (pcg32_next(rng) >> 8) * 5.9604644775390625e-08  # 2^-24
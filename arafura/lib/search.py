@@ -0,0 +1,107 @@
+# Cache-friendly layouts for searching a static sorted array of int64_t keys.
+# Binary search over the sorted array touches a new cache line at nearly every
+# level, and the lines it needs are not known until each compare resolves.
+# Both layouts here are built once from the sorted keys (duplicates allowed):
+#
+# - Eytzinger: the keys in BFS order of the implicit binary tree (slot k has
+#   children 2k and 2k+1). The search is branch-free, and the 8 descendants
+#   three levels down share one cache line, which is prefetched.
+# - B-tree: implicit static B-tree with 8 keys (one cache line) per node and
+#   node k's children at 9k+1 .. 9k+9. About log9(n) lines are read.
+#
+# A lower-bound search returns a slot. keys[slot] is the first key >= the
+# query, and rank[slot] (if rank was built) its index in the sorted array.
+# When every key is smaller, the slot holds INT64_MAX and rank n. Allocate
+# the arrays with eytzinger_size(n) / btree_size(n) entries, 64-byte aligned
+# (aligned_alloc) for the prefetch and node reads to stay within lines.
+
+from stdint import *
+from stddef import *
+
+SEARCH_NONE: macro = INT64_MAX
+
+# ============================================================================
+# Eytzinger layout: slots 1..n, slot 0 is the "none" result
+# ============================================================================
+
+def eytzinger_size(n: size_t) -> static[inline[size_t]]:
+    return n + 1
+
+def eytzinger_fill(sorted: -const[int64_t], n: size_t, keys: -int64_t, rank: -size_t, next: -size_t, k: size_t) -> static[void]:
+    # In-order walk of the implicit tree assigns sorted keys in order.
+    if k <= n:
+        eytzinger_fill(sorted, n, keys, rank, next, 2 * k)
+        keys[k] = sorted[next._]
+        if rank:
+            rank[k] = next._
+        next._ += 1
+        eytzinger_fill(sorted, n, keys, rank, next, 2 * k + 1)
+
+def eytzinger_build(sorted: -const[int64_t], n: size_t, keys: -int64_t, rank: -size_t) -> static[inline[void]]:
+    # keys (and rank, unless NULL) need eytzinger_size(n) entries.
+    next: size_t = 0
+    keys[0] = SEARCH_NONE
+    if rank:
+        rank[0] = n
+    eytzinger_fill(sorted, n, keys, rank, _.next, 1)
+
+def eytzinger_lower_bound(keys: -const[int64_t], n: size_t, key: int64_t) -> static[inline[size_t]]:
+    k: size_t = 1
+    while k <= n:
+        ____builtin_prefetch(keys + k * 8)
+        k = 2 * k + (keys[k] < key)
+    # The path went right after the answer and left ever since: drop the
+    # trailing ones and the last left turn.
+    return k >> ____builtin_ffsll(~k)
+
+# ============================================================================
+# Implicit B-tree: node k holds keys[8k .. 8k+8), slot 8 * nodes is "none"
+# ============================================================================
+
+BTREE_KEYS: macro = 8
+
+def btree_nodes(n: size_t) -> static[inline[size_t]]:
+    return (n + BTREE_KEYS - 1) / BTREE_KEYS
+
+def btree_size(n: size_t) -> static[inline[size_t]]:
+    return btree_nodes(n) * BTREE_KEYS + 1
+
+def btree_child(k: size_t, i: size_t) -> static[inline[size_t]]:
+    return k * (BTREE_KEYS + 1) + i + 1
+
+def btree_fill(sorted: -const[int64_t], n: size_t, keys: -int64_t, rank: -size_t, next: -size_t, k: size_t) -> static[void]:
+    # In-order: child i, then key i, for each key; then the last child.
+    nodes: size_t = btree_nodes(n)
+    if k < nodes:
+        for i in size_t(i := 0)(i < BTREE_KEYS)(i ** _):
+            btree_fill(sorted, n, keys, rank, next, btree_child(k, i))
+            slot: size_t = k * BTREE_KEYS + i
+            keys[slot] = sorted[next._] if next._ < n else SEARCH_NONE
+            if rank:
+                rank[slot] = next._ if next._ < n else n
+            next._ += 1
+        btree_fill(sorted, n, keys, rank, next, btree_child(k, BTREE_KEYS))
+
+def btree_build(sorted: -const[int64_t], n: size_t, keys: -int64_t, rank: -size_t) -> static[inline[void]]:
+    # keys (and rank, unless NULL) need btree_size(n) entries.
+    next: size_t = 0
+    none: size_t = btree_nodes(n) * BTREE_KEYS
+    keys[none] = SEARCH_NONE
+    if rank:
+        rank[none] = n
+    btree_fill(sorted, n, keys, rank, _.next, 0)
+
+def btree_lower_bound(keys: -const[int64_t], n: size_t, key: int64_t) -> static[inline[size_t]]:
+    nodes: size_t = btree_nodes(n)
+    result: size_t = nodes * BTREE_KEYS
+    k: size_t = 0
+    while k < nodes:
+        node: -const[int64_t] = keys + k * BTREE_KEYS
+        # Keys in the node below key, counted without branches
+        i: size_t = 0
+        for j in size_t(j := 0)(j < BTREE_KEYS)(j ** _):
+            i += node[j] < key
+        if i < BTREE_KEYS:
+            result = k * BTREE_KEYS + i
+        k = btree_child(k, i)
+    return result
@@ -0,0 +1,161 @@
+# Hierarchical timing wheel (Varghese & Lauck) for large numbers of timeouts:
+# O(1) add and cancel, expiry in batches. Time is counted in ticks of the
+# caller's choosing (e.g. milliseconds). Timers are intrusive: embed a timer
+# in the struct it times out and get back to that struct with timer_entry().
+# Nothing is allocated. A wheel belongs to one thread (its event loop).
+#
+# Level L has 64 slots of 64^L ticks each, so six levels cover 2^36 ticks;
+# later deadlines wait in the last level. A timer is linked into the slot of
+# the lowest level whose range covers its deadline. When the levels below
+# wrap around to a slot, its timers are redistributed ("cascaded") to lower
+# levels. A bitmap per level marks the slots that hold timers, so idle
+# stretches are jumped over in one step.
+
+from stdint import *
+from stddef import *
+from string import *
+
+TW_BITS: macro = 6
+TW_SLOTS: macro = 64
+TW_MASK: macro = 63
+TW_LEVELS: macro = 6
+
+@typedef(timer)
+class timer:
+    next: -type[timer]
+    pprev: --type[timer]    # Link that points to this timer; NULL if not pending
+    expires: uint64_t
+    slot: uint32_t          # level * TW_SLOTS + index
+
+@typedef(timer_wheel)
+class timer_wheel:
+    slots: list[-type[timer], TW_LEVELS * TW_SLOTS]
+    occupied: uint64_t[TW_LEVELS]
+    now: uint64_t
+    count: size_t
+
+def timer_entry(ptr, T, member):
+    [-T]([-char](ptr) - offsetof(T, member))
+
+def timer_wheel_init(w: -timer_wheel, now: uint64_t) -> static[inline[void]]:
+    memset(w, 0, sizeof(timer_wheel))
+    w._.now = now
+
+def timer_init(t: -timer) -> static[inline[void]]:
+    t._.next = NULL
+    t._.pprev = NULL
+
+def timer_pending(t: -const[timer]) -> static[inline[int]]:
+    return t._.pprev != NULL
+
+def timer_wheel_insert(w: -timer_wheel, t: -timer, level: uint32_t, index: uint32_t) -> static[inline[void]]:
+    # Links t into slot index of level.
+    slot: uint32_t = level * TW_SLOTS + index
+    t._.slot = slot
+    t._.next = w._.slots[slot]
+    if t._.next:
+        t._.next._.pprev = _.t._.next
+    w._.slots[slot] = t
+    t._.pprev = w._.slots + slot
+    w._.occupied[level] |= [uint64_t](1) << index
+
+def timer_wheel_link(w: -timer_wheel, t: -timer) -> static[inline[void]]:
+    # Links t into the slot for its deadline, counted from w.now.
+    expires: uint64_t = t._.expires
+    if expires <= w._.now:
+        expires = w._.now + 1
+    delta: uint64_t = expires - w._.now
+    if delta >> (TW_BITS * TW_LEVELS) != 0:
+        expires = w._.now + ([uint64_t](1) << (TW_BITS * TW_LEVELS)) - 1
+        delta = expires - w._.now
+    level: uint32_t = 0
+    while level < TW_LEVELS - 1 and delta >> (TW_BITS * (level + 1)) != 0:
+        level += 1
+    timer_wheel_insert(w, t, level, expires >> (TW_BITS * level) & TW_MASK)
+
+def timer_cancel(w: -timer_wheel, t: -timer) -> static[inline[void]]:
+    # Disarms t; does nothing if it is not pending.
+    if not t._.pprev:
+        return
+    t._.pprev._ = t._.next
+    if t._.next:
+        t._.next._.pprev = t._.pprev
+    if not w._.slots[t._.slot]:
+        w._.occupied[t._.slot / TW_SLOTS] &= ~([uint64_t](1) << (t._.slot & TW_MASK))
+    t._.next = NULL
+    t._.pprev = NULL
+    w._.count -= 1
+
+def timer_add(w: -timer_wheel, t: -timer, expires: uint64_t) -> static[inline[void]]:
+    # Arms t to expire at tick expires (re-arms it if pending). A deadline
+    # not after w.now expires at the next tick.
+    if t._.pprev:
+        timer_cancel(w, t)
+    t._.expires = expires
+    timer_wheel_link(w, t)
+    w._.count += 1
+
+def timer_wheel_take(w: -timer_wheel, level: uint32_t, index: uint32_t) -> static[inline[-timer]]:
+    # Empties a slot and returns its chain.
+    slot: uint32_t = level * TW_SLOTS + index
+    chain: -timer = w._.slots[slot]
+    w._.slots[slot] = NULL
+    w._.occupied[level] &= ~([uint64_t](1) << index)
+    return chain
+
+def timer_wheel_cascade(w: -timer_wheel, level: uint32_t) -> static[inline[uint32_t]]:
+    # Moves the timers of the current slot of level down; returns its index.
+    index: uint32_t = w._.now >> (TW_BITS * level) & TW_MASK
+    t: -timer = timer_wheel_take(w, level, index)
+    while t:
+        next: -timer = t._.next
+        if t._.expires <= w._.now:
+            # Due at this tick: its level-0 slot is expired right after the cascade
+            timer_wheel_insert(w, t, 0, w._.now & TW_MASK)
+        else:
+            timer_wheel_link(w, t)
+        t = next
+    return index
+
+def timer_wheel_next_expiry(w: -const[timer_wheel]) -> static[inline[uint64_t]]:
+    # The next tick at which a slot holding timers comes up: after w.now and
+    # no later than the earliest deadline, for an event loop's poll timeout.
+    # UINT64_MAX if no timer is pending.
+    earliest: uint64_t = UINT64_MAX
+    for level in uint32_t(level := 0)(level < TW_LEVELS)(level ** _):
+        bits: uint64_t = w._.occupied[level]
+        if bits:
+            shift: uint32_t = TW_BITS * level
+            start: uint32_t = (w._.now >> shift) + 1 & TW_MASK
+            rotated: uint64_t = bits >> start | bits << (64 - start) if start else bits
+            tick: uint64_t = ((w._.now >> shift) + ____builtin_ctzll(rotated) + 1) << shift
+            earliest = tick if tick < earliest else earliest
+    return earliest
+
+def timer_wheel_expire(w: -timer_wheel, now: uint64_t) -> static[inline[-timer]]:
+    # Advances the wheel to tick now and returns the timers that expired,
+    # chained through next in no particular order. They are no longer
+    # pending, so the caller may re-add them while walking the chain.
+    expired: -timer = NULL
+    while w._.now < now:
+        # Ticks before the next occupied slot do nothing: jump over them
+        tick: uint64_t = timer_wheel_next_expiry(w)
+        if tick > now:
+            w._.now = now
+            break
+        w._.now = tick
+        if (tick & TW_MASK) == 0:
+            for level in uint32_t(level := 1)(level < TW_LEVELS)(level ** _):
+                if timer_wheel_cascade(w, level) != 0:
+                    break
+        index: uint32_t = tick & TW_MASK
+        if w._.occupied[0] >> index & 1:
+            t: -timer = timer_wheel_take(w, 0, index)
+            while t:
+                next: -timer = t._.next
+                t._.pprev = NULL
+                t._.next = expired
+                expired = t
+                w._.count -= 1
+                t = next
+    return expired
@@ -0,0 +1,49 @@
+"""
+Shared prelude header for precompilation.
+
+Most modules of a project start with the same system includes, and each .c
+file parses those headers again. make_prelude() collects the unconditional
+system includes (from X import *) of every module into one header, which
+GCC or Clang can precompile:
+
+    gcc -x c-header prelude.h        # writes prelude.h.gch
+
+Modules transpiled with prelude='prelude.h' include it first and omit the
+system headers it covers; their own includes follow.
+"""
+
+import ast
+import re
+from typing import Iterable
+
+PRELUDE_GUARD = "ARAFURA_PRELUDE_H"
+
+
+def system_includes(source: str) -> list[str]:
+    """Headers of the top-level, unconditional from X import * statements."""
+    headers = []
+    for stmt in ast.parse(source).body:
+        if (isinstance(stmt, ast.ImportFrom) and stmt.module and not stmt.module.startswith('arafura.')
+                and stmt.names[0].name == '*'):
+            headers.append(f"{stmt.module}.h")
+    return headers
+
+
+def make_prelude(sources: Iterable[str]) -> str:
+    """Prelude header including every module's system headers, in first-use order."""
+    headers = {}
+    for source in sources:
+        headers.update(dict.fromkeys(system_includes(source)))
+    lines = [
+        "/* Generated by arafura: system headers shared by the project's modules. */",
+        f"#ifndef {PRELUDE_GUARD}",
+        f"#define {PRELUDE_GUARD}",
+        *(f"#include <{header}>" for header in headers),
+        "#endif",
+    ]
+    return "\n".join(lines) + "\n"
+
+
+def read_prelude(text: str) -> list[str]:
+    """Headers a prelude made by make_prelude() includes."""
+    return re.findall(r"^#include <([^>]+)>", text, re.MULTILINE)
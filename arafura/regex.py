@@ -0,0 +1,423 @@
+"""
+Regular expressions compiled to DFAs at transpile time.
+
+re_match("pattern", s, n) and re_search("pattern", s, n) take a pattern
+literal, which is compiled here to a minimized DFA and emitted as a
+table-driven C function: one table lookup per input byte, no backtracking
+and no compilation at run time.
+
+Both return 1 or 0 with Python's meaning: re_match tests for a match
+starting at s[0] (re.match), re_search for one anywhere (re.search). The
+DFA accepts the whole input, with the unanchored sides padded by "any
+bytes"; once it reaches the sink that accepts everything (or nothing),
+the loop stops early.
+
+Patterns work on bytes with the meaning Python's re gives bytes patterns:
+literals, ., [...] and [^...], \\d \\w \\s and their negations, groups (...)
+and (?:...), |, * + ? {m} {m,} {,n} {m,n} (lazy forms match the same strings),
+^ at the start and $ at the end of the pattern or of a top-level
+alternative. Backreferences, lookaround and \\b need
+more than a DFA and are rejected.
+"""
+
+from typing import NamedTuple
+
+from arafura.runtime import c_array
+
+ANY = frozenset(range(256))
+NEWLINE = frozenset(b"\n")
+DIGIT = frozenset(b"0123456789")
+WORD = frozenset(b"abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789_")
+SPACE = frozenset(b" \t\n\r\f\v")
+CLASS_ESCAPES = {
+    'd': DIGIT, 'D': ANY - DIGIT,
+    'w': WORD, 'W': ANY - WORD,
+    's': SPACE, 'S': ANY - SPACE,
+}
+CHAR_ESCAPES = {'n': 10, 't': 9, 'r': 13, 'f': 12, 'v': 11, 'a': 7, '0': 0}
+
+# Largest DFA emitted; beyond this the pattern is rejected
+MAX_STATES = 4096
+MAX_REPEAT = 1000
+
+# The DFA's first two states: no match possible, and match certain
+DEAD, ACCEPT = 0, 1
+
+
+class Dfa(NamedTuple):
+    classes: list[int]          # Byte -> equivalence class
+    table: list[list[int]]      # State -> class -> state
+    accepting: list[bool]
+    start: int
+
+
+# ============================================================================
+# Parsing: pattern -> tree of ('set', bytes) ('cat', items) ('alt', items)
+# ('repeat', item, min, max or None)
+# ============================================================================
+
+class Parser:
+    """Recursive-descent parser for the supported pattern syntax."""
+
+    def __init__(self, pattern: str):
+        self.pattern = pattern
+        self.pos = 0
+
+    def error(self, message: str) -> ValueError:
+        return ValueError(f"Regex {self.pattern!r} at {self.pos}: {message}")
+
+    def peek(self) -> str | None:
+        return self.pattern[self.pos] if self.pos < len(self.pattern) else None
+
+    def take(self) -> str:
+        char = self.pattern[self.pos]
+        self.pos += 1
+        return char
+
+    def parse(self) -> list[tuple[bool, tuple, bool]]:
+        """The top-level alternatives: (starts with ^, tree, ends with $)."""
+        alternatives = []
+        while True:
+            anchored_start = self.peek() == '^'
+            if anchored_start:
+                self.take()
+            items = []
+            anchored_end = False
+            while self.peek() not in (None, '|', ')'):
+                if self.peek() == '$' and self.pattern[self.pos + 1:self.pos + 2] in ('', '|'):
+                    self.take()
+                    anchored_end = True
+                    break
+                items.append(self.repetition())
+            alternatives.append((anchored_start, ('cat', items), anchored_end))
+            if self.peek() != '|':
+                break
+            self.take()
+        if self.pos != len(self.pattern):
+            raise self.error("unbalanced )")
+        return alternatives
+
+    def alternation(self) -> tuple:
+        items = [self.concatenation()]
+        while self.peek() == '|':
+            self.take()
+            items.append(self.concatenation())
+        return items[0] if len(items) == 1 else ('alt', items)
+
+    def concatenation(self) -> tuple:
+        items = []
+        while self.peek() not in (None, '|', ')'):
+            items.append(self.repetition())
+        return ('cat', items)
+
+    def repetition(self) -> tuple:
+        item = self.atom()
+        while self.peek() in ('*', '+', '?', '{'):
+            if self.peek() == '{':
+                bounds = self.bounds()
+                if bounds is None:
+                    break
+                low, high = bounds
+            else:
+                low, high = {'*': (0, None), '+': (1, None), '?': (0, 1)}[self.take()]
+            if self.peek() == '?':
+                self.take()    # Lazy: same strings match
+            item = ('repeat', item, low, high)
+        return item
+
+    def bounds(self) -> tuple[int, int | None] | None:
+        """{m}, {m,}, {,n} or {m,n}; None if the brace is a literal."""
+        end = self.pattern.find('}', self.pos)
+        if end < 0:
+            return None
+        low, comma, high = self.pattern[self.pos + 1:end].partition(',')
+        if not (low.isdigit() or (comma and not low)) or (high and not high.isdigit()):
+            return None
+        self.pos = end + 1
+        low_value = int(low) if low else 0
+        high_value = low_value if not comma else (int(high) if high else None)
+        if high_value is not None and high_value < low_value:
+            raise self.error("bad repeat bounds")
+        if max(low_value, high_value or 0) > MAX_REPEAT:
+            raise self.error(f"repeat count above {MAX_REPEAT}")
+        return low_value, high_value
+
+    def atom(self) -> tuple:
+        char = self.take()
+        if char == '(':
+            if self.peek() == '?':
+                if self.pattern.startswith('?:', self.pos):
+                    self.pos += 2
+                else:
+                    raise self.error("only (?:...) groups are supported")
+            tree = self.alternation()
+            if self.peek() != ')':
+                raise self.error("missing )")
+            self.take()
+            return tree
+        if char == '[':
+            return ('set', self.char_class())
+        if char == '.':
+            return ('set', ANY - NEWLINE)
+        if char == '\\':
+            return ('set', self.escape(in_class=False))
+        if char in '*+?':
+            raise self.error("nothing to repeat")
+        if char in '^$':
+            raise self.error(f"{char} is only supported at the {'start' if char == '^' else 'end'}")
+        return self.literal(char)
+
+    def literal(self, char: str) -> tuple:
+        data = char.encode('utf-8')
+        if len(data) == 1:
+            return ('set', frozenset(data))
+        return ('cat', [('set', frozenset([byte])) for byte in data])
+
+    def escape(self, in_class: bool) -> frozenset[int]:
+        if self.peek() is None:
+            raise self.error("trailing backslash")
+        char = self.take()
+        if char in CLASS_ESCAPES:
+            return CLASS_ESCAPES[char]
+        if char in CHAR_ESCAPES:
+            return frozenset([CHAR_ESCAPES[char]])
+        if char == 'x':
+            digits = self.pattern[self.pos:self.pos + 2]
+            if len(digits) != 2 or not all(d in '0123456789abcdefABCDEF' for d in digits):
+                raise self.error("\\x needs two hex digits")
+            self.pos += 2
+            return frozenset([int(digits, 16)])
+        if char == 'b' and in_class:
+            return frozenset([8])
+        if char.isalnum() or ord(char) > 127:
+            raise self.error(f"unsupported escape \\{char}")
+        return frozenset([ord(char)])
+
+    def char_class(self) -> frozenset[int]:
+        negate = self.peek() == '^'
+        if negate:
+            self.take()
+        members = set()
+        first = True
+        while True:
+            char = self.peek()
+            if char is None:
+                raise self.error("missing ]")
+            if char == ']' and not first:
+                self.take()
+                break
+            first = False
+            low = self.class_item()
+            if self.peek() == '-' and self.pattern[self.pos + 1:self.pos + 2] not in ('', ']'):
+                self.take()
+                high = self.class_item()
+                if len(low) != 1 or len(high) != 1 or min(low) > min(high):
+                    raise self.error("bad range")
+                members.update(range(min(low), min(high) + 1))
+            else:
+                members.update(low)
+        return ANY - frozenset(members) if negate else frozenset(members)
+
+    def class_item(self) -> frozenset[int]:
+        char = self.take()
+        if char == '\\':
+            return self.escape(in_class=True)
+        if ord(char) > 127:
+            raise self.error("non-ASCII character in class")
+        return frozenset([ord(char)])
+
+
+def parse(pattern: str, search: bool) -> tuple:
+    """
+    The language the DFA must accept in full: each top-level alternative,
+    preceded by any bytes for search unless it starts with ^, followed by
+    any bytes unless it ends with $ (which, as in Python, also allows one
+    final newline).
+    """
+    alternatives = []
+    for anchored_start, tree, anchored_end in Parser(pattern).parse():
+        items = []
+        if search and not anchored_start:
+            items.append(('repeat', ('set', ANY), 0, None))
+        items.append(tree)
+        if anchored_end:
+            items.append(('repeat', ('set', NEWLINE), 0, 1))
+        else:
+            items.append(('repeat', ('set', ANY), 0, None))
+        alternatives.append(('cat', items))
+    return alternatives[0] if len(alternatives) == 1 else ('alt', alternatives)
+
+
+# ============================================================================
+# Thompson NFA
+# ============================================================================
+
+class Nfa:
+    """NFA with byte-set and epsilon transitions."""
+
+    def __init__(self):
+        self.edges: list[list[tuple[frozenset[int], int]]] = []
+        self.epsilon: list[list[int]] = []
+
+    def state(self) -> int:
+        self.edges.append([])
+        self.epsilon.append([])
+        return len(self.edges) - 1
+
+    def build(self, tree: tuple) -> tuple[int, int]:
+        """Fragment for tree: (start, end)."""
+        kind = tree[0]
+        if kind == 'set':
+            start, end = self.state(), self.state()
+            self.edges[start].append((tree[1], end))
+            return start, end
+        if kind == 'cat':
+            start = end = self.state()
+            for item in tree[1]:
+                item_start, item_end = self.build(item)
+                self.epsilon[end].append(item_start)
+                end = item_end
+            return start, end
+        if kind == 'alt':
+            start, end = self.state(), self.state()
+            for item in tree[1]:
+                item_start, item_end = self.build(item)
+                self.epsilon[start].append(item_start)
+                self.epsilon[item_end].append(end)
+            return start, end
+        # repeat: min copies, then max - min optional copies or a loop
+        _, item, low, high = tree
+        start = end = self.state()
+        for _ in range(low):
+            item_start, item_end = self.build(item)
+            self.epsilon[end].append(item_start)
+            end = item_end
+        if high is None:
+            item_start, item_end = self.build(item)
+            self.epsilon[end].append(item_start)
+            self.epsilon[item_end].append(item_start)
+            exit_state = self.state()
+            self.epsilon[end].append(exit_state)
+            self.epsilon[item_end].append(exit_state)
+            return start, exit_state
+        exit_state = self.state()
+        for _ in range(high - low):
+            item_start, item_end = self.build(item)
+            self.epsilon[end].append(item_start)
+            self.epsilon[end].append(exit_state)
+            end = item_end
+        self.epsilon[end].append(exit_state)
+        return start, exit_state
+
+    def closure(self, states) -> frozenset[int]:
+        seen = set(states)
+        stack = list(states)
+        while stack:
+            for target in self.epsilon[stack.pop()]:
+                if target not in seen:
+                    seen.add(target)
+                    stack.append(target)
+        return frozenset(seen)
+
+
+# ============================================================================
+# DFA: subset construction over byte classes, then minimization
+# ============================================================================
+
+def byte_classes(nfa: Nfa) -> list[int]:
+    """Partition bytes into classes no transition distinguishes."""
+    sets = list({byte_set for edges in nfa.edges for byte_set, _ in edges})
+    signatures = {}
+    classes = []
+    for byte in range(256):
+        signature = tuple(byte in byte_set for byte_set in sets)
+        classes.append(signatures.setdefault(signature, len(signatures)))
+    return classes
+
+
+def minimize(table: list[list[int]], accepting: list[bool]) -> tuple[list[int], int]:
+    """Moore's partition refinement: block of each state, and the block count."""
+    blocks = [int(a) for a in accepting]
+    count = len(set(blocks))
+    while True:
+        signatures = {}
+        refined = [signatures.setdefault((blocks[s], tuple(blocks[t] for t in row)), len(signatures))
+                   for s, row in enumerate(table)]
+        if len(signatures) == count:
+            return refined, count
+        blocks, count = refined, len(signatures)
+
+
+def compile_dfa(pattern: str, search: bool) -> Dfa:
+    """Minimized DFA for re_match (search=False) or re_search."""
+    nfa = Nfa()
+    start, end = nfa.build(parse(pattern, search))
+    classes = byte_classes(nfa)
+    representatives = [classes.index(c) for c in range(max(classes) + 1)]
+
+    # Subset construction
+    initial = nfa.closure([start])
+    index = {initial: 0}
+    subsets = [initial]
+    table = []
+    for subset in subsets:
+        row = []
+        for byte in representatives:
+            targets = nfa.closure([t for s in subset for byte_set, t in nfa.edges[s] if byte in byte_set])
+            if targets not in index:
+                if len(subsets) >= MAX_STATES:
+                    raise ValueError(f"Regex {pattern!r} needs more than {MAX_STATES} DFA states")
+                index[targets] = len(subsets)
+                subsets.append(targets)
+            row.append(index[targets])
+        table.append(row)
+    accepting = [end in subset for subset in subsets]
+
+    # Merge equivalent states; number the dead and accept sinks 0 and 1
+    blocks, count = minimize(table, accepting)
+    block_rows = {blocks[s]: [blocks[t] for t in row] for s, row in enumerate(table)}
+    block_accepting = {blocks[s]: accepting[s] for s in range(len(table))}
+    order = {}
+    for block, row in block_rows.items():
+        if all(t == block for t in row):
+            order[block] = ACCEPT if block_accepting[block] else DEAD
+    next_number = 2
+    for state in range(len(table)):    # Remaining blocks in discovery order
+        if blocks[state] not in order:
+            order[blocks[state]] = next_number
+            next_number += 1
+    width = max(classes) + 1
+    final_table = [[DEAD] * width, [ACCEPT] * width] + [None] * (next_number - 2)
+    final_accepting = [False, True] + [False] * (next_number - 2)
+    for block, row in block_rows.items():
+        number = order[block]
+        if number >= 2:
+            final_table[number] = [order[t] for t in row]
+            final_accepting[number] = block_accepting[block]
+    return Dfa(classes, final_table, final_accepting, order[blocks[0]])
+
+
+def emit_matcher(dfa: Dfa, name: str) -> list[str]:
+    """C code of int name(const char *s, size_t n) running dfa over s."""
+    states = len(dfa.table)
+    state_type = "uint8_t" if states <= 256 else "uint16_t"
+    rows = [f"    {{{', '.join(map(str, row))}}}," for row in dfa.table]
+    accepting = ", ".join(str(int(a)) for a in dfa.accepting)
+    return [
+        f"static const uint8_t {name}_class[256] = {{",
+        *c_array(dfa.classes, 2, 16).split("\n"),
+        "};",
+        f"static const {state_type} {name}_next[{states}][{len(dfa.table[0])}] = {{",
+        *rows,
+        "};",
+        f"static const uint8_t {name}_accept[{states}] = {{{accepting}}};",
+        f"static inline int {name}(const char *s, size_t n) {{",
+        "    const unsigned char *p = (const unsigned char *)s;",
+        f"    unsigned state = {dfa.start};",
+        "    /* States 0 and 1 are the dead and accepting sinks */",
+        "    for (size_t i = 0; i < n && state > 1; i++) {",
+        f"        state = {name}_next[state][{name}_class[p[i]]];",
+        "    }",
+        f"    return {name}_accept[state];",
+        "}",
+    ]
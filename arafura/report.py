@@ -0,0 +1,114 @@
+"""
+Per-function stack usage and code size, attributed to the arafura source.
+
+size_report() transpiles a module, compiles it with GCC's -fstack-usage and
+reads each function's frame size from the .su file and its code size from
+the object file's symbol table (nm -S). Both are keyed by C function name;
+the report maps them back to the def that produced the function, so deep
+recursion with large frames and over-inlined functions can be found in the
+.py source rather than in generated C.
+
+Functions that were inlined everywhere have no symbol and no .su entry and
+are not reported. Support code (runtime snippets, regex matchers) is
+reported without a source line.
+"""
+
+import ast
+import subprocess
+import tempfile
+from pathlib import Path
+from typing import NamedTuple
+
+from arafura.transpiler import CTranspiler, DERIVE_TRAITS, transpile
+
+# Default thresholds for flagging a function
+MAX_STACK = 4096
+MAX_CODE = 4096
+
+
+class FunctionSize(NamedTuple):
+    name: str             # C function name
+    line: int | None      # Line of the def (or class) in the source
+    stack: int | None     # Frame size in bytes, from -fstack-usage
+    stack_kind: str       # static, dynamic or "dynamic,bounded"
+    code: int | None      # Code size in bytes, from nm -S
+
+
+def source_functions(source: str) -> dict[str, int]:
+    """C function name -> line of the definition that produces it."""
+    transpiler = CTranspiler()
+    lines = {}
+    for node in ast.parse(source).body:
+        if isinstance(node, ast.FunctionDef):
+            lines[transpiler.escape_identifier(node.name)] = node.lineno
+        elif isinstance(node, ast.ClassDef):
+            for stmt in node.body:
+                if isinstance(stmt, ast.FunctionDef):
+                    lines[CTranspiler.method_function(node.name, stmt).name] = stmt.lineno
+            for trait in DERIVE_TRAITS:
+                lines[f"{node.name}_{trait}"] = node.lineno
+    return lines
+
+
+def parse_stack_usage(text: str) -> dict[str, tuple[int, str]]:
+    """Parse a .su file: 'file.c:LINE:COL:name<TAB>bytes<TAB>kind' lines."""
+    usage = {}
+    for line in text.splitlines():
+        location, size, kind = line.split("\t")
+        usage[location.rsplit(":", 1)[-1]] = (int(size), kind)
+    return usage
+
+
+def parse_symbol_sizes(text: str) -> dict[str, int]:
+    """Sizes of the code symbols in nm -S output."""
+    sizes = {}
+    for line in text.splitlines():
+        fields = line.split()
+        if len(fields) == 4 and fields[2] in ('t', 'T'):
+            sizes[fields[3]] = int(fields[1], 16)
+    return sizes
+
+
+def size_report(source: str, cc: str = "gcc", flags: tuple[str, ...] = ("-O2",), **options) -> list[FunctionSize]:
+    """
+    Compile source (options are those of transpile()) with cc and flags and
+    report every function in the object file, largest stack first.
+    """
+    c_code = transpile(source, **options)
+    with tempfile.TemporaryDirectory() as directory:
+        path = Path(directory)
+        (path / "module.c").write_text(c_code, encoding="utf-8")
+        subprocess.run([cc, *flags, "-fstack-usage", "-c", "module.c", "-o", "module.o"],
+                       cwd=path, check=True, capture_output=True, text=True)
+        usage = parse_stack_usage((path / "module.su").read_text(encoding="utf-8"))
+        symbols = subprocess.run(["nm", "-S", "--defined-only", "module.o"],
+                                 cwd=path, check=True, capture_output=True, text=True).stdout
+    sizes = parse_symbol_sizes(symbols)
+    lines = source_functions(source)
+    report = []
+    for name in usage.keys() | sizes.keys():
+        stack, kind = usage.get(name, (None, ""))
+        report.append(FunctionSize(name, lines.get(name), stack, kind, sizes.get(name)))
+    return sorted(report, key=lambda f: (-(f.stack or 0), -(f.code or 0), f.name))
+
+
+def format_report(report: list[FunctionSize], filename: str,
+                  max_stack: int = MAX_STACK, max_code: int = MAX_CODE) -> tuple[list[str], int]:
+    """The report as a table followed by warnings; also the number of warnings."""
+    rows = [f"{'stack':>8} {'code':>8}  function"]
+    warnings = []
+    for function in report:
+        location = f"{filename}:{function.line}" if function.line else "(support code)"
+        stack = "?" if function.stack is None else str(function.stack)
+        if function.stack_kind.startswith("dynamic"):
+            stack += "+"
+        code = "?" if function.code is None else str(function.code)
+        rows.append(f"{stack:>8} {code:>8}  {function.name}  {location}")
+        prefix = f"{filename}:{function.line or 1}: warning: {function.name}"
+        if function.stack is not None and function.stack > max_stack:
+            warnings.append(f"{prefix} uses {function.stack} bytes of stack (limit {max_stack})")
+        if function.stack_kind.startswith("dynamic") and "bounded" not in function.stack_kind:
+            warnings.append(f"{prefix} has an unbounded dynamic stack frame")
+        if function.code is not None and function.code > max_code:
+            warnings.append(f"{prefix} is {function.code} bytes of code (limit {max_code})")
+    return rows + warnings, len(warnings)
@@ -0,0 +1,906 @@
+"""
+C support code for types and builtins that have no direct C spelling.
+
+The transpiler emits a snippet (after its dependencies and includes) the first
+time generated code uses it. All names are prefixed arafura_ and all functions
+are static, so every translation unit can carry its own copy.
+"""
+
+from typing import NamedTuple
+
+
+class RuntimeSnippet(NamedTuple):
+    includes: tuple[str, ...]  # System headers
+    requires: tuple[str, ...]  # Other snippets that must come first
+    code: str
+
+
+# ============================================================================
+# HALF PRECISION AND BFLOAT16
+# ============================================================================
+
+# IEEE binary16 storage. _Float16 where the compiler has it, otherwise the raw
+# bits in a uint16_t; either way, convert through the functions below.
+# Scalar fallbacks round to nearest even (after F. Giesen's half conversions).
+FLOAT16 = RuntimeSnippet(
+    includes=("stddef.h", "stdint.h", "string.h"),
+    requires=(),
+    code=r"""
+#if defined(__F16C__) || defined(__AVX512F__)
+#include <immintrin.h>
+#endif
+#if defined(__FLT16_MAX__) && !defined(ARAFURA_NO_NATIVE_FLOAT16)
+#define ARAFURA_NATIVE_FLOAT16 1
+typedef _Float16 arafura_f16;
+#else
+typedef uint16_t arafura_f16;
+#endif
+
+static inline float arafura_f16_bits_to_f32(uint16_t h) {
+    const uint32_t shifted_exp = 0x7c00u << 13;
+    const uint32_t magic_bits = 113u << 23;
+    uint32_t o = ((uint32_t)h & 0x7fffu) << 13;
+    uint32_t exp = shifted_exp & o;
+    float f, magic;
+    o += (uint32_t)(127 - 15) << 23;
+    if (exp == shifted_exp) {
+        o += (uint32_t)(128 - 16) << 23;  /* Inf/NaN */
+    } else if (exp == 0) {
+        o += 1u << 23;                    /* Zero/subnormal: renormalize */
+        memcpy(&f, &o, 4);
+        memcpy(&magic, &magic_bits, 4);
+        f -= magic;
+        memcpy(&o, &f, 4);
+    }
+    o |= ((uint32_t)h & 0x8000u) << 16;
+    memcpy(&f, &o, 4);
+    return f;
+}
+
+static inline uint16_t arafura_f32_to_f16_bits(float value) {
+    const uint32_t f32_infinity = 255u << 23;
+    const uint32_t f16_max = (127u + 16u) << 23;
+    const uint32_t denorm_magic_bits = ((127u - 15u) + (23u - 10u) + 1u) << 23;
+    uint32_t x, sign;
+    uint16_t o;
+    memcpy(&x, &value, 4);
+    sign = x & 0x80000000u;
+    x ^= sign;
+    if (x >= f16_max) {
+        o = x > f32_infinity ? 0x7e00 : 0x7c00;  /* NaN stays NaN, overflow to Inf */
+    } else if (x < (113u << 23)) {
+        float f, magic;                           /* Subnormal result: let the FPU round */
+        uint32_t r;
+        memcpy(&f, &x, 4);
+        memcpy(&magic, &denorm_magic_bits, 4);
+        f += magic;
+        memcpy(&r, &f, 4);
+        o = (uint16_t)(r - denorm_magic_bits);
+    } else {
+        uint32_t mant_odd = (x >> 13) & 1u;       /* Round to nearest even */
+        x += ((uint32_t)(15 - 127) << 23) + 0xfffu;
+        x += mant_odd;
+        o = (uint16_t)(x >> 13);
+    }
+    return (uint16_t)(o | (sign >> 16));
+}
+
+static inline float arafura_f16_to_f32(arafura_f16 h) {
+#if defined(ARAFURA_NATIVE_FLOAT16)
+    return (float)h;
+#else
+    return arafura_f16_bits_to_f32(h);
+#endif
+}
+
+static inline arafura_f16 arafura_f32_to_f16(float f) {
+#if defined(ARAFURA_NATIVE_FLOAT16)
+    return (arafura_f16)f;
+#else
+    return arafura_f32_to_f16_bits(f);
+#endif
+}
+
+static inline void arafura_f16_to_f32_n(float *dst, const arafura_f16 *src, size_t n) {
+    size_t i = 0;
+#if defined(__AVX512F__)
+    for (; i + 16 <= n; i += 16) {
+        __m256i h = _mm256_loadu_si256((const __m256i *)(src + i));
+        _mm512_storeu_ps(dst + i, _mm512_cvtph_ps(h));
+    }
+#elif defined(__F16C__)
+    for (; i + 8 <= n; i += 8) {
+        __m128i h = _mm_loadu_si128((const __m128i *)(src + i));
+        _mm256_storeu_ps(dst + i, _mm256_cvtph_ps(h));
+    }
+#endif
+    for (; i < n; i++) {
+        dst[i] = arafura_f16_to_f32(src[i]);
+    }
+}
+
+static inline void arafura_f32_to_f16_n(arafura_f16 *dst, const float *src, size_t n) {
+    size_t i = 0;
+#if defined(__AVX512F__)
+    for (; i + 16 <= n; i += 16) {
+        __m256i h = _mm512_cvtps_ph(_mm512_loadu_ps(src + i), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+        _mm256_storeu_si256((__m256i *)(dst + i), h);
+    }
+#elif defined(__F16C__)
+    for (; i + 8 <= n; i += 8) {
+        __m128i h = _mm256_cvtps_ph(_mm256_loadu_ps(src + i), _MM_FROUND_TO_NEAREST_INT);
+        _mm_storeu_si128((__m128i *)(dst + i), h);
+    }
+#endif
+    for (; i < n; i++) {
+        dst[i] = arafura_f32_to_f16(src[i]);
+    }
+}
+""",
+)
+
+# bfloat16 storage: the high half of a binary32. __bf16 where the compiler
+# treats it as an arithmetic type, otherwise uint16_t bits.
+BFLOAT16 = RuntimeSnippet(
+    includes=("stddef.h", "stdint.h", "string.h"),
+    requires=(),
+    code=r"""
+#if defined(__AVX512BF16__) && defined(__AVX512VL__)
+#include <immintrin.h>
+#endif
+#if defined(__BFLT16_MAX__) && !defined(ARAFURA_NO_NATIVE_FLOAT16)
+typedef __bf16 arafura_bf16;
+#else
+typedef uint16_t arafura_bf16;
+#endif
+
+static inline float arafura_bf16_to_f32(arafura_bf16 h) {
+    uint16_t bits;
+    uint32_t u;
+    float f;
+    memcpy(&bits, &h, 2);
+    u = (uint32_t)bits << 16;
+    memcpy(&f, &u, 4);
+    return f;
+}
+
+static inline arafura_bf16 arafura_f32_to_bf16(float f) {
+    uint32_t u;
+    uint16_t bits;
+    arafura_bf16 h;
+    memcpy(&u, &f, 4);
+    if ((u & 0x7fffffffu) > 0x7f800000u) {
+        bits = (uint16_t)((u >> 16) | 0x40u);  /* Quiet NaN */
+    } else {
+        u += 0x7fffu + ((u >> 16) & 1u);       /* Round to nearest even */
+        bits = (uint16_t)(u >> 16);
+    }
+    memcpy(&h, &bits, 2);
+    return h;
+}
+
+static inline void arafura_bf16_to_f32_n(float *dst, const arafura_bf16 *src, size_t n) {
+    /* A shift per element; compilers vectorize this loop as written */
+    for (size_t i = 0; i < n; i++) {
+        dst[i] = arafura_bf16_to_f32(src[i]);
+    }
+}
+
+static inline void arafura_f32_to_bf16_n(arafura_bf16 *dst, const float *src, size_t n) {
+    size_t i = 0;
+#if defined(__AVX512BF16__) && defined(__AVX512VL__)
+    /* Note: the instruction treats subnormal inputs as zero */
+    for (; i + 16 <= n; i += 16) {
+        __m256bh h = _mm512_cvtneps_pbh(_mm512_loadu_ps(src + i));
+        memcpy(dst + i, &h, sizeof h);
+    }
+#endif
+    for (; i < n; i++) {
+        dst[i] = arafura_f32_to_bf16(src[i]);
+    }
+}
+""",
+)
+
+
+# ============================================================================
+# BYTE SEARCH
+# ============================================================================
+
+# Compare a 32-byte (AVX2) or 16-byte (SSE2) block against the needle and
+# movemask the result: one compare per block instead of one branch per byte.
+# Tails, and targets without SSE2, run the scalar loop.
+SIMD_INCLUDE = """
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+"""
+
+FIND_BYTE = RuntimeSnippet(
+    includes=("stddef.h",),
+    requires=(),
+    code=SIMD_INCLUDE + r"""
+/* Index of the first byte equal to c in buf[0..n), or n */
+static inline size_t arafura_find_byte(const void *buf, size_t n, int c) {
+    const unsigned char *p = (const unsigned char *)buf;
+    size_t i = 0;
+#if defined(__AVX2__)
+    const __m256i needle32 = _mm256_set1_epi8((char)c);
+    for (; i + 32 <= n; i += 32) {
+        __m256i block = _mm256_loadu_si256((const __m256i *)(p + i));
+        unsigned mask = (unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, needle32));
+        if (mask) {
+            return i + (size_t)__builtin_ctz(mask);
+        }
+    }
+#endif
+#if defined(__SSE2__)
+    const __m128i needle16 = _mm_set1_epi8((char)c);
+    for (; i + 16 <= n; i += 16) {
+        __m128i block = _mm_loadu_si128((const __m128i *)(p + i));
+        unsigned mask = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(block, needle16));
+        if (mask) {
+            return i + (size_t)__builtin_ctz(mask);
+        }
+    }
+#endif
+    for (; i < n; i++) {
+        if (p[i] == (unsigned char)c) {
+            return i;
+        }
+    }
+    return n;
+}
+""",
+)
+
+# Up to ARAFURA_FIND_ANY_VECTOR needles are OR-ed compares per block; larger
+# sets use a 256-entry membership table.
+FIND_ANY = RuntimeSnippet(
+    includes=("stddef.h",),
+    requires=("find_byte",),
+    code=r"""
+#define ARAFURA_FIND_ANY_VECTOR 8
+
+/* Index of the first byte of buf[0..n) that is one of set[0..k), or n */
+static inline size_t arafura_find_any(const void *buf, size_t n, const char *set, size_t k) {
+    const unsigned char *p = (const unsigned char *)buf;
+    unsigned char member[256] = {0};
+    size_t i = 0;
+    if (k <= 1) {
+        return k == 0 ? n : arafura_find_byte(buf, n, set[0]);
+    }
+#if defined(__AVX2__)
+    if (k <= ARAFURA_FIND_ANY_VECTOR) {
+        __m256i needles[ARAFURA_FIND_ANY_VECTOR];
+        for (size_t j = 0; j < k; j++) {
+            needles[j] = _mm256_set1_epi8(set[j]);
+        }
+        for (; i + 32 <= n; i += 32) {
+            __m256i block = _mm256_loadu_si256((const __m256i *)(p + i));
+            __m256i hit = _mm256_cmpeq_epi8(block, needles[0]);
+            for (size_t j = 1; j < k; j++) {
+                hit = _mm256_or_si256(hit, _mm256_cmpeq_epi8(block, needles[j]));
+            }
+            unsigned mask = (unsigned)_mm256_movemask_epi8(hit);
+            if (mask) {
+                return i + (size_t)__builtin_ctz(mask);
+            }
+        }
+    }
+#elif defined(__SSE2__)
+    if (k <= ARAFURA_FIND_ANY_VECTOR) {
+        __m128i needles[ARAFURA_FIND_ANY_VECTOR];
+        for (size_t j = 0; j < k; j++) {
+            needles[j] = _mm_set1_epi8(set[j]);
+        }
+        for (; i + 16 <= n; i += 16) {
+            __m128i block = _mm_loadu_si128((const __m128i *)(p + i));
+            __m128i hit = _mm_cmpeq_epi8(block, needles[0]);
+            for (size_t j = 1; j < k; j++) {
+                hit = _mm_or_si128(hit, _mm_cmpeq_epi8(block, needles[j]));
+            }
+            unsigned mask = (unsigned)_mm_movemask_epi8(hit);
+            if (mask) {
+                return i + (size_t)__builtin_ctz(mask);
+            }
+        }
+    }
+#endif
+    for (size_t j = 0; j < k; j++) {
+        member[(unsigned char)set[j]] = 1;
+    }
+    for (; i < n; i++) {
+        if (member[p[i]]) {
+            return i;
+        }
+    }
+    return n;
+}
+""",
+)
+
+# Matches are accumulated bytewise (a compare yields -1 per hit) and widened
+# with SAD before the 8-bit lanes could overflow.
+COUNT_BYTE = RuntimeSnippet(
+    includes=("stddef.h",),
+    requires=(),
+    code=SIMD_INCLUDE + r"""
+/* Number of bytes equal to c in buf[0..n) */
+static inline size_t arafura_count_byte(const void *buf, size_t n, int c) {
+    const unsigned char *p = (const unsigned char *)buf;
+    size_t i = 0, count = 0;
+#if defined(__AVX2__)
+    const __m256i needle32 = _mm256_set1_epi8((char)c);
+    while (i + 32 <= n) {
+        __m256i acc = _mm256_setzero_si256(), sums;
+        for (int rounds = 0; rounds < 255 && i + 32 <= n; rounds++, i += 32) {
+            __m256i block = _mm256_loadu_si256((const __m256i *)(p + i));
+            acc = _mm256_sub_epi8(acc, _mm256_cmpeq_epi8(block, needle32));
+        }
+        sums = _mm256_sad_epu8(acc, _mm256_setzero_si256());
+        count += (size_t)(_mm256_extract_epi64(sums, 0) + _mm256_extract_epi64(sums, 1)
+                          + _mm256_extract_epi64(sums, 2) + _mm256_extract_epi64(sums, 3));
+    }
+#elif defined(__SSE2__)
+    const __m128i needle16 = _mm_set1_epi8((char)c);
+    while (i + 16 <= n) {
+        __m128i acc = _mm_setzero_si128(), sums;
+        for (int rounds = 0; rounds < 255 && i + 16 <= n; rounds++, i += 16) {
+            __m128i block = _mm_loadu_si128((const __m128i *)(p + i));
+            acc = _mm_sub_epi8(acc, _mm_cmpeq_epi8(block, needle16));
+        }
+        sums = _mm_sad_epu8(acc, _mm_setzero_si128());
+        count += (size_t)_mm_cvtsi128_si32(sums) + (size_t)_mm_cvtsi128_si32(_mm_srli_si128(sums, 8));
+    }
+#endif
+    for (; i < n; i++) {
+        count += p[i] == (unsigned char)c;
+    }
+    return count;
+}
+""",
+)
+
+
+# ============================================================================
+# CHECKSUMS AND HASHING
+# ============================================================================
+
+def crc32c_tables() -> list[list[int]]:
+    """Slicing-by-8 tables for CRC32C (Castagnoli, reflected 0x82F63B78)."""
+    tables = [[0] * 256 for _ in range(8)]
+    for i in range(256):
+        crc = i
+        for _ in range(8):
+            crc = (crc >> 1) ^ (0x82F63B78 if crc & 1 else 0)
+        tables[0][i] = crc
+    for i in range(256):
+        for t in range(1, 8):
+            prev = tables[t - 1][i]
+            tables[t][i] = (prev >> 8) ^ tables[0][prev & 0xFF]
+    return tables
+
+
+def aes_sbox() -> list[int]:
+    """The AES S-box: inverse in GF(2^8) followed by the affine map."""
+    def mul(a: int, b: int) -> int:
+        product = 0
+        while b:
+            if b & 1:
+                product ^= a
+            a = ((a << 1) ^ (0x11B if a & 0x80 else 0)) & 0xFF
+            b >>= 1
+        return product
+
+    sbox = []
+    for x in range(256):
+        inverse = next((y for y in range(1, 256) if mul(x, y) == 1), 0)
+        rotated = [(inverse << k | inverse >> (8 - k)) & 0xFF for k in range(5)]
+        sbox.append(rotated[0] ^ rotated[1] ^ rotated[2] ^ rotated[3] ^ rotated[4] ^ 0x63)
+    return sbox
+
+
+def c_array(values: list[int], width: int, per_line: int) -> str:
+    """Initializer rows for a C array of hex constants."""
+    rows = [", ".join(f"0x{v:0{width}x}" for v in values[i:i + per_line])
+            for i in range(0, len(values), per_line)]
+    return ",\n".join("    " + row for row in rows)
+
+
+# Hardware paths are compiled with target attributes and chosen at run time,
+# so one binary runs everywhere. Defining ARAFURA_NO_CPU_DISPATCH keeps only
+# the portable code.
+CPU_DISPATCH = RuntimeSnippet(
+    includes=(),
+    requires=(),
+    code=r"""
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__)) && !defined(ARAFURA_NO_CPU_DISPATCH)
+#define ARAFURA_X86_DISPATCH 1
+#include <immintrin.h>
+#endif
+""",
+)
+
+# CRC32C with the SSE4.2 crc32 instruction (8 bytes per instruction), else
+# slicing-by-8 tables. Seeds chain: crc32c(b, m, crc32c(a, n, 0)) is the CRC
+# of a followed by b.
+CRC32C = RuntimeSnippet(
+    includes=("stddef.h", "stdint.h", "string.h"),
+    requires=("cpu_dispatch",),
+    code=r"""
+static const uint32_t arafura_crc32c_table[8][256] = {
+""" + ",\n".join("    {\n" + c_array(table, 8, 8).replace("    ", "        ") + "\n    }"
+                 for table in crc32c_tables()) + r"""
+};
+
+static inline uint32_t arafura_crc32c_portable(const void *buf, size_t n, uint32_t seed) {
+    const unsigned char *p = (const unsigned char *)buf;
+    uint32_t crc = ~seed;
+#if !defined(__BYTE_ORDER__) || __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    for (; n >= 8; n -= 8, p += 8) {
+        uint32_t lo, hi;
+        memcpy(&lo, p, 4);
+        memcpy(&hi, p + 4, 4);
+        lo ^= crc;
+        crc = arafura_crc32c_table[7][lo & 0xff] ^ arafura_crc32c_table[6][(lo >> 8) & 0xff]
+            ^ arafura_crc32c_table[5][(lo >> 16) & 0xff] ^ arafura_crc32c_table[4][lo >> 24]
+            ^ arafura_crc32c_table[3][hi & 0xff] ^ arafura_crc32c_table[2][(hi >> 8) & 0xff]
+            ^ arafura_crc32c_table[1][(hi >> 16) & 0xff] ^ arafura_crc32c_table[0][hi >> 24];
+    }
+#endif
+    for (; n > 0; n--, p++) {
+        crc = (crc >> 8) ^ arafura_crc32c_table[0][(crc ^ *p) & 0xff];
+    }
+    return ~crc;
+}
+
+#if defined(ARAFURA_X86_DISPATCH)
+__attribute__((target("sse4.2")))
+static uint32_t arafura_crc32c_sse42(const void *buf, size_t n, uint32_t seed) {
+    const unsigned char *p = (const unsigned char *)buf;
+    uint64_t crc = ~seed;
+    for (; n >= 8; n -= 8, p += 8) {
+        uint64_t word;
+        memcpy(&word, p, 8);
+        crc = _mm_crc32_u64(crc, word);
+    }
+    for (; n > 0; n--, p++) {
+        crc = _mm_crc32_u8((uint32_t)crc, *p);
+    }
+    return ~(uint32_t)crc;
+}
+#endif
+
+static inline uint32_t arafura_crc32c(const void *buf, size_t n, uint32_t seed) {
+#if defined(ARAFURA_X86_DISPATCH)
+    if (__builtin_cpu_supports("sse4.2")) {
+        return arafura_crc32c_sse42(buf, n, seed);
+    }
+#endif
+    return arafura_crc32c_portable(buf, n, seed);
+}
+""",
+)
+
+# A fast non-cryptographic 64-bit hash built on AES rounds: two lanes each
+# absorb a 16-byte block per round, then three rounds mix the lanes. With
+# AES-NI one round is one instruction; the portable round computes the same
+# function from the S-box, so hashes agree across machines. Not suitable
+# where inputs are chosen by an adversary.
+HASH64 = RuntimeSnippet(
+    includes=("stddef.h", "stdint.h", "string.h"),
+    requires=("cpu_dispatch",),
+    code=r"""
+static const uint8_t arafura_aes_sbox[256] = {
+""" + c_array(aes_sbox(), 2, 16) + r"""
+};
+
+static const uint64_t arafura_hash64_keys[8] = {
+    0x243f6a8885a308d3ull, 0x13198a2e03707344ull, 0xa4093822299f31d0ull, 0x082efa98ec4e6c89ull,
+    0x452821e638d01377ull, 0xbe5466cf34e90c6cull, 0xc0ac29b7c97c50ddull, 0x3f84d5b5b5470917ull,
+};
+
+/* One AES encryption round on 16 bytes: SubBytes, ShiftRows, MixColumns, key */
+static inline void arafura_aesenc_portable(uint8_t state[16], const uint8_t key[16]) {
+    uint8_t t[16];
+    for (int c = 0; c < 4; c++) {
+        for (int r = 0; r < 4; r++) {
+            t[4 * c + r] = arafura_aes_sbox[state[4 * ((c + r) % 4) + r]];
+        }
+    }
+    for (int c = 0; c < 4; c++) {
+        uint8_t a0 = t[4 * c], a1 = t[4 * c + 1], a2 = t[4 * c + 2], a3 = t[4 * c + 3];
+        uint8_t all = a0 ^ a1 ^ a2 ^ a3;
+        #define ARAFURA_XTIME(x) ((uint8_t)(((x) << 1) ^ (((x) >> 7) * 0x1b)))
+        state[4 * c] = a0 ^ all ^ ARAFURA_XTIME(a0 ^ a1) ^ key[4 * c];
+        state[4 * c + 1] = a1 ^ all ^ ARAFURA_XTIME(a1 ^ a2) ^ key[4 * c + 1];
+        state[4 * c + 2] = a2 ^ all ^ ARAFURA_XTIME(a2 ^ a3) ^ key[4 * c + 2];
+        state[4 * c + 3] = a3 ^ all ^ ARAFURA_XTIME(a3 ^ a0) ^ key[4 * c + 3];
+        #undef ARAFURA_XTIME
+    }
+}
+
+static inline uint64_t arafura_hash64_portable(const void *buf, size_t n) {
+    const unsigned char *p = (const unsigned char *)buf;
+    uint64_t a[2] = {arafura_hash64_keys[0] ^ n, arafura_hash64_keys[1]};
+    uint64_t b[2] = {arafura_hash64_keys[2], arafura_hash64_keys[3] ^ n};
+    uint8_t block[16];
+    for (; n >= 32; n -= 32, p += 32) {
+        uint64_t m[4];
+        memcpy(m, p, 32);
+        a[0] ^= m[0]; a[1] ^= m[1];
+        b[0] ^= m[2]; b[1] ^= m[3];
+        arafura_aesenc_portable((uint8_t *)a, (const uint8_t *)(arafura_hash64_keys + 4));
+        arafura_aesenc_portable((uint8_t *)b, (const uint8_t *)(arafura_hash64_keys + 6));
+    }
+    if (n >= 16) {
+        uint64_t m[2];
+        memcpy(m, p, 16);
+        a[0] ^= m[0]; a[1] ^= m[1];
+        arafura_aesenc_portable((uint8_t *)a, (const uint8_t *)(arafura_hash64_keys + 4));
+        n -= 16;
+        p += 16;
+    }
+    if (n > 0) {
+        uint64_t m[2] = {0, 0};
+        memcpy(m, p, n);
+        b[0] ^= m[0]; b[1] ^= m[1];
+        arafura_aesenc_portable((uint8_t *)b, (const uint8_t *)(arafura_hash64_keys + 6));
+    }
+    memcpy(block, b, 16);
+    arafura_aesenc_portable((uint8_t *)a, block);
+    arafura_aesenc_portable((uint8_t *)a, (const uint8_t *)(arafura_hash64_keys + 0));
+    arafura_aesenc_portable((uint8_t *)a, (const uint8_t *)(arafura_hash64_keys + 2));
+    return a[0] ^ a[1];
+}
+
+#if defined(ARAFURA_X86_DISPATCH)
+__attribute__((target("aes")))
+static uint64_t arafura_hash64_aesni(const void *buf, size_t n) {
+    const unsigned char *p = (const unsigned char *)buf;
+    const __m128i *keys = (const __m128i *)arafura_hash64_keys;
+    __m128i a = _mm_xor_si128(_mm_loadu_si128(keys), _mm_set_epi64x(0, (long long)n));
+    __m128i b = _mm_xor_si128(_mm_loadu_si128(keys + 1), _mm_set_epi64x((long long)n, 0));
+    const __m128i ka = _mm_loadu_si128(keys + 2), kb = _mm_loadu_si128(keys + 3);
+    for (; n >= 32; n -= 32, p += 32) {
+        a = _mm_aesenc_si128(_mm_xor_si128(a, _mm_loadu_si128((const __m128i *)p)), ka);
+        b = _mm_aesenc_si128(_mm_xor_si128(b, _mm_loadu_si128((const __m128i *)(p + 16))), kb);
+    }
+    if (n >= 16) {
+        a = _mm_aesenc_si128(_mm_xor_si128(a, _mm_loadu_si128((const __m128i *)p)), ka);
+        n -= 16;
+        p += 16;
+    }
+    if (n > 0) {
+        uint8_t tail[16] = {0};
+        memcpy(tail, p, n);
+        b = _mm_aesenc_si128(_mm_xor_si128(b, _mm_loadu_si128((const __m128i *)tail)), kb);
+    }
+    a = _mm_aesenc_si128(a, b);
+    a = _mm_aesenc_si128(a, _mm_loadu_si128(keys));
+    a = _mm_aesenc_si128(a, _mm_loadu_si128(keys + 1));
+    return (uint64_t)_mm_cvtsi128_si64(a) ^ (uint64_t)_mm_cvtsi128_si64(_mm_unpackhi_epi64(a, a));
+}
+#endif
+
+static inline uint64_t arafura_hash64(const void *buf, size_t n) {
+#if defined(ARAFURA_X86_DISPATCH)
+    if (__builtin_cpu_supports("aes")) {
+        return arafura_hash64_aesni(buf, n);
+    }
+#endif
+    return arafura_hash64_portable(buf, n);
+}
+""",
+)
+
+
+# ============================================================================
+# APPROXIMATE MATH
+# ============================================================================
+
+# Single-precision approximations that are branch-free and call nothing:
+# selects compile to blends and float<->int reinterpretation goes through
+# memcpy, so loops over them vectorize at -O3. Maximum errors, measured over
+# the whole float range against double-precision libm, are in DESIGN.md.
+FAST_MATH = RuntimeSnippet(
+    includes=("stdint.h", "string.h"),
+    requires=(),
+    code=r"""
+static inline float arafura_bits_to_float(uint32_t u) {
+    float f;
+    memcpy(&f, &u, 4);
+    return f;
+}
+
+static inline uint32_t arafura_float_to_bits(float f) {
+    uint32_t u;
+    memcpy(&u, &f, 4);
+    return u;
+}
+
+/* cond ? a : b by bit masks: no branch for the compiler to thread constants into */
+static inline float arafura_select(int cond, float a, float b) {
+    uint32_t mask = 0u - (uint32_t)(cond != 0);
+    return arafura_bits_to_float((arafura_float_to_bits(a) & mask) | (arafura_float_to_bits(b) & ~mask));
+}
+
+/* e^x: x = n ln2 + r with |r| <= ln2/2, e^r by Taylor polynomial, 2^n by exponent bits.
+   Clamping to [-104, 89.5] keeps 2^n finite; the product then overflows to inf or
+   underflows through the subnormals to 0 exactly as e^x does. */
+static inline float arafura_fast_exp(float x) {
+    float c = arafura_select(x > 89.5f, 89.5f, arafura_select(x < -104.0f, -104.0f, x));
+    int32_t n = (int32_t)(arafura_select(c == c, c, 0.0f) * 1.44269504f + 256.5f) - 256;  /* round(c / ln2) */
+    int32_t n1 = n >> 1, n2 = n - n1;                                       /* 2^n = 2^n1 2^n2 */
+    float r = (c - (float)n * 0.693145752f) - (float)n * 1.42860677e-6f;       /* Cody-Waite ln2 */
+    float p = 1.0f + r * (1.0f + r * (0.5f + r * (0.166666672f + r * (0.0416666679f
+              + r * (0.00833333377f + r * 0.00138888892f)))));
+    return p * arafura_bits_to_float((uint32_t)(n1 + 127) << 23)
+             * arafura_bits_to_float((uint32_t)(n2 + 127) << 23);
+}
+
+/* ln x: x = 2^e m with m in [sqrt(1/2), sqrt(2)), ln m = 2 atanh(s) with s = (m-1)/(m+1) */
+static inline float arafura_fast_log(float x) {
+    int subnormal = x < 1.17549435e-38f;
+    uint32_t bits = arafura_float_to_bits(x * arafura_select(subnormal, 8388608.0f, 1.0f));  /* 2^23 */
+    int32_t e = (int32_t)((bits >> 23) & 0xffu) - 127 - 23 * subnormal;
+    float m = arafura_bits_to_float((bits & 0x007fffffu) | 0x3f800000u);
+    int big = m > 1.41421356f;
+    m = m * arafura_select(big, 0.5f, 1.0f);
+    e += big;
+    float s = (m - 1.0f) / (m + 1.0f), s2 = s * s;
+    float p = 2.0f * s * (1.0f + s2 * (0.333333343f + s2 * (0.2f + s2 * (0.142857149f + s2 * 0.111111112f))));
+    float result = (float)e * 0.693147182f + p;
+    float inf = arafura_bits_to_float(0x7f800000u);
+    float special = arafura_select(x == 0.0f, -inf, arafura_select(x > 0.0f, inf, arafura_bits_to_float(0x7fc00000u)));
+    return arafura_select((x > 0.0f) & (x < inf), result, special);
+}
+
+/* 1/sqrt(x): bit-level initial guess, refined by two Newton steps */
+static inline float arafura_rsqrt(float x) {
+    int subnormal = x < 1.17549435e-38f;
+    float z = x * arafura_select(subnormal, 16777216.0f, 1.0f);  /* 2^24 */
+    float y = arafura_bits_to_float(0x5f375a86u - (arafura_float_to_bits(z) >> 1));
+    y = y * (1.5f - 0.5f * z * y * y);
+    y = y * (1.5f - 0.5f * z * y * y);
+    y = y * arafura_select(subnormal, 4096.0f, 1.0f);
+    float inf = arafura_bits_to_float(0x7f800000u);
+    float zero = arafura_bits_to_float(0x7f800000u | (arafura_float_to_bits(x) & 0x80000000u));  /* +-0 -> +-inf */
+    float special = arafura_select(x == 0.0f, zero, arafura_select(x == inf, 0.0f, arafura_bits_to_float(0x7fc00000u)));
+    return arafura_select((x > 0.0f) & (x < inf), y, special);
+}
+
+/* tanh x: odd Taylor polynomial near 0, 1 - 2/(e^2|x| + 1) elsewhere */
+static inline float arafura_fast_tanh(float x) {
+    uint32_t sign = arafura_float_to_bits(x) & 0x80000000u;
+    float a = arafura_bits_to_float(arafura_float_to_bits(x) ^ sign), x2 = x * x;
+    float small = x * (1.0f + x2 * (-0.333333343f + x2 * (0.133333340f + x2 * (-0.0539682545f
+                  + x2 * (0.0218694881f + x2 * -0.00886323954f)))));
+    float large = 1.0f - 2.0f / (arafura_fast_exp(2.0f * a) + 1.0f);
+    return arafura_select(a < 0.4f, small, arafura_bits_to_float(arafura_float_to_bits(large) | sign));
+}
+""",
+)
+
+# --precise-math: the same builtins through libm
+PRECISE_MATH = RuntimeSnippet(
+    includes=("math.h",),
+    requires=(),
+    code=r"""
+static inline float arafura_rsqrt_precise(float x) {
+    return 1.0f / sqrtf(x);
+}
+""",
+)
+
+
+# ============================================================================
+# DERIVED HASHING
+# ============================================================================
+
+# Combining step for @derive(hash): each field is folded in as a 64-bit word
+# and the result gets the murmur3 finalizer, so every input bit reaches every
+# output bit. Floating-point fields hash by value: -0.0 == 0.0, so both hash
+# as +0.0.
+HASH_MIX = RuntimeSnippet(
+    includes=("stdint.h", "string.h"),
+    requires=(),
+    code=r"""
+static inline uint64_t arafura_hash_mix(uint64_t h, uint64_t v) {
+    h = (h ^ v) * 0x9e3779b97f4a7c15ull;
+    return h ^ (h >> 32);
+}
+
+static inline uint64_t arafura_hash_finish(uint64_t h) {
+    h = (h ^ (h >> 33)) * 0xff51afd7ed558ccdull;
+    h = (h ^ (h >> 33)) * 0xc4ceb9fe1a85ec53ull;
+    return h ^ (h >> 33);
+}
+
+static inline uint64_t arafura_double_bits(double x) {
+    uint64_t bits;
+    x = x == 0.0 ? 0.0 : x;
+    memcpy(&bits, &x, 8);
+    return bits;
+}
+""",
+)
+
+
+# ============================================================================
+# RUNTIME-INVARIANT DIVISION
+# ============================================================================
+
+# fastdiv[T]: division by a divisor fixed at run time, after Lemire, Kaser and
+# Kurz, "Faster Remainder by Direct Computation" (2019). With N twice the
+# width of T and M = ceil(2^N / d), a / d is the high half of M * a, and
+# a % d the high half of (M * a mod 2^N) * d: multiplies instead of a divide.
+# d == 1 wraps M to 0, so the quotient checks for it. Without 128-bit
+# integers, the 64-bit form divides.
+FASTDIV = RuntimeSnippet(
+    includes=("stdint.h",),
+    requires=(),
+    code=r"""
+typedef struct {
+    uint64_t m;
+    uint32_t d;
+} arafura_fastdiv_u32;
+
+static inline arafura_fastdiv_u32 arafura_fastdiv_u32_make(uint32_t d) {
+    arafura_fastdiv_u32 f;
+    f.m = UINT64_MAX / d + 1;
+    f.d = d;
+    return f;
+}
+
+/* High 64 bits of the 96-bit product x * y */
+static inline uint64_t arafura_mulhi_u64_u32(uint64_t x, uint32_t y) {
+#ifdef __SIZEOF_INT128__
+    return (uint64_t)(((__uint128_t)x * y) >> 64);
+#else
+    uint64_t low = (x & 0xffffffffu) * y;
+    return ((x >> 32) * y + (low >> 32)) >> 32;
+#endif
+}
+
+static inline uint32_t arafura_fastdiv_u32_div(uint32_t a, arafura_fastdiv_u32 f) {
+    return f.d == 1 ? a : (uint32_t)arafura_mulhi_u64_u32(f.m, a);
+}
+
+static inline uint32_t arafura_fastdiv_u32_mod(uint32_t a, arafura_fastdiv_u32 f) {
+    return (uint32_t)arafura_mulhi_u64_u32(f.m * a, f.d);
+}
+
+#ifdef __SIZEOF_INT128__
+typedef struct {
+    __uint128_t m;
+    uint64_t d;
+} arafura_fastdiv_u64;
+
+static inline arafura_fastdiv_u64 arafura_fastdiv_u64_make(uint64_t d) {
+    arafura_fastdiv_u64 f;
+    f.m = ~(__uint128_t)0 / d + 1;
+    f.d = d;
+    return f;
+}
+
+/* High 64 bits of the 192-bit product x * y */
+static inline uint64_t arafura_mulhi_u128_u64(__uint128_t x, uint64_t y) {
+    __uint128_t low = ((x & UINT64_MAX) * y) >> 64;
+    return (uint64_t)(((x >> 64) * y + low) >> 64);
+}
+
+static inline uint64_t arafura_fastdiv_u64_div(uint64_t a, arafura_fastdiv_u64 f) {
+    return f.d == 1 ? a : arafura_mulhi_u128_u64(f.m, a);
+}
+
+static inline uint64_t arafura_fastdiv_u64_mod(uint64_t a, arafura_fastdiv_u64 f) {
+    return arafura_mulhi_u128_u64(f.m * a, f.d);
+}
+#else
+typedef struct {
+    uint64_t d;
+} arafura_fastdiv_u64;
+
+static inline arafura_fastdiv_u64 arafura_fastdiv_u64_make(uint64_t d) {
+    arafura_fastdiv_u64 f;
+    f.d = d;
+    return f;
+}
+
+static inline uint64_t arafura_fastdiv_u64_div(uint64_t a, arafura_fastdiv_u64 f) {
+    return a / f.d;
+}
+
+static inline uint64_t arafura_fastdiv_u64_mod(uint64_t a, arafura_fastdiv_u64 f) {
+    return a % f.d;
+}
+#endif
+""",
+)
+
+
+# ============================================================================
+# SEQUENCE LOCKS
+# ============================================================================
+
+# seqlock[T]: a sequence counter that is odd while a write is in progress.
+# Writers make it odd with a CAS (so writers also exclude each other), then
+# a release fence orders that before their data stores; the closing
+# increment is a release store. Readers load the counter with acquire, copy
+# the data, and after an acquire fence check the counter is unchanged,
+# retrying otherwise. Readers store nothing. The data is held as atomic
+# words copied with relaxed loads and stores, so a torn read is a retry
+# rather than a data race (Boehm, "Can Seqlocks Get Along with Programming
+# Language Memory Models?", 2012).
+SEQLOCK = RuntimeSnippet(
+    includes=("stdatomic.h", "stddef.h", "stdint.h"),
+    requires=(),
+    code=r"""
+static inline void arafura_cpu_relax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    __asm__ __volatile__("yield");
+#endif
+}
+
+static inline uint32_t arafura_seqlock_read_begin(_Atomic uint32_t *seq) {
+    uint32_t s;
+    while ((s = atomic_load_explicit(seq, memory_order_acquire)) & 1) {
+        arafura_cpu_relax();
+    }
+    return s;
+}
+
+/* Nonzero if a write started since read_begin returned s: the copy is torn */
+static inline int arafura_seqlock_read_retry(_Atomic uint32_t *seq, uint32_t s) {
+    atomic_thread_fence(memory_order_acquire);
+    return atomic_load_explicit(seq, memory_order_relaxed) != s;
+}
+
+static inline void arafura_seqlock_write_begin(_Atomic uint32_t *seq) {
+    uint32_t s = atomic_load_explicit(seq, memory_order_relaxed);
+    while ((s & 1) || !atomic_compare_exchange_weak_explicit(seq, &s, s + 1, memory_order_acquire,
+                                                             memory_order_relaxed)) {
+        arafura_cpu_relax();
+        s = atomic_load_explicit(seq, memory_order_relaxed);
+    }
+    atomic_thread_fence(memory_order_release);
+}
+
+static inline void arafura_seqlock_write_end(_Atomic uint32_t *seq) {
+    atomic_store_explicit(seq, atomic_load_explicit(seq, memory_order_relaxed) + 1, memory_order_release);
+}
+
+static inline void arafura_seqlock_load_words(_Atomic uint64_t *words, uint64_t *buf, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        buf[i] = atomic_load_explicit(words + i, memory_order_relaxed);
+    }
+}
+
+static inline void arafura_seqlock_store_words(_Atomic uint64_t *words, const uint64_t *buf, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        atomic_store_explicit(words + i, buf[i], memory_order_relaxed);
+    }
+}
+""",
+)
+
+
+RUNTIME = {
+    "float16": FLOAT16,
+    "bfloat16": BFLOAT16,
+    "find_byte": FIND_BYTE,
+    "find_any": FIND_ANY,
+    "count_byte": COUNT_BYTE,
+    "cpu_dispatch": CPU_DISPATCH,
+    "crc32c": CRC32C,
+    "hash64": HASH64,
+    "fast_math": FAST_MATH,
+    "precise_math": PRECISE_MATH,
+    "hash_mix": HASH_MIX,
+    "fastdiv": FASTDIV,
+    "seqlock": SEQLOCK,
+}
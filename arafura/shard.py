@@ -0,0 +1,209 @@
+"""
+Splitting one module into several C compilation units.
+
+A module that transpiles to hundreds of thousands of lines compiles in one
+thread. transpile_sharded() places its function definitions in N .c files of
+similar size, which can be compiled in parallel, and everything they share
+in one header:
+
+- types, macros, inline functions and runtime support go to the header
+- definitions inside a top-level `if [X]:` block are split the same way, and
+  the header and each shard repeat the block's #if lines around their part
+- every function gets a prototype in the header, including struct methods
+- global variables are defined in shard 0 and declared extern in the header
+- a static function referenced from another shard, or from code in the
+  header (an inline function, also one of an imported standard module),
+  loses static and becomes hidden, so it is still not exported
+
+Shards are filled largest function first, each into the currently smallest
+shard; within a shard, functions keep their source order.
+"""
+
+import ast
+import re
+from typing import NamedTuple
+
+from arafura.transpiler import CTranspiler
+
+HIDDEN = '__attribute__((visibility("hidden"))) '
+
+
+class ShardedOutput(NamedTuple):
+    header: str
+    shards: list[str]
+
+
+class Unit(NamedTuple):
+    """One top-level statement: its output and the definitions in it."""
+    lines: list[str]      # Output of the statement
+    support: list[str]    # Support code it required (header)
+    definitions: list[tuple[ast.stmt, int, int]]    # Functions and globals, as line ranges of lines
+    names: set[str]       # Names the statement refers to
+
+
+def is_inline_function(node: ast.FunctionDef) -> bool:
+    """True if the return annotation carries inline[...]."""
+    current = node.returns
+    while isinstance(current, ast.Subscript) and isinstance(current.value, ast.Name):
+        if current.value.id == 'inline':
+            return True
+        current = current.slice
+    return False
+
+
+def global_variable(node: ast.stmt) -> bool:
+    """True for a top-level variable definition (not a macro or extern declaration)."""
+    if not (isinstance(node, ast.AnnAssign) and isinstance(node.target, ast.Name)):
+        return False
+    annotation = node.annotation
+    if isinstance(annotation, ast.Name) and annotation.id in ('macro', 'label'):
+        return False
+    return not (isinstance(annotation, ast.Subscript) and isinstance(annotation.value, ast.Name)
+                and annotation.value.id == 'extern')
+
+
+def extern_declaration(transpiler: CTranspiler, node: ast.AnnAssign) -> str:
+    """extern declaration of the global variable defined by node."""
+    name = transpiler.escape_identifier(node.target.id)
+    annotation = node.annotation
+    if isinstance(annotation, ast.Call):
+        # Point(x=1, y=2) -> struct Point p = {...}
+        return f"extern struct {annotation.func.id} {name};"
+    visibility = ""
+    if isinstance(annotation, ast.Subscript) and isinstance(annotation.value, ast.Name) \
+            and annotation.value.id == 'static':
+        annotation = annotation.slice
+        visibility = HIDDEN
+    extern = ast.Subscript(value=ast.Name(id='extern'), slice=annotation)
+    return f"{visibility}{transpiler.emit_type(extern, name)};"
+
+
+def promote(line: str) -> str:
+    """Replace the static of a definition's first line by hidden visibility."""
+    return HIDDEN + line.removeprefix("static ")
+
+
+def balance(sizes: list[int], count: int) -> list[int]:
+    """Shard index for each item: largest first, into the smallest shard."""
+    totals = [0] * count
+    assignment = [0] * len(sizes)
+    for index in sorted(range(len(sizes)), key=lambda i: -sizes[i]):
+        shard = min(range(count), key=lambda s: totals[s])
+        assignment[index] = shard
+        totals[shard] += sizes[index]
+    return assignment
+
+
+def file_scope_statements(stmt: ast.stmt) -> list[ast.stmt]:
+    """stmt, and the statements inside it if it is a preprocessor conditional."""
+    if isinstance(stmt, ast.If) and CTranspiler.is_preprocessor_test(stmt.test):
+        nested = [stmt]
+        for inner in stmt.body + stmt.orelse:
+            nested.extend(file_scope_statements(inner))
+        return nested
+    return [stmt]
+
+
+def is_directive(line: str) -> bool:
+    """True for the #if/#elif/#else/#endif lines of a preprocessor conditional."""
+    return line.lstrip().startswith(("#if", "#elif", "#else", "#endif"))
+
+
+def transpile_sharded(source_code: str, shards: int, header: str = "module.h", **options) -> ShardedOutput:
+    """
+    Transpile source to a header named header and `shards` .c files that
+    each include it. Options are those of transpile().
+    """
+    if shards < 1:
+        raise ValueError(f"Number of shards must be positive: {shards}")
+    module = ast.parse(source_code)
+    transpiler = CTranspiler(**options)
+    transpiler.collect_type_names(module.body)
+    if transpiler.infer_const:
+        transpiler.const_params = transpiler.infer_const_params(module)
+
+    # Emit each statement once, noting where its function and global
+    # definitions are: also those inside #if blocks, and struct methods
+    preamble = transpiler.output    # The prelude #include, if any
+    units = []
+    for stmt in module.body:
+        transpiler.output = []
+        transpiler.spans = []
+        transpiler.visit(stmt)
+        file_scope = {id(node) for node in file_scope_statements(stmt)}
+        definitions = [
+            (node, first, end) for node, first, end in transpiler.spans
+            if (isinstance(node, ast.FunctionDef) and not is_inline_function(node))
+            or (id(node) in file_scope and global_variable(node))
+        ]
+        names = {node.id for node in ast.walk(stmt) if isinstance(node, ast.Name)}
+        units.append(Unit(transpiler.output, transpiler.support, definitions, names))
+        transpiler.support = []
+    transpiler.spans = None
+
+    # Units with functions are balanced over the shards; global variables go to shard 0
+    functions = [i for i, unit in enumerate(units)
+                 if any(isinstance(node, ast.FunctionDef) for node, _, _ in unit.definitions)]
+    sizes = [sum(end - first for _, first, end in units[i].definitions) for i in functions]
+    assignment = dict(zip(functions, balance(sizes, shards)))
+    for i, unit in enumerate(units):
+        if unit.definitions and i not in assignment:
+            assignment[i] = 0
+
+    # Identifiers in code that stays in the header, such as the inline
+    # functions of an imported standard module
+    header_names = set()
+    for unit in units:
+        inside = {index for _, first, end in unit.definitions for index in range(first, end)}
+        for index, line in enumerate(unit.lines):
+            if index not in inside:
+                header_names.update(re.findall(r"\b[A-Za-z_]\w*", line))
+
+    # Static functions used outside their shard, or from the header, become hidden
+    promoted = set()
+    for i in functions:
+        for node, _, _ in units[i].definitions:
+            if not (isinstance(node, ast.FunctionDef) and CTranspiler.is_static_function(node)):
+                continue
+            if node.name in header_names or any(
+                    j != i and node.name in other.names and assignment.get(j) != assignment[i]
+                    for j, other in enumerate(units)):
+                promoted.add(id(node))
+
+    header_lines = list(preamble)
+    shard_lines = [[] for _ in range(shards)]
+    for i, unit in enumerate(units):
+        header_lines.extend(unit.support)
+        starts = {first: (node, end) for node, first, end in unit.definitions}
+        private = []
+        index = 0
+        while index < len(unit.lines):
+            if index not in starts:
+                line = unit.lines[index]
+                header_lines.append(line)
+                if is_directive(line):
+                    private.append(line)
+                index += 1
+                continue
+            node, end = starts[index]
+            lines = unit.lines[index:end]
+            if isinstance(node, ast.FunctionDef):
+                signature = transpiler.emit_function_signature(node)
+                if id(node) in promoted:
+                    header_lines.append(f"{promote(signature)};")
+                    # An @alias_versioned function is preceded by its clone
+                    lines = [promote(line) if line == f"{signature} {{" else line for line in lines]
+                elif not CTranspiler.is_static_function(node):
+                    header_lines.append(f"{transpiler.visibility_attribute(node)}{signature};")
+            else:
+                header_lines.append(extern_declaration(transpiler, node))
+                if lines[0].startswith("static "):
+                    lines = [promote(lines[0])] + lines[1:]
+            private.extend(lines)
+            index = end
+        if unit.definitions:
+            shard_lines[assignment[i]].extend(private)
+
+    guard = re.sub(r"\W", "_", header).upper()
+    header_text = "\n".join([f"#ifndef {guard}", f"#define {guard}", *header_lines, "#endif"])
+    return ShardedOutput(header_text, ["\n".join([f'#include "{header}"', *lines]) for lines in shard_lines])
@@ -6,18 +6,425 @@ Converts syntactically valid Python (parseable by ast.parse) into C code.
 
 import ast
 import sys
+from typing import Iterable, NamedTuple
+
+from arafura import lib
+from arafura.regex import compile_dfa, emit_matcher
+from arafura.runtime import RUNTIME
+
+
+# Library functions whose pointer parameters (by position) are only read.
+# Passing a pointer parameter to one of these does not prevent const inference.
+CONST_POINTER_PARAMS = {
+    'strlen': {0},
+    'strcmp': {0, 1},
+    'strncmp': {0, 1},
+    'memcmp': {0, 1},
+    'memcpy': {1},
+    'memmove': {1},
+    'strcpy': {1},
+    'strncpy': {1},
+    'strcat': {1},
+    'puts': {0},
+    'fputs': {0},
+}
+
+
+# C operator precedence, higher binds tighter. Used by minimal_parens emission.
+PREC_COMMA = 1
+PREC_ASSIGN = 2
+PREC_TERNARY = 3
+PREC_OR = 4
+PREC_AND = 5
+PREC_BITOR = 6
+PREC_BITXOR = 7
+PREC_BITAND = 8
+PREC_EQUALITY = 9
+PREC_RELATIONAL = 10
+PREC_SHIFT = 11
+PREC_ADDITIVE = 12
+PREC_MULTIPLICATIVE = 13
+PREC_UNARY = 14
+PREC_POSTFIX = 15
+
+BINOP_PRECEDENCE = {
+    ast.Mult: PREC_MULTIPLICATIVE,
+    ast.Div: PREC_MULTIPLICATIVE,
+    ast.FloorDiv: PREC_MULTIPLICATIVE,
+    ast.Mod: PREC_MULTIPLICATIVE,
+    ast.Pow: PREC_MULTIPLICATIVE,
+    ast.Add: PREC_ADDITIVE,
+    ast.Sub: PREC_ADDITIVE,
+    ast.LShift: PREC_SHIFT,
+    ast.RShift: PREC_SHIFT,
+    ast.BitAnd: PREC_BITAND,
+    ast.BitXor: PREC_BITXOR,
+    ast.BitOr: PREC_BITOR,
+}
+
+COMPARE_PRECEDENCE = {
+    ast.Eq: PREC_EQUALITY,
+    ast.NotEq: PREC_EQUALITY,
+    ast.Lt: PREC_RELATIONAL,
+    ast.LtE: PREC_RELATIONAL,
+    ast.Gt: PREC_RELATIONAL,
+    ast.GtE: PREC_RELATIONAL,
+}
+
+AUGASSIGN_OPERATORS = {
+    ast.Add: '+=',
+    ast.Sub: '-=',
+    ast.Mult: '*=',
+    ast.Div: '/=',
+    ast.Mod: '%=',
+    ast.BitAnd: '&=',
+    ast.BitOr: '|=',
+    ast.BitXor: '^=',
+    ast.LShift: '<<=',
+    ast.RShift: '>>=',
+}
+
+
+# Storage-only floating point types and their C names (see runtime.py)
+STORAGE_TYPES = {
+    'float16': 'arafura_f16',
+    'bfloat16': 'arafura_bf16',
+}
+
+# convert[DST, SRC](...) lowerings: scalar function; bulk functions add _n
+CONVERSIONS = {
+    ('float', 'float16'): ('float16', 'arafura_f16_to_f32'),
+    ('float16', 'float'): ('float16', 'arafura_f32_to_f16'),
+    ('float', 'bfloat16'): ('bfloat16', 'arafura_bf16_to_f32'),
+    ('bfloat16', 'float'): ('bfloat16', 'arafura_f32_to_bf16'),
+}
+
+# Byte search builtins and their argument counts (see runtime.py)
+BYTE_SEARCH_BUILTINS = {
+    'find_byte': 3,
+    'find_any': 4,
+    'count_byte': 3,
+}
+
+# Checksum and hash builtins and their argument counts (see runtime.py)
+HASH_BUILTINS = {
+    'crc32c': 3,
+    'hash64': 2,
+}
+
+# fastdiv[T] operand types and the suffix of their runtime functions
+FASTDIV_TYPES = {
+    'uint32_t': 'u32',
+    'uint64_t': 'u64',
+}
+
+# seqlock[T] builtins and their argument counts; the first is the seqlock
+SEQLOCK_BUILTINS = {
+    'seqlock_init': 2,
+    'seqlock_load': 1,
+    'seqlock_store': 2,
+    'seqlock_write_begin': 1,
+    'seqlock_write_end': 2,
+}
+
+# Regular expression builtins: re_match("pattern", s, n) -> search anywhere?
+REGEX_BUILTINS = {
+    're_match': False,
+    're_search': True,
+}
+
+# Approximate math builtins and their libm equivalents for precise_math
+FAST_MATH_BUILTINS = {
+    'fast_exp': 'expf',
+    'fast_log': 'logf',
+    'rsqrt': 'arafura_rsqrt_precise',
+    'fast_tanh': 'tanhf',
+}
+
+# Sizes of scalar field types, for proving a @derive struct padding-free
+# (scalars are aligned to their size; a _Static_assert checks the result)
+SCALAR_SIZES = {
+    'char': 1, 'int8_t': 1, 'uint8_t': 1, 'bool': 1,
+    'short': 2, 'int16_t': 2, 'uint16_t': 2, 'float16': 2, 'bfloat16': 2,
+    'int': 4, 'int32_t': 4, 'uint32_t': 4, 'float': 4,
+    'long': 8, 'int64_t': 8, 'uint64_t': 8, 'size_t': 8, 'intptr_t': 8, 'uintptr_t': 8, 'double': 8,
+}
+FLOAT_TYPES = {'float', 'double'}
+DERIVE_TRAITS = ('eq', 'hash', 'cmp')
+
+
+class DerivedField(NamedTuple):
+    """A field of a @derive struct: kind is 'scalar', 'pointer' or a struct name."""
+    name: str
+    kind: str
+    count: int | None   # Array length, or None
+    size: int           # Size of one element
+    align: int
+    has_float: bool
+
+
+class DerivedLayout(NamedTuple):
+    """Layout of a @derive struct, for structs that contain it."""
+    traits: set[str]
+    size: int
+    align: int
+    padded: bool
+    has_float: bool
+
+# A value-returning match becomes a lookup table when it has at least this
+# many constant cases and they fill at least half of their key range.
+LOOKUP_TABLE_MIN_CASES = 4
+LOOKUP_TABLE_MAX_SIZE = 4096
+
+
+def is_single_pointer_type(node: ast.AST) -> bool:
+    """True for a data pointer annotation -T where T is not itself a pointer."""
+    if not (isinstance(node, ast.UnaryOp) and isinstance(node.op, ast.USub)):
+        return False
+    inner = node.operand
+    if isinstance(inner, ast.Call) and isinstance(inner.func, ast.Tuple):
+        return False  # Function pointer: -(args)(ret)
+    if isinstance(inner, ast.UnaryOp):
+        return False  # Multi-level pointer: const T ** does not accept T **
+    return True
+
+
+def is_const_pointer_type(node: ast.AST) -> bool:
+    """True for -const[T]."""
+    return (is_single_pointer_type(node)
+            and isinstance(node.operand, ast.Subscript)
+            and isinstance(node.operand.value, ast.Name)
+            and node.operand.value.id == 'const')
+
+
+def is_array_type(node: ast.AST) -> bool:
+    """True for an array annotation: T[N], list[T, N], list[T], also under qualifiers."""
+    while isinstance(node, ast.Subscript):
+        if not isinstance(node.value, ast.Name):
+            return True     # T[N][M], type[S][N]
+        name = node.value.id
+        if name == 'list':
+            return True
+        if name in ('const', 'volatile', 'static', 'extern', 'atomic', 'thread_local'):
+            node = node.slice
+        elif name == 'alignas' and isinstance(node.slice, ast.Tuple) and len(node.slice.elts) == 2:
+            node = node.slice.elts[1]
+        else:
+            return name not in ('type', 'union', 'enum', 'bit', 'fastdiv', 'seqlock', 'ndview',
+                                'unsigned', 'long', 'inline', 'alignas')
+    return False
+
+
+class PointerUseScanner(ast.NodeVisitor):
+    """
+    Classify how a function body uses its pointer parameters.
+
+    A parameter is disqualified from const inference if anything is stored
+    through it, or if it escapes (returned, assigned, cast, address taken,
+    used in pointer arithmetic outside a dereference). An array field read
+    through it (p._.arr, p[i].arr) decays to a pointer into *p, so it may
+    only be subscripted; any other use is an escape. Parameters passed
+    directly as call arguments are recorded in `calls` so the caller can
+    decide based on the callee's signature.
+    """
+
+    def __init__(self, params: set[str], array_fields: set[str] = frozenset()):
+        self.params = params
+        self.array_fields = array_fields  # Names of array fields of the module's structs
+        self.disqualified = set()
+        self.calls = []  # (callee name or None, arg index, param name)
+
+    def pointee_param(self, node: ast.AST) -> str | None:
+        """The parameter whose pointee node is part of (p._, p[i], p._.f, p[i].f.g)."""
+        while isinstance(node, ast.Attribute) and node.attr != '_':
+            node = node.value
+        if isinstance(node, ast.Attribute) or isinstance(node, ast.Subscript):
+            base = node.value
+            while isinstance(base, ast.BinOp) and isinstance(base.op, (ast.Add, ast.Sub)):
+                base = base.left
+            if isinstance(base, ast.Name) and base.id in self.params:
+                return base.id
+        return None
+
+    def array_field(self, node: ast.AST) -> str | None:
+        """The parameter an array field access p._.arr or p[i].arr points into."""
+        if isinstance(node, ast.Attribute) and node.attr != '_' and node.attr in self.array_fields:
+            return self.pointee_param(node.value)
+        return None
+
+    def param_base(self, node: ast.AST) -> str | None:
+        """Return the parameter that `node` points into (p, p + i, p - i)."""
+        if isinstance(node, ast.Name) and node.id in self.params:
+            return node.id
+        if isinstance(node, ast.BinOp) and isinstance(node.op, (ast.Add, ast.Sub)):
+            base = self.param_base(node.left)
+            if base:
+                self.visit(node.right)
+                return base
+        return None
+
+    def test(self, node: ast.AST):
+        """Visit an expression used only for its truth value or comparison."""
+        if not (isinstance(node, ast.Name) and node.id in self.params):
+            self.visit(node)
+
+    def store(self, target: ast.AST):
+        """Visit an assignment target."""
+        if isinstance(target, ast.Name):
+            # Reassigning the pointer itself is fine for const T *p
+            return
+        through_pointer = False
+        current = target
+        while True:
+            if isinstance(current, ast.Attribute):
+                if current.attr == '_':
+                    through_pointer = True
+                current = current.value
+            elif isinstance(current, ast.Subscript):
+                through_pointer = True
+                self.visit(current.slice)
+                current = current.value
+            else:
+                break
+        for name in ast.walk(current):
+            if isinstance(name, ast.Name) and name.id in self.params:
+                if through_pointer:
+                    self.disqualified.add(name.id)
+        if not isinstance(current, ast.Name):
+            self.visit(current)
+
+    def visit_Name(self, node: ast.Name):
+        # Any use not matched by a more specific rule is an escape
+        if node.id in self.params:
+            self.disqualified.add(node.id)
+
+    def visit_Assign(self, node: ast.Assign):
+        for target in node.targets:
+            self.store(target)
+        self.visit(node.value)
+
+    def visit_AugAssign(self, node: ast.AugAssign):
+        self.store(node.target)
+        self.visit(node.value)
+
+    def visit_AnnAssign(self, node: ast.AnnAssign):
+        if node.value:
+            self.visit(node.value)
+
+    def visit_If(self, node: ast.If):
+        self.test(node.test)
+        for stmt in node.body + node.orelse:
+            self.visit(stmt)
+
+    def visit_While(self, node: ast.While):
+        self.test(node.test)
+        for stmt in node.body + node.orelse:
+            self.visit(stmt)
+
+    def visit_IfExp(self, node: ast.IfExp):
+        self.test(node.test)
+        self.visit(node.body)
+        self.visit(node.orelse)
+
+    def visit_BoolOp(self, node: ast.BoolOp):
+        for value in node.values:
+            self.test(value)
+
+    def visit_UnaryOp(self, node: ast.UnaryOp):
+        if isinstance(node.op, ast.Not):
+            self.test(node.operand)
+        else:
+            self.visit(node.operand)
+
+    def visit_Compare(self, node: ast.Compare):
+        for operand in [node.left] + node.comparators:
+            self.test(operand)
+
+    def visit_BinOp(self, node: ast.BinOp):
+        # Increment/decrement: i ** _, _ ** i, i // _, _ // i
+        if isinstance(node.op, (ast.Pow, ast.FloorDiv)):
+            if isinstance(node.right, ast.Name) and node.right.id == '_':
+                self.store(node.left)
+                return
+            if isinstance(node.left, ast.Name) and node.left.id == '_':
+                self.store(node.right)
+                return
+        self.generic_visit(node)
+
+    def visit_Attribute(self, node: ast.Attribute):
+        # Address-of: _.p lets the callee write through *&p
+        if isinstance(node.value, ast.Name) and node.value.id == '_':
+            if node.attr in self.params:
+                self.disqualified.add(node.attr)
+            return
+        # Read through the pointer: p._, p._.x
+        if node.attr == '_' and self.param_base(node.value):
+            return
+        # An array field used as a value is a pointer into *p
+        escaped = self.array_field(node)
+        if escaped:
+            self.disqualified.add(escaped)
+        self.visit(node.value)
+
+    def visit_Subscript(self, node: ast.Subscript):
+        # Read through the pointer: p[i], p._.arr[i]
+        if self.param_base(node.value):
+            self.visit(node.slice)
+            return
+        if self.array_field(node.value):
+            self.visit(node.value.value)
+            self.visit(node.slice)
+            return
+        self.generic_visit(node)
+
+    def visit_Call(self, node: ast.Call):
+        if isinstance(node.func, ast.Name) and node.func.id in ('sizeof', 'alignof'):
+            return
+        callee = node.func.id if isinstance(node.func, ast.Name) else None
+        if callee is None:
+            self.visit(node.func)
+        for i, arg in enumerate(node.args):
+            if isinstance(arg, ast.Name) and arg.id in self.params:
+                self.calls.append((callee, i, arg.id))
+            else:
+                self.visit(arg)
+        for kw in node.keywords:
+            self.visit(kw.value)
 
 
 class CTranspiler(ast.NodeVisitor):
     """Transpiles Python AST to C code."""
 
-    def __init__(self):
+    def __init__(self, infer_const: bool = False, minimal_parens: bool = False, precise_math: bool = False,
+                 prelude: str | None = None, prelude_includes: Iterable[str] = (), visibility: str = 'default'):
+        if visibility not in ('default', 'hidden'):
+            raise ValueError(f"Unknown visibility: {visibility} (expected default or hidden)")
         self.indent_level = 0
-        self.output = []
+        self.output = [f'#include "{prelude}"'] if prelude else []
         self.context_type = None  # For compound literals with _
         self.struct_types = set()  # Track struct names
         self.union_types = set()   # Track union names
         self.enum_types = set()    # Track enum names
+        self.infer_const = infer_const  # Emit read-only pointer params as const T *
+        self.const_params = {}     # id(FunctionDef) -> inferred const param names
+        self.minimal_parens = minimal_parens  # Only emit parentheses C needs
+        self.precise_math = precise_math  # Map fast_exp etc. to libm
+        self.current_function = None  # FunctionDef being emitted
+        self.scopes = [{}]         # Declared variable annotations, innermost last
+        self.type_aliases = {}     # type NAME = ... aliases, for resolving declared types
+        self.table_count = 0       # Lookup tables emitted so far (for unique names)
+        self.support = []          # Support code required by the current top-level statement
+        self.support_keys = set()  # Support code already emitted
+        self.libraries = set()     # Standard modules already included
+        self.protocol_types = set()  # Track Protocol (interface) names
+        self.protocols = {}        # Protocol name -> its method signatures
+        self.methods = {}          # Struct name -> names of its methods (not their bodies)
+        self.derived = {}          # Struct name -> DerivedLayout of its @derive
+        self.regexes = {}          # (builtin, pattern) -> name of its matcher
+        self.fields = {}           # Struct name -> {field name: annotation}
+        self.prelude_includes = set(prelude_includes)  # System headers the prelude already includes
+        self.visibility = visibility  # Visibility of functions not marked @export
+        self.spans = None          # If a list: (node, first, end) output lines of each file-scope definition
 
     def indent(self) -> str:
         """Return current indentation."""
@@ -27,6 +434,142 @@ class CTranspiler(ast.NodeVisitor):
         """Emit a line of C code."""
         self.output.append(code)
 
+    def require_support(self, key: str, lines: list[str]):
+        """
+        Request support code (includes, helper types and functions) once per
+        output. It is placed before the top-level statement that needs it.
+        """
+        if key not in self.support_keys:
+            self.support_keys.add(key)
+            self.support.extend(lines)
+
+    def require_include(self, header: str):
+        """Request a system #include."""
+        if header in self.prelude_includes:
+            return
+        self.require_support(f"include:{header}", [f"#include <{header}>"])
+
+    def require_runtime(self, name: str):
+        """Request a runtime snippet (see runtime.py) and everything it needs."""
+        if f"runtime:{name}" in self.support_keys:
+            return
+        snippet = RUNTIME[name]
+        for dependency in snippet.requires:
+            self.require_runtime(dependency)
+        for header in snippet.includes:
+            self.require_include(header)
+        self.require_support(f"runtime:{name}", snippet.code.strip("\n").split("\n"))
+
+    def declare_var(self, name: str, annotation: ast.AST):
+        """Record the annotation of a variable or parameter in the current scope."""
+        self.scopes[-1][name] = annotation
+
+    def resolve_type(self, annotation: ast.AST | None) -> ast.AST | None:
+        """Expand type aliases and strip storage classes and qualifiers."""
+        seen = set()
+        while annotation is not None:
+            annotation = self.strip_storage_class(annotation)
+            if isinstance(annotation, ast.Subscript) and isinstance(annotation.value, ast.Name) \
+                    and annotation.value.id in ('volatile', 'thread_local'):
+                annotation = annotation.slice
+                continue
+            if isinstance(annotation, ast.Name) and annotation.id in self.type_aliases \
+                    and annotation.id not in seen:
+                seen.add(annotation.id)
+                annotation = self.type_aliases[annotation.id]
+                continue
+            return annotation
+        return None
+
+    def static_type(self, node: ast.AST) -> ast.AST | None:
+        """
+        Declared type of a variable expression (x or p._), or None if unknown.
+        This is only used to pick special lowerings; it is not a type checker.
+        """
+        if isinstance(node, ast.Name):
+            for scope in reversed(self.scopes):
+                if node.id in scope:
+                    return self.resolve_type(scope[node.id])
+            return None
+        if isinstance(node, ast.Attribute) and node.attr == '_':
+            pointer = self.static_type(node.value)
+            if isinstance(pointer, ast.UnaryOp) and isinstance(pointer.op, ast.USub):
+                return self.resolve_type(pointer.operand)
+        elif isinstance(node, ast.Attribute) and not (isinstance(node.value, ast.Name) and node.value.id == '_'):
+            # s.f or p._.f
+            struct = self.static_type(node.value)
+            if isinstance(struct, ast.Subscript) and isinstance(struct.value, ast.Name) and struct.value.id == 'type':
+                struct = struct.slice
+            if isinstance(struct, ast.Name) and node.attr in self.fields.get(struct.id, {}):
+                return self.resolve_type(self.fields[struct.id][node.attr])
+        return None
+
+    def fastdiv_suffix(self, node: ast.AST) -> str | None:
+        """u32 or u64 if node is declared fastdiv[uint32_t] or fastdiv[uint64_t]."""
+        declared = self.static_type(node)
+        if (isinstance(declared, ast.Subscript) and isinstance(declared.value, ast.Name)
+                and declared.value.id == 'fastdiv' and isinstance(declared.slice, ast.Name)):
+            return FASTDIV_TYPES.get(declared.slice.id)
+        return None
+
+    def is_fastdiv_op(self, node: ast.BinOp) -> bool:
+        """True for x / d, x // d or x % d with d of a fastdiv type."""
+        if not isinstance(node.op, (ast.Div, ast.FloorDiv, ast.Mod)):
+            return False
+        if isinstance(node.right, ast.Name) and node.right.id == '_':
+            return False    # i // _ is i--
+        return self.fastdiv_suffix(node.right) is not None
+
+    def scalar_size(self, declared: ast.AST | None) -> int | None:
+        """Size in bytes of a declared scalar type, or None if it is not one."""
+        if isinstance(declared, ast.Subscript) and isinstance(declared.value, ast.Name) \
+                and declared.value.id in ('unsigned', 'signed'):
+            declared = declared.slice
+        return SCALAR_SIZES.get(declared.id) if isinstance(declared, ast.Name) else None
+
+    def integer_width(self, node: ast.expr) -> int | None:
+        """
+        Size in bytes of an integer expression's C type, or None if unknown:
+        declared variables and elements, [T](x) casts, literals, and the
+        arithmetic on them (usual conversions, at least int).
+        """
+        if isinstance(node, ast.Constant) and type(node.value) is int:
+            return 4 if 0 <= node.value <= 0x7FFFFFFF else 8
+        if isinstance(node, ast.Call) and isinstance(node.func, ast.List) and len(node.func.elts) == 1:
+            return self.scalar_size(self.resolve_type(node.func.elts[0]))
+        if isinstance(node, ast.Subscript):
+            container = self.static_type(node.value)
+            if isinstance(container, ast.UnaryOp) and isinstance(container.op, ast.USub):
+                return self.scalar_size(self.resolve_type(container.operand))
+            if isinstance(container, ast.Subscript):
+                return self.scalar_size(self.resolve_type(container.value))
+            return None
+        if isinstance(node, ast.BinOp) and isinstance(node.op, (ast.LShift, ast.RShift)):
+            width = self.integer_width(node.left)
+            return None if width is None else max(width, 4)
+        if isinstance(node, ast.BinOp):
+            widths = [self.integer_width(node.left), self.integer_width(node.right)]
+            return None if None in widths else max(*widths, 4)
+        if isinstance(node, ast.UnaryOp) and isinstance(node.op, (ast.UAdd, ast.Invert)):
+            width = self.integer_width(node.operand)
+            return None if width is None else max(width, 4)
+        return self.scalar_size(self.static_type(node))
+
+    def check_fastdiv(self, dividend: ast.expr, divisor: ast.expr):
+        """Raise unless dividend is known to fit a fastdiv[uint32_t] divisor."""
+        if self.fastdiv_suffix(divisor) != 'u32':
+            return
+        # The u32 functions take a uint32_t dividend; a wider one would be truncated
+        width = self.integer_width(dividend)
+        if width is None:
+            raise ValueError("fastdiv[uint32_t] needs a dividend of a known type of at most 32 bits: "
+                             "use fastdiv[uint64_t] or cast the dividend with [uint32_t](...)")
+        if width > 4:
+            declared = self.static_type(dividend)
+            name = declared.id if isinstance(declared, ast.Name) else f"{width * 8}-bit value"
+            raise ValueError(f"fastdiv[uint32_t] cannot divide a {name}: "
+                             "use fastdiv[uint64_t] or cast the dividend")
+
     def get_output(self) -> str:
         """Get the final C code."""
         return "\n".join(self.output)
@@ -61,6 +604,9 @@ class CTranspiler(ast.NodeVisitor):
             # Basic type: int, char, float, double, void, etc.
             # Bare names are used as-is (could be typedef names or basic types)
             type_name = node.id
+            if type_name in STORAGE_TYPES:
+                self.require_runtime(type_name)
+                type_name = STORAGE_TYPES[type_name]
             if var_name:
                 return f"{type_name} {var_name}"
             else:
@@ -170,6 +716,19 @@ class CTranspiler(ast.NodeVisitor):
                             else:
                                 return type_str
 
+                # fastdiv[uint32_t], fastdiv[uint64_t]
+                if name == 'fastdiv':
+                    return f"{self.fastdiv_type(node)} {var_name}".strip()
+
+                # seqlock[T]
+                if name == 'seqlock':
+                    return f"{self.require_seqlock(node.slice)} {var_name}".strip()
+
+                # ndview[T, N] / ndview[T, N, contiguous]
+                if name == 'ndview':
+                    type_name = self.require_ndview(self.view_info(node))
+                    return f"{type_name} {var_name}".strip()
+
                 # Check if it's alignas[N, T]
                 if name == 'alignas':
                     if isinstance(node.slice, ast.Tuple) and len(node.slice.elts) == 2:
@@ -178,7 +737,8 @@ class CTranspiler(ast.NodeVisitor):
                         return f"_Alignas({align_val}) {inner_type}".strip()
 
                 # Check if it's a qualifier/storage class
-                if name in ('const', 'volatile', 'unsigned', 'static', 'extern', 'long', 'atomic', 'thread_local'):
+                if name in ('const', 'volatile', 'unsigned', 'static', 'extern', 'long', 'atomic', 'thread_local',
+                            'inline'):
                     # Map to C names
                     c_name = name
                     if name == 'atomic':
@@ -287,6 +847,58 @@ class CTranspiler(ast.NodeVisitor):
     # EXPRESSION EMISSION
     # ========================================================================
 
+    def expr_precedence(self, node: ast.AST) -> int:
+        """Precedence of the top-level operator of `node` as emitted in C."""
+        if isinstance(node, ast.BinOp):
+            if isinstance(node.op, (ast.Pow, ast.FloorDiv)):
+                if isinstance(node.right, ast.Name) and node.right.id == '_':
+                    return PREC_POSTFIX  # i++
+                if isinstance(node.left, ast.Name) and node.left.id == '_':
+                    return PREC_UNARY    # ++i
+            if self.is_fastdiv_op(node):
+                return PREC_POSTFIX      # A call
+            return BINOP_PRECEDENCE.get(type(node.op), PREC_POSTFIX)
+        elif isinstance(node, ast.UnaryOp):
+            return PREC_UNARY
+        elif isinstance(node, ast.Compare):
+            return min(COMPARE_PRECEDENCE.get(type(op), PREC_RELATIONAL) for op in node.ops)
+        elif isinstance(node, ast.BoolOp):
+            return PREC_AND if isinstance(node.op, ast.And) else PREC_OR
+        elif isinstance(node, ast.IfExp):
+            return PREC_TERNARY
+        elif isinstance(node, ast.NamedExpr):
+            return PREC_ASSIGN
+        elif isinstance(node, ast.Tuple):
+            if len(node.elts) == 1:
+                return self.expr_precedence(node.elts[0])
+            return PREC_COMMA
+        elif isinstance(node, ast.Attribute):
+            # p._ -> *p. The language reads _.arr[0] as &arr[0], so _.x is
+            # left unwrapped under postfix operators, like the default form.
+            if node.attr == '_' and not (isinstance(node.value, ast.Name) and node.value.id == '_'):
+                return PREC_UNARY
+            return PREC_POSTFIX
+        elif isinstance(node, ast.Call):
+            # [T](x) and cast[T](x) -> (T)x
+            if isinstance(node.func, ast.List) and len(node.func.elts) == 1 and len(node.args) == 1:
+                return PREC_UNARY
+            if (isinstance(node.func, ast.Subscript) and isinstance(node.func.value, ast.Name)
+                    and node.func.value.id == 'cast' and len(node.args) == 1):
+                return PREC_UNARY
+            return PREC_POSTFIX
+        return PREC_POSTFIX
+
+    def emit_operand(self, node: ast.AST, min_prec: int) -> str:
+        """
+        Emit a subexpression whose context requires at least `min_prec`.
+        The default emission already parenthesizes every compound expression
+        except comparisons, which only need it as operands.
+        """
+        text = self.emit_expr(node)
+        if (self.minimal_parens or isinstance(node, ast.Compare)) and self.expr_precedence(node) < min_prec:
+            return f"({text})"
+        return text
+
     def emit_expr(self, node: ast.AST) -> str:
         """Emit a C expression."""
         if isinstance(node, ast.Constant):
@@ -316,6 +928,11 @@ class CTranspiler(ast.NodeVisitor):
 
         elif isinstance(node, ast.IfExp):
             # Ternary: a if cond else b -> (cond) ? a : b
+            if self.minimal_parens:
+                cond = self.emit_operand(node.test, PREC_OR)
+                true_val = self.emit_expr(node.body)
+                false_val = self.emit_operand(node.orelse, PREC_TERNARY)
+                return f"{cond} ? {true_val} : {false_val}"
             cond = self.emit_expr(node.test)
             true_val = self.emit_expr(node.body)
             false_val = self.emit_expr(node.orelse)
@@ -337,7 +954,7 @@ class CTranspiler(ast.NodeVisitor):
                 # This is handled in emit_call
                 pass
             # Array literal: [1, 2, 3] -> {1, 2, 3}
-            elts = ", ".join(self.emit_expr(e) for e in node.elts)
+            elts = ", ".join(self.emit_operand(e, PREC_ASSIGN) for e in node.elts)
             return f"{{{elts}}}"
 
         elif isinstance(node, ast.Dict):
@@ -345,18 +962,20 @@ class CTranspiler(ast.NodeVisitor):
             items = []
             for k, v in zip(node.keys, node.values):
                 key_str = self.emit_expr(k)
-                val_str = self.emit_expr(v)
+                val_str = self.emit_operand(v, PREC_ASSIGN)
                 items.append(f"[{key_str}] = {val_str}")
             return f"{{{', '.join(items)}}}"
 
         elif isinstance(node, ast.Tuple):
             # Tuple for multiple expressions (used in for loops, etc.)
-            return ", ".join(self.emit_expr(e) for e in node.elts)
+            return ", ".join(self.emit_operand(e, PREC_ASSIGN) for e in node.elts)
 
         elif isinstance(node, ast.NamedExpr):
             # Walrus operator: (x := 5) -> (x = 5)
             target = self.emit_expr(node.target)
-            value = self.emit_expr(node.value)
+            value = self.emit_operand(node.value, PREC_ASSIGN)
+            if self.minimal_parens:
+                return f"{target} = {value}"
             return f"({target} = {value})"
 
         else:
@@ -377,7 +996,8 @@ class CTranspiler(ast.NodeVisitor):
                       .replace('\t', '\\t'))
             return f'"{escaped}"'
         elif isinstance(node.value, int):
-            return str(node.value)
+            # Past long long the constant only fits unsigned; say so explicitly
+            return f"{node.value}ull" if node.value > 0x7FFFFFFFFFFFFFFF else str(node.value)
         elif isinstance(node.value, float):
             return str(node.value)
         elif node.value is None:
@@ -387,8 +1007,24 @@ class CTranspiler(ast.NodeVisitor):
 
     def emit_binop(self, node: ast.BinOp) -> str:
         """Emit binary operation."""
-        left = self.emit_expr(node.left)
-        right = self.emit_expr(node.right)
+        if self.is_fastdiv_op(node):
+            return self.emit_fastdiv(node.op, node.left, node.right)
+        prec = self.expr_precedence(node)
+        if prec == PREC_POSTFIX:
+            left = self.emit_operand(node.left, PREC_POSTFIX)
+            right = self.emit_expr(node.right)
+        elif prec == PREC_UNARY:
+            left = self.emit_expr(node.left)
+            right = self.emit_operand(node.right, PREC_UNARY)
+        else:
+            # Left-associative: the right operand needs parentheses at equal precedence
+            left = self.emit_operand(node.left, prec)
+            right = self.emit_operand(node.right, prec + 1)
+            # The default emission wraps compound operands except comparisons
+            if self.minimal_parens or isinstance(node.left, ast.Compare):
+                left = self.clarify_operand(node.left, prec, left)
+            if self.minimal_parens or isinstance(node.right, ast.Compare):
+                right = self.clarify_operand(node.right, prec, right)
 
         # Check for increment/decrement patterns
         if isinstance(node.op, ast.Pow):
@@ -427,13 +1063,41 @@ class CTranspiler(ast.NodeVisitor):
 
         op_str = op_map.get(type(node.op))
         if op_str:
+            if self.minimal_parens:
+                return f"{left} {op_str} {right}"
             return f"({left} {op_str} {right})"
         else:
             raise ValueError(f"Unhandled binary operator: {type(node.op)}")
 
+    def emit_fastdiv(self, op: ast.operator, dividend: ast.expr, divisor: ast.expr) -> str:
+        """x / d, x // d or x % d with d a fastdiv[T]: multiplies by d's reciprocal."""
+        suffix = self.fastdiv_suffix(divisor)
+        self.check_fastdiv(dividend, divisor)
+        self.require_runtime('fastdiv')
+        function = 'mod' if isinstance(op, ast.Mod) else 'div'
+        args = f"{self.emit_operand(dividend, PREC_ASSIGN)}, {self.emit_operand(divisor, PREC_ASSIGN)}"
+        return f"arafura_fastdiv_{suffix}_{function}({args})"
+
+    def clarify_operand(self, node: ast.AST, parent_prec: int, text: str) -> str:
+        """
+        Keep the groupings GCC's -Wparentheses asks for even where C
+        precedence makes them redundant, so -Wall -Werror builds stay clean:
+        +/- inside shifts and arithmetic or comparisons inside & ^ |.
+        Operands binding looser than the parent are already parenthesized.
+        """
+        prec = self.expr_precedence(node)
+        if prec <= parent_prec or not isinstance(node, (ast.BinOp, ast.Compare)):
+            return text
+        if parent_prec == PREC_SHIFT and prec == PREC_ADDITIVE:
+            return f"({text})"
+        if parent_prec in (PREC_BITOR, PREC_BITXOR, PREC_BITAND):
+            if prec in (PREC_ADDITIVE, PREC_BITAND, PREC_BITXOR, PREC_EQUALITY, PREC_RELATIONAL):
+                return f"({text})"
+        return text
+
     def emit_unaryop(self, node: ast.UnaryOp) -> str:
         """Emit unary operation."""
-        operand = self.emit_expr(node.operand)
+        operand = self.emit_operand(node.operand, PREC_UNARY)
 
         op_map = {
             ast.Not: '!',
@@ -444,13 +1108,19 @@ class CTranspiler(ast.NodeVisitor):
 
         op_str = op_map.get(type(node.op))
         if op_str:
+            if self.minimal_parens and op_str in '+-' and operand[:1] == op_str:
+                # -(-x), not --x
+                return f"{op_str}({operand})"
             return f"{op_str}{operand}"
         else:
             raise ValueError(f"Unhandled unary operator: {type(node.op)}")
 
     def emit_compare(self, node: ast.Compare) -> str:
         """Emit comparison."""
-        left = self.emit_expr(node.left)
+        # Chains are emitted flat and parse left to right in C, so every
+        # operand must bind tighter than a relational operator.
+        operand_prec = PREC_RELATIONAL + 1
+        left = self.emit_operand(node.left, operand_prec)
 
         op_map = {
             ast.Eq: '==',
@@ -465,7 +1135,7 @@ class CTranspiler(ast.NodeVisitor):
         for op, comparator in zip(node.ops, node.comparators):
             op_str = op_map.get(type(op))
             if op_str:
-                comp = self.emit_expr(comparator)
+                comp = self.emit_operand(comparator, operand_prec)
                 parts.append(op_str)
                 parts.append(comp)
             else:
@@ -484,6 +1154,17 @@ class CTranspiler(ast.NodeVisitor):
         if not op_str:
             raise ValueError(f"Unhandled boolean operator: {type(node.op)}")
 
+        if self.minimal_parens:
+            prec = self.expr_precedence(node)
+            values = []
+            for v in node.values:
+                text = self.emit_operand(v, prec + 1)
+                if isinstance(v, ast.BoolOp) and self.expr_precedence(v) > prec:
+                    # && inside || (-Wparentheses)
+                    text = f"({text})"
+                values.append(text)
+            return f" {op_str} ".join(values)
+
         values = [f"({self.emit_expr(v)})" for v in node.values]
         return f"({op_str.join(values)})"
 
@@ -496,6 +1177,8 @@ class CTranspiler(ast.NodeVisitor):
             type_expr = node.func.elts[0]
             if len(node.args) == 1:
                 type_str = self.emit_type(type_expr, "")
+                if self.minimal_parens:
+                    return f"({type_str}){self.emit_operand(node.args[0], PREC_UNARY)}"
                 expr_str = self.emit_expr(node.args[0])
                 return f"(({type_str})({expr_str}))"
 
@@ -504,6 +1187,8 @@ class CTranspiler(ast.NodeVisitor):
             if isinstance(node.func.value, ast.Name) and node.func.value.id == 'cast':
                 if len(node.args) == 1:
                     type_str = self.emit_type(node.func.slice, "")
+                    if self.minimal_parens:
+                        return f"({type_str}){self.emit_operand(node.args[0], PREC_UNARY)}"
                     expr_str = self.emit_expr(node.args[0])
                     return f"(({type_str})({expr_str}))"
 
@@ -516,6 +1201,8 @@ class CTranspiler(ast.NodeVisitor):
                 # This respects type[F], enum[E], union[U] syntax
                 if isinstance(arg, ast.Name):
                     # Simple name - emit as-is (could be typedef or basic type)
+                    if arg.id in STORAGE_TYPES:
+                        return f"{func_name}({self.emit_type(arg)})"
                     return f"{func_name}({arg.id})"
                 elif isinstance(arg, ast.Subscript):
                     # Could be type[F], enum[E], union[U], or array type
@@ -526,6 +1213,55 @@ class CTranspiler(ast.NodeVisitor):
                     arg_str = self.emit_expr(arg)
                     return f"{func_name}({arg_str})"
 
+        # convert(dst, src, n), convert[DST, SRC](...), convert[DST](x)
+        convert = node.func.value if isinstance(node.func, ast.Subscript) else node.func
+        if isinstance(convert, ast.Name) and convert.id == 'convert':
+            return self.emit_convert(node)
+
+        # find_byte(buf, n, c), find_any(buf, n, set[, k]), count_byte(buf, n, c)
+        if isinstance(node.func, ast.Name) and node.func.id in BYTE_SEARCH_BUILTINS:
+            return self.emit_byte_search(node)
+
+        # fastdiv[T](d): the reciprocal of d
+        if (isinstance(node.func, ast.Subscript) and isinstance(node.func.value, ast.Name)
+                and node.func.value.id == 'fastdiv'):
+            self.require_args(node, 1, "fastdiv[T] takes 1 argument: the divisor")
+            return f"{self.fastdiv_type(node.func)}_make({self.emit_operand(node.args[0], PREC_ASSIGN)})"
+
+        # seqlock_load(s), seqlock_store(s, v), seqlock_write_begin(s), ...
+        if isinstance(node.func, ast.Name) and node.func.id in SEQLOCK_BUILTINS:
+            return self.emit_seqlock(node)
+
+        # re_match("pattern", s, n), re_search("pattern", s, n)
+        if isinstance(node.func, ast.Name) and node.func.id in REGEX_BUILTINS:
+            return self.emit_regex(node)
+
+        # crc32c(buf, n, seed), hash64(buf, n)
+        if isinstance(node.func, ast.Name) and node.func.id in HASH_BUILTINS:
+            name = node.func.id
+            self.require_args(node, HASH_BUILTINS[name], f"{name} takes {HASH_BUILTINS[name]} arguments")
+            self.require_runtime(name)
+            args = ", ".join(self.emit_operand(arg, PREC_ASSIGN) for arg in node.args)
+            return f"arafura_{name}({args})"
+
+        # fast_exp(x), fast_log(x), rsqrt(x), fast_tanh(x)
+        if isinstance(node.func, ast.Name) and node.func.id in FAST_MATH_BUILTINS:
+            name = node.func.id
+            self.require_args(node, 1, f"{name} takes 1 argument")
+            if self.precise_math:
+                self.require_runtime('precise_math')
+                func_name = FAST_MATH_BUILTINS[name]
+            else:
+                self.require_runtime('fast_math')
+                func_name = f"arafura_{name}"
+            return f"{func_name}({self.emit_operand(node.args[0], PREC_ASSIGN)})"
+
+        # ndview[T, N](ptr, dims...)
+        if isinstance(node.func, ast.Subscript):
+            view = self.view_info(node.func)
+            if view is not None:
+                return self.emit_view_constructor(node, view)
+
         # alignof[T] - subscript form
         if isinstance(node.func, ast.Subscript):
             if isinstance(node.func.value, ast.Name) and node.func.value.id == 'alignof':
@@ -548,33 +1284,301 @@ class CTranspiler(ast.NodeVisitor):
                 # Designated initializer compound literal
                 items = []
                 for kw in node.keywords:
-                    val = self.emit_expr(kw.value)
+                    val = self.emit_operand(kw.value, PREC_ASSIGN)
                     items.append(f".{kw.arg} = {val}")
                 init_str = "{" + ", ".join(items) + "}"
                 # Need context type - for now, emit generic form
                 # In a real implementation, we'd track the expected type
                 return f"({init_str})"
 
+        # Protocol conversion: Shape(_.circle)
+        if isinstance(node.func, ast.Name) and node.func.id in self.protocol_types:
+            return self.emit_protocol_conversion(node)
+
+        # Method call: shape.area() or circle.area()
+        if isinstance(node.func, ast.Attribute) and node.func.attr != '_':
+            call = self.emit_method_call(node)
+            if call is not None:
+                return call
+
         # Struct constructor: Point(10, 20) or Point(x=10, y=20)
         if isinstance(node.func, ast.Name) and node.func.id in self.struct_types:
             if node.keywords:
                 # Designated initializer
                 items = []
                 for kw in node.keywords:
-                    val = self.emit_expr(kw.value)
+                    val = self.emit_operand(kw.value, PREC_ASSIGN)
                     items.append(f".{kw.arg} = {val}")
                 init_str = "{" + ", ".join(items) + "}"
                 return init_str
             else:
                 # Positional initializer
-                args_str = ", ".join(self.emit_expr(arg) for arg in node.args)
+                args_str = ", ".join(self.emit_operand(arg, PREC_ASSIGN) for arg in node.args)
                 return f"{{{args_str}}}"
 
         # Regular function call
-        func_name = self.emit_expr(node.func)
-        args_str = ", ".join(self.emit_expr(arg) for arg in node.args)
+        func_name = self.emit_operand(node.func, PREC_POSTFIX)
+        args_str = ", ".join(self.emit_operand(arg, PREC_ASSIGN) for arg in node.args)
         return f"{func_name}({args_str})"
 
+    def element_type_name(self, node: ast.AST) -> str | None:
+        """Element type name of a pointer or array variable (-T, T[n], list[T, n])."""
+        declared = self.static_type(node)
+        if isinstance(declared, ast.UnaryOp) and isinstance(declared.op, ast.USub):
+            elem = self.resolve_type(declared.operand)
+        elif isinstance(declared, ast.Subscript) and isinstance(declared.value, ast.Name) \
+                and declared.value.id == 'list':
+            elem = declared.slice.elts[0] if isinstance(declared.slice, ast.Tuple) else declared.slice
+        elif isinstance(declared, ast.Subscript):
+            elem = declared.value
+            while isinstance(elem, ast.Subscript):
+                elem = elem.value
+        else:
+            return None
+        return elem.id if isinstance(elem, ast.Name) else None
+
+    @staticmethod
+    def require_args(node: ast.Call, count: int, message: str):
+        """Raise message unless node has exactly count positional arguments."""
+        if len(node.args) != count or node.keywords:
+            raise ValueError(message)
+
+    def check_call(self, node: ast.Call):
+        """
+        Raise the errors emit_call would raise for a builtin call, without
+        emitting anything. check.py runs this on every call.
+        """
+        func = node.func
+        name = func.id if isinstance(func, ast.Name) else None
+        generic = func.value if isinstance(func, ast.Subscript) else None
+        if isinstance(generic, ast.Name) and generic.id == 'fastdiv':
+            self.require_args(node, 1, "fastdiv[T] takes 1 argument: the divisor")
+            if not (isinstance(func.slice, ast.Name) and func.slice.id in FASTDIV_TYPES):
+                raise ValueError(f"fastdiv takes {' or '.join(FASTDIV_TYPES)}")
+        elif name == 'convert' or (isinstance(generic, ast.Name) and generic.id == 'convert'):
+            self.convert_types(node)
+        elif name in BYTE_SEARCH_BUILTINS:
+            self.byte_search_args(node)
+        elif name in SEQLOCK_BUILTINS:
+            self.seqlock_declared(node)
+        elif name in REGEX_BUILTINS:
+            self.regex_pattern(node)
+        elif name in HASH_BUILTINS:
+            self.require_args(node, HASH_BUILTINS[name], f"{name} takes {HASH_BUILTINS[name]} arguments")
+        elif name in FAST_MATH_BUILTINS:
+            self.require_args(node, 1, f"{name} takes 1 argument")
+        elif isinstance(func, ast.Subscript) and (view := self.view_info(func)) is not None:
+            rank = view[1]
+            self.require_args(node, rank + 1, f"ndview of rank {rank} needs a pointer and {rank} extents")
+
+    def convert_types(self, node: ast.Call) -> tuple[str, str, bool]:
+        """(destination, source, bulk) of a convert call; raises if there is no such conversion."""
+        explicit = []
+        if isinstance(node.func, ast.Subscript):
+            explicit = node.func.slice.elts if isinstance(node.func.slice, ast.Tuple) else [node.func.slice]
+            if not all(isinstance(t, ast.Name) for t in explicit) or len(explicit) > 2:
+                raise ValueError(f"convert[...] takes type names: {ast.dump(node.func)}")
+            explicit = [t.id for t in explicit]
+
+        if len(node.args) == 3:
+            bulk = True
+            dst = explicit[0] if explicit else self.element_type_name(node.args[0])
+            src = explicit[1] if len(explicit) == 2 else self.element_type_name(node.args[1])
+        elif len(node.args) == 1 and explicit:
+            bulk = False
+            dst = explicit[0]
+            src = explicit[1] if len(explicit) == 2 else None
+            if src is None and isinstance(node.args[0], ast.Subscript):
+                src = self.element_type_name(node.args[0].value)
+            elif src is None:
+                declared = self.static_type(node.args[0])
+                src = declared.id if isinstance(declared, ast.Name) else None
+        else:
+            raise ValueError("convert takes (dst, src, n), or [DST](value)")
+
+        if (dst, src) not in CONVERSIONS:
+            raise ValueError(f"No conversion from {src or 'unknown type'} to {dst or 'unknown type'}; "
+                             f"use convert[DST, SRC] to name the types")
+        return dst, src, bulk
+
+    def emit_convert(self, node: ast.Call) -> str:
+        """
+        Conversions between float and the storage types float16/bfloat16:
+        convert(dst, src, n) converts n elements (types from the declarations
+        of dst and src); convert[DST, SRC](...) names them explicitly;
+        convert[DST](x) converts one value.
+        """
+        dst, src, bulk = self.convert_types(node)
+        runtime, func_name = CONVERSIONS[(dst, src)]
+        self.require_runtime(runtime)
+        args = ", ".join(self.emit_operand(arg, PREC_ASSIGN) for arg in node.args)
+        return f"{func_name}{'_n' if bulk else ''}({args})"
+
+    @staticmethod
+    def byte_search_args(node: ast.Call) -> list[ast.expr]:
+        """Arguments of find_byte/find_any/count_byte, with the length of a literal find_any set added."""
+        name = node.func.id
+        args = list(node.args)
+        if name == 'find_any' and len(args) == 3:
+            if not (isinstance(args[2], ast.Constant) and isinstance(args[2].value, str)):
+                raise ValueError("find_any(buf, n, set) needs a string literal set; pass its length otherwise")
+            args.append(ast.Constant(len(args[2].value.encode())))
+        if len(args) != BYTE_SEARCH_BUILTINS[name] or node.keywords:
+            raise ValueError(f"{name} takes {BYTE_SEARCH_BUILTINS[name]} arguments")
+        return args
+
+    def emit_byte_search(self, node: ast.Call) -> str:
+        """
+        find_byte/find_any/count_byte over (buf, n, ...). A one-character
+        string is accepted for a byte, and a string literal set for find_any
+        supplies its own length.
+        """
+        name = node.func.id
+        args = self.byte_search_args(node)
+        self.require_runtime(name)
+        emitted = []
+        for i, arg in enumerate(args):
+            if name != 'find_any' and i == 2 and isinstance(arg, ast.Constant) and isinstance(arg.value, str):
+                emitted.append(self.emit_char(arg.value))
+            else:
+                emitted.append(self.emit_operand(arg, PREC_ASSIGN))
+        return f"arafura_{name}({', '.join(emitted)})"
+
+    def fastdiv_type(self, node: ast.Subscript) -> str:
+        """C type of fastdiv[T], requiring its runtime support."""
+        if not (isinstance(node.slice, ast.Name) and node.slice.id in FASTDIV_TYPES):
+            raise ValueError(f"fastdiv takes {' or '.join(FASTDIV_TYPES)}")
+        self.require_runtime('fastdiv')
+        return f"arafura_fastdiv_{FASTDIV_TYPES[node.slice.id]}"
+
+    def require_seqlock(self, elem: ast.AST) -> str:
+        """Emit (once) the struct and accessors for seqlock[T]; return its typedef name."""
+        type_name = f"seqlock_{self.type_key(elem)}"
+        if f"seqlock:{type_name}" in self.support_keys:
+            return type_name
+        self.require_runtime('seqlock')
+        self.require_include("string.h")
+        value = self.emit_type(elem, "")
+        words = f"(sizeof({value}) + 7) / 8"
+        # The value is held as words so that readers copy it with relaxed
+        # atomic loads: a copy torn by a writer is retried, not a data race
+        lines = [
+            "typedef struct {",
+            f"    {self.emit_type(ast.Subscript(value=ast.Name(id='atomic'), slice=ast.Name(id='uint32_t')), 'seq')};",
+            f"    {self.emit_type(ast.Subscript(value=ast.Name(id='atomic'), slice=ast.Name(id='uint64_t')), 'words')}[{words}];",
+            f"}} {type_name};",
+            "",
+            "/* Sets the value; not to be used while other threads access s */",
+            f"static inline void {type_name}_init({type_name} *s, {self.emit_type(elem, 'v')}) {{",
+            f"    uint64_t buf[{words}] = {{0}};",
+            "    memcpy(buf, &v, sizeof v);",
+            "    atomic_store_explicit(&s->seq, 0, memory_order_relaxed);",
+            "    arafura_seqlock_store_words(s->words, buf, sizeof buf / 8);",
+            "}",
+            "",
+            "/* A consistent snapshot, retried while a write overlaps the copy */",
+            f"static inline {value} {type_name}_load({type_name} *s) {{",
+            f"    uint64_t buf[{words}];",
+            f"    {self.emit_type(elem, 'v')};",
+            "    uint32_t seq;",
+            "    do {",
+            "        seq = arafura_seqlock_read_begin(&s->seq);",
+            "        arafura_seqlock_load_words(s->words, buf, sizeof buf / 8);",
+            "    } while (arafura_seqlock_read_retry(&s->seq, seq));",
+            "    memcpy(&v, buf, sizeof v);",
+            "    return v;",
+            "}",
+            "",
+            "/* Excludes other writers and returns the current value, to be changed",
+            "   and passed to write_end; readers retry until then */",
+            f"static inline {value} {type_name}_write_begin({type_name} *s) {{",
+            f"    uint64_t buf[{words}];",
+            f"    {self.emit_type(elem, 'v')};",
+            "    arafura_seqlock_write_begin(&s->seq);",
+            "    arafura_seqlock_load_words(s->words, buf, sizeof buf / 8);",
+            "    memcpy(&v, buf, sizeof v);",
+            "    return v;",
+            "}",
+            "",
+            f"static inline void {type_name}_write_end({type_name} *s, {self.emit_type(elem, 'v')}) {{",
+            f"    uint64_t buf[{words}] = {{0}};",
+            "    memcpy(buf, &v, sizeof v);",
+            "    arafura_seqlock_store_words(s->words, buf, sizeof buf / 8);",
+            "    arafura_seqlock_write_end(&s->seq);",
+            "}",
+            "",
+            f"static inline void {type_name}_store({type_name} *s, {self.emit_type(elem, 'v')}) {{",
+            "    arafura_seqlock_write_begin(&s->seq);",
+            f"    {type_name}_write_end(s, v);",
+            "}",
+        ]
+        self.require_support(f"seqlock:{type_name}", lines)
+        return type_name
+
+    def seqlock_declared(self, node: ast.Call) -> ast.Subscript:
+        """The seqlock[T] type of a seqlock builtin's first argument."""
+        name = node.func.id
+        self.require_args(node, SEQLOCK_BUILTINS[name], f"{name} takes {SEQLOCK_BUILTINS[name]} arguments")
+        declared = self.static_type(node.args[0])
+        if not (isinstance(declared, ast.Subscript) and isinstance(declared.value, ast.Name)
+                and declared.value.id == 'seqlock'):
+            raise ValueError(f"{name} takes a variable, p._ or field declared seqlock[T] first")
+        return declared
+
+    def emit_seqlock(self, node: ast.Call) -> str:
+        """seqlock_load(s) -> seqlock_T_load(&s); p._ is passed as p."""
+        name = node.func.id
+        lock = node.args[0] if node.args else None
+        declared = self.seqlock_declared(node)
+        type_name = self.require_seqlock(declared.slice)
+        if isinstance(lock, ast.Attribute) and lock.attr == '_':
+            args = [self.emit_operand(lock.value, PREC_ASSIGN)]
+        else:
+            args = [f"&{self.emit_operand(lock, PREC_UNARY)}"]
+        args += [self.emit_operand(arg, PREC_ASSIGN) for arg in node.args[1:]]
+        return f"{type_name}_{name.removeprefix('seqlock_')}({', '.join(args)})"
+
+    @staticmethod
+    def regex_pattern(node: ast.Call) -> str:
+        """The literal pattern of re_match/re_search."""
+        name = node.func.id
+        CTranspiler.require_args(node, 3, f"{name} takes 3 arguments: pattern, s, n")
+        pattern = node.args[0]
+        if not (isinstance(pattern, ast.Constant) and isinstance(pattern.value, str)):
+            raise ValueError(f"{name} needs a string literal pattern")
+        return pattern.value
+
+    def emit_regex(self, node: ast.Call) -> str:
+        """
+        re_match/re_search: the pattern literal is compiled to a minimized
+        DFA (see regex.py), emitted once per distinct pattern as a table-driven
+        matcher.
+        """
+        name = node.func.id
+        pattern = node.args[0] if node.args else None
+        self.regex_pattern(node)
+        key = (name, pattern.value)
+        if key not in self.regexes:
+            matcher = f"arafura_re_{len(self.regexes)}"
+            dfa = compile_dfa(pattern.value, search=REGEX_BUILTINS[name])
+            self.require_include("stddef.h")
+            self.require_include("stdint.h")
+            self.require_support(f"regex:{matcher}", emit_matcher(dfa, matcher))
+            self.regexes[key] = matcher
+        args = ", ".join(self.emit_operand(arg, PREC_ASSIGN) for arg in node.args[1:])
+        return f"{self.regexes[key]}({args})"
+
+    def emit_char(self, text: str) -> str:
+        """A one-byte string as a C character constant."""
+        data = text.encode()
+        if len(data) != 1:
+            raise ValueError(f"Expected a single byte, got {text!r}")
+        escapes = {'\n': "'\\n'", '\r': "'\\r'", '\t': "'\\t'", '\0': "'\\0'",
+                   "'": "'\\''", '\\': "'\\\\'"}
+        if text in escapes:
+            return escapes[text]
+        return f"'{text}'" if 32 <= data[0] < 127 else str(data[0])
+
     def emit_attribute(self, node: ast.Attribute) -> str:
         """Emit attribute access."""
         # Check for special _ forms
@@ -585,18 +1589,20 @@ class CTranspiler(ast.NodeVisitor):
 
         # Dereference: ptr._ -> *ptr
         if node.attr == '_':
-            value = self.emit_expr(node.value)
+            value = self.emit_operand(node.value, PREC_UNARY)
+            if self.minimal_parens:
+                return f"*{value}"
             return f"(*{value})"
 
         # Pointer member access: ptr._.x
         # Need to check if value is ptr._
         if isinstance(node.value, ast.Attribute) and node.value.attr == '_':
             # ptr._.x -> ptr->x
-            ptr = self.emit_expr(node.value.value)
+            ptr = self.emit_operand(node.value.value, PREC_POSTFIX)
             return f"{ptr}->{node.attr}"
 
         # Regular member access: p.x -> p.x
-        value = self.emit_expr(node.value)
+        value = self.emit_operand(node.value, PREC_POSTFIX)
         return f"{value}.{node.attr}"
 
     def emit_subscript(self, node: ast.Subscript) -> str:
@@ -606,31 +1612,215 @@ class CTranspiler(ast.NodeVisitor):
             type_str = self.emit_type(node.slice, "")
             return f"_Alignof({type_str})"
 
-        value = self.emit_expr(node.value)
+        view = self.view_info(self.static_type(node.value))
+        if view is not None:
+            return self.emit_view_subscript(node, view)
+
+        value = self.emit_operand(node.value, PREC_POSTFIX)
         index = self.emit_expr(node.slice)
         return f"{value}[{index}]"
 
+    # ========================================================================
+    # STRIDED ARRAY VIEWS
+    # ========================================================================
+
+    def view_info(self, annotation: ast.AST | None) -> tuple[ast.AST, int, bool] | None:
+        """(element type, rank, contiguous) for ndview[T, N] / ndview[T, N, contiguous]."""
+        if not (isinstance(annotation, ast.Subscript) and isinstance(annotation.value, ast.Name)
+                and annotation.value.id == 'ndview'):
+            return None
+        args = annotation.slice.elts if isinstance(annotation.slice, ast.Tuple) else [annotation.slice]
+        rank = self.int_literal(args[1]) if len(args) >= 2 else None
+        if len(args) not in (2, 3) or rank is None or rank < 1:
+            raise ValueError(f"ndview needs an element type and a constant rank: {ast.dump(annotation)}")
+        contiguous = len(args) == 3
+        if contiguous and not (isinstance(args[2], ast.Name) and args[2].id == 'contiguous'):
+            raise ValueError(f"Unknown ndview layout: {ast.dump(args[2])}")
+        return args[0], rank, contiguous
+
+    def type_key(self, node: ast.AST) -> str:
+        """Identifier-safe spelling of a type, for naming generated helpers."""
+        spelled = self.emit_type(node, "").replace("*", " p ")
+        return "_".join("".join(c if c.isalnum() or c == "_" else " " for c in spelled).split())
+
+    def require_ndview(self, view: tuple[ast.AST, int, bool]) -> str:
+        """Emit (once) the struct for a view type and return its typedef name."""
+        elem, rank, contiguous = view
+        type_name = f"ndview_{self.type_key(elem)}_{rank}{'c' if contiguous else ''}"
+        # A contiguous view's innermost stride is always 1 and is not stored
+        stored_strides = rank - 1 if contiguous else rank
+        lines = [
+            "typedef struct {",
+            f"    {self.emit_type(ast.UnaryOp(op=ast.USub(), operand=elem), 'data')};",
+            f"    ptrdiff_t shape[{rank}];",
+        ]
+        if stored_strides:
+            lines.append(f"    ptrdiff_t strides[{stored_strides}];")
+        lines.append(f"}} {type_name};")
+        self.require_include("stddef.h")
+        self.require_support(f"ndview:{type_name}", lines)
+        return type_name
+
+    def view_access(self, node: ast.AST) -> str:
+        """Prefix for members of a view expression: "v." or "p->"."""
+        if isinstance(node, ast.Attribute) and node.attr == '_':
+            return f"{self.emit_operand(node.value, PREC_POSTFIX)}->"
+        return f"{self.emit_operand(node, PREC_POSTFIX)}."
+
+    def view_stride(self, access: str, view: tuple[ast.AST, int, bool], dim: int) -> str:
+        """Stride expression of one dimension (in elements)."""
+        _, rank, contiguous = view
+        if contiguous and dim == rank - 1:
+            return "1"
+        return f"{access}strides[{dim}]"
+
+    def check_view_subscript(self, node: ast.Subscript, view: tuple[ast.AST, int, bool],
+                             target: tuple[ast.AST, int, bool] | None = None):
+        """Raise if indexing or slicing a view, or assigning the slice to a view of type target, is invalid."""
+        _, rank, contiguous = view
+        indices = node.slice.elts if isinstance(node.slice, ast.Tuple) else [node.slice]
+        if len(indices) != rank:
+            raise ValueError(f"ndview of rank {rank} indexed with {len(indices)} subscripts")
+        slices = [index for index in indices if isinstance(index, ast.Slice)]
+        for index in slices:
+            if index.step is not None and (
+                    (self.int_literal(index.step) is not None and self.int_literal(index.step) <= 0)
+                    or (isinstance(index.step, ast.UnaryOp) and isinstance(index.step.op, ast.USub))):
+                raise ValueError("ndview slice steps must be positive")
+        if target is None or not slices:
+            return
+        if target[1] != len(slices):
+            raise ValueError(f"ndview slice of rank {len(slices)} assigned to rank {target[1]}")
+        last = indices[-1]
+        unit_stride = (contiguous and isinstance(last, ast.Slice)
+                       and (last.step is None or self.int_literal(last.step) == 1))
+        if target[2] and not unit_stride:
+            raise ValueError("Slice is not contiguous in its last dimension")
+
+    def emit_view_subscript(self, node: ast.Subscript, view: tuple[ast.AST, int, bool],
+                            target: tuple[ast.AST, int, bool] | None = None) -> str:
+        """
+        v[i, j] -> v.data[i * v.strides[0] + j * v.strides[1]]
+        v[a:b, j] -> a view of rank 1 sharing v's data (no copy)
+        """
+        elem, rank, contiguous = view
+        self.check_view_subscript(node, view, target)
+        indices = node.slice.elts if isinstance(node.slice, ast.Tuple) else [node.slice]
+        access = self.view_access(node.value)
+
+        offsets = []
+        shapes = []
+        strides = []
+        for dim, index in enumerate(indices):
+            stride = self.view_stride(access, view, dim)
+            if isinstance(index, ast.Slice):
+                lower = index.lower
+                if lower is not None:
+                    offsets.append(self.scale(self.emit_operand(lower, PREC_MULTIPLICATIVE), stride))
+                upper = (self.emit_operand(index.upper, PREC_ADDITIVE + 1) if index.upper is not None
+                         else f"{access}shape[{dim}]")
+                extent = upper if lower is None else f"{upper} - {self.emit_operand(lower, PREC_ADDITIVE + 1)}"
+                if index.step is not None:
+                    step = self.emit_operand(index.step, PREC_MULTIPLICATIVE + 1)
+                    extent = f"({extent} + {step} - 1) / {step}"
+                    stride = self.scale(step, stride)
+                shapes.append(extent)
+                strides.append(stride)
+            else:
+                offsets.append(self.scale(self.emit_operand(index, PREC_MULTIPLICATIVE), stride))
+
+        offset = " + ".join(offsets) or "0"
+        if not shapes:
+            return f"{access}data[{offset}]"
+
+        result = (elem, len(shapes), contiguous and strides[-1] == "1"
+                  and isinstance(indices[-1], ast.Slice))
+        if target is not None:
+            result = target
+        if result[2]:
+            strides = strides[:-1]
+        type_name = self.require_ndview(result)
+        data = f"{access}data" if offset == "0" else f"{access}data + {offset}"
+        fields = [f".data = {data}", f".shape = {{{', '.join(shapes)}}}"]
+        if strides:
+            fields.append(f".strides = {{{', '.join(strides)}}}")
+        return f"({type_name}){{{', '.join(fields)}}}"
+
+    @staticmethod
+    def scale(index: str, stride: str) -> str:
+        """index * stride, skipping a unit stride."""
+        return index if stride == "1" else f"{index} * {stride}"
+
+    def emit_view_constructor(self, node: ast.Call, view: tuple[ast.AST, int, bool]) -> str:
+        """
+        ndview[T, N](ptr, d0, ..., dN-1): a row-major view of a flat buffer.
+        """
+        elem, rank, contiguous = view
+        self.require_args(node, rank + 1, f"ndview of rank {rank} needs a pointer and {rank} extents")
+        data = self.emit_operand(node.args[0], PREC_ASSIGN)
+        dims = node.args[1:]
+        strides = []
+        for k in range(rank):
+            # Right operands of * need a tighter precedence: a * (b / c) is not a * b / c
+            factors = [self.emit_operand(d, PREC_MULTIPLICATIVE + (i > 0)) for i, d in enumerate(dims[k + 1:])]
+            strides.append(" * ".join(factors) or "1")
+        if contiguous:
+            strides = strides[:-1]
+        type_name = self.require_ndview(view)
+        fields = [f".data = {data}", f".shape = {{{', '.join(self.emit_operand(d, PREC_ASSIGN) for d in node.args[1:])}}}"]
+        if strides:
+            fields.append(f".strides = {{{', '.join(strides)}}}")
+        return f"({type_name}){{{', '.join(fields)}}}"
+
+    def emit_value(self, node: ast.AST, target: ast.AST | None) -> str:
+        """Emit an expression assigned to a variable declared as `target`."""
+        view = self.view_info(self.resolve_type(target))
+        if view is not None:
+            if isinstance(node, ast.Call) and isinstance(node.func, ast.Name) and node.func.id == 'ndview':
+                return self.emit_view_constructor(node, view)
+            if isinstance(node, ast.Subscript):
+                source = self.view_info(self.static_type(node.value))
+                if source is not None:
+                    return self.emit_view_subscript(node, source, target=view)
+        return self.emit_expr(node)
+
     # ========================================================================
     # STATEMENT EMISSION
     # ========================================================================
 
     def visit_Module(self, node: ast.Module):
         """Visit module (top level)."""
-        # First pass: collect all type names
+        self.collect_type_names(node.body)
+
+        if self.infer_const:
+            self.const_params = self.infer_const_params(node)
+
+        # Second pass: emit code
         for stmt in node.body:
+            self.visit_toplevel(stmt)
+
+    def collect_type_names(self, body: list[ast.stmt]):
+        """First pass: collect all type names."""
+        for stmt in body:
             if isinstance(stmt, ast.ClassDef):
                 is_union = any(isinstance(base, ast.Name) and base.id == 'Union' for base in stmt.bases)
                 is_enum = any(isinstance(base, ast.Name) and base.id == 'Enum' for base in stmt.bases)
-                if is_union:
+                if self.is_protocol(stmt):
+                    self.protocol_types.add(stmt.name)
+                elif is_union:
                     self.union_types.add(stmt.name)
                 elif is_enum:
                     self.enum_types.add(stmt.name)
                 else:
                     self.struct_types.add(stmt.name)
 
-        # Second pass: emit code
-        for stmt in node.body:
-            self.visit(stmt)
+    def visit_toplevel(self, stmt: ast.stmt):
+        """Visit a top-level statement, preceded by any support code it requires."""
+        mark = len(self.output)
+        self.visit(stmt)
+        if self.support:
+            self.output[mark:mark] = self.support
+            self.support = []
 
     def visit_Import(self, node: ast.Import):
         """Handle import: import stdio -> #include "stdio.h" """
@@ -639,14 +1829,38 @@ class CTranspiler(ast.NodeVisitor):
 
     def visit_ImportFrom(self, node: ast.ImportFrom):
         """Handle from ... import: from stdio import * -> #include <stdio.h>"""
-        if node.names[0].name == '*':
-            self.emit(f'#include <{node.module}.h>')
+        if node.module and node.module.startswith('arafura.'):
+            self.include_library(node.module.removeprefix('arafura.'))
+        elif node.names[0].name == '*':
+            if f"{node.module}.h" not in self.prelude_includes:
+                self.emit(f'#include <{node.module}.h>')
         else:
             # Partial imports - treat as regular include
             self.emit(f'#include "{node.module}.h"')
 
+    def include_library(self, name: str):
+        """Transpile a standard module (arafura/lib) in place, once."""
+        if name in self.libraries:
+            return
+        self.libraries.add(name)
+        module = ast.parse(lib.source(name))
+        self.collect_type_names(module.body)
+        for stmt in module.body:
+            self.visit_toplevel(stmt)
+
+    def record_span(self, node: ast.stmt, start: int):
+        """Note the output lines of a file-scope definition, for the sharder."""
+        if self.spans is not None and self.current_function is None:
+            self.spans.append((node, start, len(self.output)))
+
     def visit_AnnAssign(self, node: ast.AnnAssign):
         """Handle annotated assignment (variable declaration)."""
+        start = len(self.output)
+        self.emit_declaration(node)
+        self.record_span(node, start)
+
+    def emit_declaration(self, node: ast.AnnAssign):
+        """Emit a label, macro constant or variable declaration."""
         if isinstance(node.target, ast.Name):
             var_name = self.escape_identifier(node.target.id)
 
@@ -676,37 +1890,29 @@ class CTranspiler(ast.NodeVisitor):
                     # Regular variable declaration
                     type_decl = self.emit_type(node.annotation, var_name)
                     if node.value:
-                        value = self.emit_expr(node.value)
+                        value = self.emit_value(node.value, node.annotation)
                         self.emit(f"{self.indent()}{type_decl} = {value};")
                     else:
                         self.emit(f"{self.indent()}{type_decl};")
+                    self.declare_var(node.target.id, node.annotation)
 
     def visit_Assign(self, node: ast.Assign):
         """Handle assignment."""
         for target in node.targets:
             target_str = self.emit_expr(target)
-            value_str = self.emit_expr(node.value)
+            value_str = self.emit_value(node.value, self.static_type(target))
             self.emit(f"{self.indent()}{target_str} = {value_str};")
 
     def visit_AugAssign(self, node: ast.AugAssign):
         """Handle augmented assignment: x += 1"""
         target = self.emit_expr(node.target)
+        if isinstance(node.op, (ast.Div, ast.FloorDiv, ast.Mod)) and self.fastdiv_suffix(node.value):
+            # x /= d -> x = x / d with d's reciprocal
+            self.emit(f"{self.indent()}{target} = {self.emit_fastdiv(node.op, node.target, node.value)};")
+            return
         value = self.emit_expr(node.value)
 
-        op_map = {
-            ast.Add: '+=',
-            ast.Sub: '-=',
-            ast.Mult: '*=',
-            ast.Div: '/=',
-            ast.Mod: '%=',
-            ast.BitAnd: '&=',
-            ast.BitOr: '|=',
-            ast.BitXor: '^=',
-            ast.LShift: '<<=',
-            ast.RShift: '>>=',
-        }
-
-        op_str = op_map.get(type(node.op))
+        op_str = AUGASSIGN_OPERATORS.get(type(node.op))
         if op_str:
             self.emit(f"{self.indent()}{target} {op_str} {value};")
         else:
@@ -720,13 +1926,18 @@ class CTranspiler(ast.NodeVisitor):
     def visit_If(self, node: ast.If):
         """Handle if statement."""
         # Check for preprocessor conditional: if [expr]:
-        if isinstance(node.test, ast.List) and len(node.test.elts) == 1:
+        if self.is_preprocessor_test(node.test):
             # Preprocessor conditional - handle full chain with elif/else
             self.emit_preprocessor_chain(node)
         else:
             # Regular if statement
             self.emit_if_chain(node)
 
+    @staticmethod
+    def is_preprocessor_test(test: ast.expr) -> bool:
+        """True for the condition of a preprocessor conditional: if [expr]:"""
+        return isinstance(test, ast.List) and len(test.elts) == 1
+
     def emit_preprocessor_chain(self, node: ast.If):
         """Emit preprocessor conditional chain (#if/#elif/#else/#endif)."""
         # Emit the initial #if/#ifdef/#ifndef
@@ -763,7 +1974,7 @@ class CTranspiler(ast.NodeVisitor):
         if len(orelse_stmts) == 1 and isinstance(orelse_stmts[0], ast.If):
             # Check if it's a preprocessor elif
             elif_node = orelse_stmts[0]
-            if isinstance(elif_node.test, ast.List) and len(elif_node.test.elts) == 1:
+            if self.is_preprocessor_test(elif_node.test):
                 # Preprocessor elif
                 cond_expr = elif_node.test.elts[0]
 
@@ -876,70 +2087,73 @@ class CTranspiler(ast.NodeVisitor):
 
     def visit_For(self, node: ast.For):
         """Handle for statement (C-style for loop)."""
-        # Pattern: for VARS in TYPES(INIT)(COND)(STEP):
-        # Iterable is Call(Call(Call(TYPES, [INIT]), [COND]), [STEP])
-
-        if isinstance(node.iter, ast.Call):
-            # Try to match the pattern
-            step_call = node.iter
-            if isinstance(step_call.func, ast.Call):
-                cond_call = step_call.func
-                if isinstance(cond_call.func, ast.Call):
-                    init_call = cond_call.func
-
-                    # Extract components
-                    types = init_call.func
-                    init_expr = init_call.args[0] if init_call.args else None
-                    cond_expr = cond_call.args[0] if cond_call.args else None
-                    step_expr = step_call.args[0] if step_call.args else None
-
-                    # Extract variables
-                    if isinstance(node.target, ast.Tuple):
-                        var_names = [elt.id for elt in node.target.elts if isinstance(elt, ast.Name)]
-                        if isinstance(types, ast.Tuple):
-                            type_exprs = types.elts
-                        else:
-                            type_exprs = [types] * len(var_names)
-                    else:
-                        var_names = [node.target.id]
-                        type_exprs = [types]
-
-                    # Emit declarations
-                    # for (int i = 0, j = 10; i < 10; i++, j--)
-
-                    # Build init clause
-                    init_parts = []
-                    if init_expr:
-                        # Handle tuple of assignments or single assignment
-                        if isinstance(init_expr, ast.Tuple):
-                            for i, (var, typ, init_item) in enumerate(zip(var_names, type_exprs, init_expr.elts)):
-                                if isinstance(init_item, ast.NamedExpr):
-                                    val = self.emit_expr(init_item.value)
-                                    type_str = self.emit_type(typ, "")
-                                    if i == 0:
-                                        init_parts.append(f"{type_str} {var} = {val}")
-                                    else:
-                                        init_parts.append(f"{var} = {val}")
+        parts = self.for_loop_parts(node)
+        if parts is None:
+            raise ValueError(f"Invalid for loop pattern: {ast.dump(node)}")
+        types, init_expr, cond_expr, step_expr = parts
+
+        # Extract variables
+        if isinstance(node.target, ast.Tuple):
+            var_names = [elt.id for elt in node.target.elts if isinstance(elt, ast.Name)]
+            if isinstance(types, ast.Tuple):
+                type_exprs = types.elts
+            else:
+                type_exprs = [types] * len(var_names)
+        else:
+            var_names = [node.target.id]
+            type_exprs = [types]
+
+        # Emit declarations
+        # for (int i = 0, j = 10; i < 10; i++, j--)
+
+        # Build init clause
+        init_parts = []
+        if init_expr:
+            # Handle tuple of assignments or single assignment
+            if isinstance(init_expr, ast.Tuple):
+                for i, (var, typ, init_item) in enumerate(zip(var_names, type_exprs, init_expr.elts)):
+                    if isinstance(init_item, ast.NamedExpr):
+                        val = self.emit_expr(init_item.value)
+                        type_str = self.emit_type(typ, "")
+                        if i == 0:
+                            init_parts.append(f"{type_str} {var} = {val}")
                         else:
-                            # Single variable
-                            if isinstance(init_expr, ast.NamedExpr):
-                                val = self.emit_expr(init_expr.value)
-                                type_str = self.emit_type(type_exprs[0], "")
-                                init_parts.append(f"{type_str} {var_names[0]} = {val}")
+                            init_parts.append(f"{var} = {val}")
+            else:
+                # Single variable
+                if isinstance(init_expr, ast.NamedExpr):
+                    val = self.emit_expr(init_expr.value)
+                    type_str = self.emit_type(type_exprs[0], "")
+                    init_parts.append(f"{type_str} {var_names[0]} = {val}")
 
-                    init_str = ", ".join(init_parts)
-                    cond_str = self.emit_expr(cond_expr) if cond_expr else ""
-                    step_str = self.emit_expr(step_expr) if step_expr else ""
+        init_str = ", ".join(init_parts)
+        cond_str = self.emit_expr(cond_expr) if cond_expr else ""
+        step_str = self.emit_expr(step_expr) if step_expr else ""
 
-                    self.emit(f"{self.indent()}for ({init_str}; {cond_str}; {step_str}) {{")
-                    self.indent_level += 1
-                    for stmt in node.body:
-                        self.visit(stmt)
-                    self.indent_level -= 1
-                    self.emit(f"{self.indent()}}}")
-                    return
+        self.emit(f"{self.indent()}for ({init_str}; {cond_str}; {step_str}) {{")
+        self.indent_level += 1
+        for stmt in node.body:
+            self.visit(stmt)
+        self.indent_level -= 1
+        self.emit(f"{self.indent()}}}")
 
-        raise ValueError(f"Invalid for loop pattern: {ast.dump(node)}")
+    @staticmethod
+    def for_loop_parts(node: ast.For) -> tuple[ast.expr, ast.expr | None, ast.expr | None, ast.expr | None] | None:
+        """
+        Split for VARS in TYPES(INIT)(COND)(STEP) into (TYPES, INIT, COND, STEP),
+        or None if the loop does not have that shape.
+        The iterable is Call(Call(Call(TYPES, [INIT]), [COND]), [STEP]).
+        """
+        step_call = node.iter
+        if not (isinstance(step_call, ast.Call) and isinstance(step_call.func, ast.Call)
+                and isinstance(step_call.func.func, ast.Call)):
+            return None
+        cond_call = step_call.func
+        init_call = cond_call.func
+        return (init_call.func,
+                init_call.args[0] if init_call.args else None,
+                cond_call.args[0] if cond_call.args else None,
+                step_call.args[0] if step_call.args else None)
 
     def visit_Break(self, node: ast.Break):
         """Handle break statement."""
@@ -976,6 +2190,9 @@ class CTranspiler(ast.NodeVisitor):
 
     def visit_Match(self, node: ast.Match):
         """Handle match statement (switch)."""
+        if self.emit_match_table(node):
+            return
+
         # match expr: -> switch (expr) {
         subject = self.emit_expr(node.subject)
         self.emit(f"{self.indent()}switch ({subject}) {{")
@@ -983,15 +2200,15 @@ class CTranspiler(ast.NodeVisitor):
         # Process each case
         for case in node.cases:
             # case pattern: -> case value: or default:
-            if isinstance(case.pattern, ast.MatchAs) and case.pattern.pattern is None:
+            if not self.is_switch_pattern(case.pattern):
+                raise ValueError(f"Unsupported match pattern: {ast.dump(case.pattern)}")
+            if isinstance(case.pattern, ast.MatchAs):
                 # case _: -> default:
                 self.emit(f"{self.indent()}default:")
-            elif isinstance(case.pattern, ast.MatchValue):
+            else:
                 # case V: -> case V:
                 value = self.emit_expr(case.pattern.value)
                 self.emit(f"{self.indent()}case {value}:")
-            else:
-                raise ValueError(f"Unsupported match pattern: {ast.dump(case.pattern)}")
 
             # Emit case body
             self.indent_level += 1
@@ -1001,30 +2218,326 @@ class CTranspiler(ast.NodeVisitor):
 
         self.emit(f"{self.indent()}}}")
 
+    @staticmethod
+    def is_switch_pattern(pattern: ast.pattern) -> bool:
+        """True for the patterns a switch can express: case V: and case _:"""
+        return (isinstance(pattern, ast.MatchValue)
+                or (isinstance(pattern, ast.MatchAs) and pattern.pattern is None))
+
+    @staticmethod
+    def int_literal(node: ast.AST) -> int | None:
+        """Value of an integer literal (5 or -5), or None."""
+        if isinstance(node, ast.UnaryOp) and isinstance(node.op, ast.USub):
+            value = CTranspiler.int_literal(node.operand)
+            return -value if value is not None else None
+        if isinstance(node, ast.Constant) and type(node.value) is int:
+            return node.value
+        return None
+
+    @staticmethod
+    def is_literal(node: ast.AST) -> bool:
+        """True for a constant or a negated numeric constant."""
+        if isinstance(node, ast.UnaryOp) and isinstance(node.op, ast.USub):
+            node = node.operand
+            return isinstance(node, ast.Constant) and isinstance(node.value, (int, float))
+        return isinstance(node, ast.Constant)
+
+    @staticmethod
+    def is_pure_expr(node: ast.AST) -> bool:
+        """True if evaluating `node` twice is as good as once (no calls or side effects)."""
+        for child in ast.walk(node):
+            if isinstance(child, (ast.Call, ast.NamedExpr)):
+                return False
+            if isinstance(child, ast.BinOp) and isinstance(child.op, (ast.Pow, ast.FloorDiv)):
+                if any(isinstance(side, ast.Name) and side.id == '_' for side in (child.left, child.right)):
+                    return False
+        return True
+
+    def emit_match_table(self, node: ast.Match) -> bool:
+        """
+        Emit a match whose cases map dense integer constants to literal
+        return values as a static const table plus one bounds check:
+
+            match x:                    static const int lut0[3] = {10, 20, 30};
+                case 1: return 10       if ((unsigned long long)x - 1 < 3) {
+                case 2: return 20   ->      return lut0[x - 1];
+                case 3: return 30       }
+                case _: return 0        return 0;
+
+        Returns False (emit a switch) when the match does not have that shape.
+        """
+        func = self.current_function
+        if func is None or (isinstance(func.returns, ast.Name) and func.returns.id == 'void'):
+            return False
+        if not self.is_pure_expr(node.subject):
+            return False
+
+        entries = {}
+        default = None
+        for i, case in enumerate(node.cases):
+            if case.guard is not None or len(case.body) != 1:
+                return False
+            body = case.body[0]
+            if not (isinstance(body, ast.Return) and body.value is not None and self.is_literal(body.value)):
+                return False
+            if isinstance(case.pattern, ast.MatchAs) and case.pattern.pattern is None and case.pattern.name is None:
+                if i != len(node.cases) - 1:
+                    return False
+                default = body.value
+            elif isinstance(case.pattern, ast.MatchValue):
+                key = self.int_literal(case.pattern.value)
+                if key is None or key in entries:
+                    return False
+                entries[key] = body.value
+            else:
+                return False
+
+        if len(entries) < LOOKUP_TABLE_MIN_CASES:
+            return False
+        low, high = min(entries), max(entries)
+        size = high - low + 1
+        if size > 2 * len(entries) or size > LOOKUP_TABLE_MAX_SIZE:
+            return False
+        if size > len(entries) and default is None:
+            return False  # Holes would fall through the switch
+
+        # static const T name[size]; pointer results get a const pointer
+        # so the table stays read-only without changing the pointee type
+        name = f"lut{self.table_count}"
+        self.table_count += 1
+        elem_type = self.strip_storage_class(func.returns)
+        if isinstance(elem_type, ast.UnaryOp) and isinstance(elem_type.op, ast.USub):
+            decl = "static " + self.emit_type(elem_type, f"const {name}[{size}]")
+        else:
+            decl = "static const " + self.emit_type(elem_type, f"{name}[{size}]")
+        values = ", ".join(
+            self.emit_expr(entries.get(key, default)) for key in range(low, high + 1)
+        )
+        self.emit(f"{self.indent()}{decl} = {{{values}}};")
+
+        subject = self.emit_operand(node.subject, PREC_UNARY)
+        if low == 0:
+            check = f"(unsigned long long){subject} < {size}"
+            index = self.emit_expr(node.subject)
+        else:
+            sign = '-' if low > 0 else '+'
+            check = f"(unsigned long long){subject} {sign} {abs(low)} < {size}"
+            index = f"{self.emit_operand(node.subject, PREC_ADDITIVE)} {sign} {abs(low)}"
+        self.emit(f"{self.indent()}if ({check}) {{")
+        self.indent_level += 1
+        self.emit(f"{self.indent()}return {name}[{index}];")
+        self.indent_level -= 1
+        self.emit(f"{self.indent()}}}")
+        if default is not None:
+            self.emit(f"{self.indent()}return {self.emit_expr(default)};")
+        return True
+
+    @staticmethod
+    def strip_storage_class(node: ast.AST) -> ast.AST:
+        """Remove outer static/extern/const qualifiers from a type annotation."""
+        while (isinstance(node, ast.Subscript) and isinstance(node.value, ast.Name)
+               and node.value.id in ('static', 'extern', 'const', 'inline')):
+            node = node.slice
+        return node
+
     def visit_FunctionDef(self, node: ast.FunctionDef):
         """Handle function definition or macro."""
-        # Determine if it's a function or macro
-        has_return_annotation = node.returns is not None
-        has_param_annotations = all(arg.annotation is not None for arg in node.args.args)
-
-        if has_return_annotation and has_param_annotations:
-            # C function
+        kind = self.definition_kind(node)
+        if kind == 'function':
+            start = len(self.output)
             self.emit_function(node)
-        elif not has_return_annotation and not has_param_annotations:
-            # Macro
+            self.record_span(node, start)
+        elif kind == 'macro':
             self.emit_macro(node)
         else:
             raise ValueError(f"Invalid function/macro definition: {node.name}")
 
+    @staticmethod
+    def definition_kind(node: ast.FunctionDef) -> str | None:
+        """
+        'function' if the return and every parameter are annotated, 'macro' if
+        none are, None for a mix.
+        """
+        has_return_annotation = node.returns is not None
+        annotated = [arg.annotation is not None for arg in node.args.args]
+        if has_return_annotation and all(annotated):
+            return 'function'
+        if not has_return_annotation and not any(annotated):
+            return 'macro'
+        return None
+
+    @staticmethod
+    def find_decorator(node: ast.FunctionDef | ast.ClassDef, name: str) -> ast.AST | None:
+        """Return the decorator @name or @name(...) of a definition, if present."""
+        for decorator in node.decorator_list:
+            target = decorator.func if isinstance(decorator, ast.Call) else decorator
+            if isinstance(target, ast.Name) and target.id == name:
+                return decorator
+        return None
+
     def emit_function(self, node: ast.FunctionDef):
         """Emit a C function."""
-        func_name = node.name
+        versioned = self.find_decorator(node, 'alias_versioned')
+        if versioned is not None:
+            self.emit_alias_versioned(node, versioned)
+            return
+
+        self.emit(f"{self.indent()}{self.visibility_attribute(node)}{self.emit_function_signature(node)} {{")
+        self.emit_function_body(node)
+
+    def visibility_attribute(self, node: ast.FunctionDef) -> str:
+        """
+        Visibility of an external function: @export functions keep default
+        visibility (also under -fvisibility=hidden), the rest follow the
+        visibility option. Static functions have no dynamic symbol.
+        """
+        exported = self.find_decorator(node, 'export') is not None
+        if self.is_static_function(node):
+            if exported:
+                raise ValueError(f"@export function cannot be static: {node.name}")
+            return ""
+        if exported:
+            return '__attribute__((visibility("default"))) '
+        if self.visibility == 'hidden':
+            return '__attribute__((visibility("hidden"))) '
+        return ""
+
+    def emit_function_body(self, node: ast.FunctionDef):
+        """Emit the statements of a function and its closing brace."""
+        saved_function = self.current_function
+        self.current_function = node
+        self.scopes.append({arg.arg: arg.annotation for arg in node.args.args})
+        self.indent_level += 1
+
+        for stmt in node.body:
+            self.visit(stmt)
+
+        self.indent_level -= 1
+        self.scopes.pop()
+        self.current_function = saved_function
+        self.emit(f"{self.indent()}}}")
+
+    @staticmethod
+    def alias_versioned_extents(node: ast.FunctionDef, decorator: ast.AST) -> tuple[dict, dict]:
+        """Pointer parameters of an @alias_versioned function, and the extents given for them."""
+        if not isinstance(decorator, ast.Call) or (not decorator.args and not decorator.keywords):
+            raise ValueError(f"@alias_versioned needs pointer extents: {node.name}")
+        if len(decorator.args) > 1:
+            raise ValueError(f"@alias_versioned takes one shared extent or per-pointer keywords: {node.name}")
+
+        pointers = {
+            arg.arg: arg.annotation for arg in node.args.args
+            if isinstance(arg.annotation, ast.UnaryOp) and isinstance(arg.annotation.op, ast.USub)
+            and not (isinstance(arg.annotation.operand, ast.Call) and isinstance(arg.annotation.operand.func, ast.Tuple))
+        }
+        extents = {}
+        if decorator.args:
+            for name in pointers:
+                extents[name] = decorator.args[0]
+        for kw in decorator.keywords:
+            if kw.arg not in pointers:
+                raise ValueError(f"@alias_versioned: {kw.arg} is not a pointer parameter of {node.name}")
+            extents[kw.arg] = kw.value
+        for name in extents:
+            operand = pointers[name].operand
+            if isinstance(operand, ast.Name) and operand.id == 'void':
+                raise ValueError(f"@alias_versioned: extent of void pointer {name} is not in elements")
+        # The body is emitted twice; each copy would have its own static locals
+        for stmt in ast.walk(node):
+            if (isinstance(stmt, ast.AnnAssign) and isinstance(stmt.annotation, ast.Subscript)
+                    and isinstance(stmt.annotation.value, ast.Name) and stmt.annotation.value.id == 'static'):
+                raise ValueError(f"@alias_versioned: static local {ast.unparse(stmt.target)} of {node.name} "
+                                 "would not be shared with its restrict clone")
+        return pointers, extents
+
+    def emit_alias_versioned(self, node: ast.FunctionDef, decorator: ast.AST):
+        """
+        Emit @alias_versioned(n) / @alias_versioned(a=n, b=m):
+        a restrict-qualified static clone of the body, and the function itself,
+        which calls the clone when the pointer ranges [p, p + extent) do not
+        overlap and otherwise runs the original body.
+        """
+        pointers, extents = self.alias_versioned_extents(node, decorator)
+
+        # Two read-only ranges may overlap freely
+        const_params = self.const_params.get(id(node), set())
+        read_only = {
+            name for name in extents
+            if is_const_pointer_type(pointers[name]) or name in const_params
+        }
+        names = list(extents)
+        checks = []
+        for i, a in enumerate(names):
+            for b in names[i + 1:]:
+                if a in read_only and b in read_only:
+                    continue
+                end_a = self.emit_operand(extents[a], PREC_MULTIPLICATIVE)
+                end_b = self.emit_operand(extents[b], PREC_MULTIPLICATIVE)
+                checks.append(
+                    f"(uintptr_t)({a} + {end_a}) <= (uintptr_t){b} || "
+                    f"(uintptr_t)({b} + {end_b}) <= (uintptr_t){a}"
+                )
+        if not checks:
+            raise ValueError(f"@alias_versioned needs two pointers that may alias: {node.name}")
+        if len(checks) > 1:
+            checks = [f"({check})" for check in checks]
+        self.require_include("stdint.h")
+
+        clone_name = f"{node.name}_restrict"
+        static = "" if self.is_static_function(node) else "static "
+        clone_sig = self.emit_function_signature(node, name=clone_name, restrict=set(extents))
+        self.emit(f"{self.indent()}{static}{clone_sig} {{")
+        self.emit_function_body(node)
+
+        self.emit(f"{self.indent()}{self.visibility_attribute(node)}{self.emit_function_signature(node)} {{")
+        self.indent_level += 1
+        self.emit(f"{self.indent()}if ({' && '.join(checks)}) {{")
+        self.indent_level += 1
+        call = f"{clone_name}({', '.join(arg.arg for arg in node.args.args)})"
+        returns = self.resolve_type(node.returns)
+        if isinstance(returns, ast.Name) and returns.id == 'void':
+            self.emit(f"{self.indent()}{call};")
+            self.emit(f"{self.indent()}return;")
+        else:
+            self.emit(f"{self.indent()}return {call};")
+        self.indent_level -= 1
+        self.emit(f"{self.indent()}}}")
+        self.indent_level -= 1
+        self.emit_function_body(node)
+
+    @staticmethod
+    def is_static_function(node: ast.FunctionDef) -> bool:
+        """True if the return annotation carries static[...]."""
+        current = node.returns
+        while isinstance(current, ast.Subscript) and isinstance(current.value, ast.Name):
+            if current.value.id == 'static':
+                return True
+            current = current.slice
+        return False
+
+    def emit_function_signature(self, node: ast.FunctionDef, name: str | None = None,
+                                restrict: set[str] = frozenset()) -> str:
+        """
+        Emit the declarator of a C function: "int add(int a, int b)".
+        Shared by definitions and prototypes so both agree on inferred const.
+        Parameters in `restrict` are emitted restrict-qualified.
+        """
+        func_name = name or node.name
         ret_type = self.emit_type(node.returns, "")
 
         # Parameters
+        const_params = self.const_params.get(id(node), set())
         params = []
         for arg in node.args.args:
-            param_type = self.emit_type(arg.annotation, arg.arg)
+            annotation = arg.annotation
+            if arg.arg in const_params:
+                # -T -> -const[T]
+                annotation = ast.UnaryOp(
+                    op=ast.USub(),
+                    operand=ast.Subscript(value=ast.Name(id='const'), slice=annotation.operand),
+                )
+            var_name = f"restrict {arg.arg}" if arg.arg in restrict else arg.arg
+            param_type = self.emit_type(annotation, var_name)
             params.append(param_type)
 
         if not params:
@@ -1032,14 +2545,69 @@ class CTranspiler(ast.NodeVisitor):
         else:
             params_str = ", ".join(params)
 
-        self.emit(f"{self.indent()}{ret_type} {func_name}({params_str}) {{")
-        self.indent_level += 1
+        return f"{ret_type} {func_name}({params_str})"
 
-        for stmt in node.body:
-            self.visit(stmt)
+    def infer_const_params(self, module: ast.Module) -> dict[int, set[str]]:
+        """
+        Find pointer parameters that are never written through, never escape,
+        and are only passed on to const pointer parameters.
 
-        self.indent_level -= 1
-        self.emit(f"{self.indent()}}}")
+        Starts from every candidate being const and removes violations until
+        a fixed point, so parameters passed along recursive calls stay const.
+        """
+        functions = [
+            stmt for stmt in ast.walk(module)
+            if isinstance(stmt, ast.FunctionDef)
+            and stmt.returns is not None
+            and all(arg.annotation is not None for arg in stmt.args.args)
+        ]
+
+        by_name = {}
+        for func in functions:
+            by_name.setdefault(func.name, []).append(func)
+
+        array_fields = {
+            field.target.id for struct in ast.walk(module) if isinstance(struct, ast.ClassDef)
+            for field in struct.body
+            if isinstance(field, ast.AnnAssign) and isinstance(field.target, ast.Name)
+            and is_array_type(field.annotation)
+        }
+
+        inferred = {}
+        calls = {}
+        for func in functions:
+            candidates = {
+                arg.arg for arg in func.args.args
+                if is_single_pointer_type(arg.annotation)
+                and not is_const_pointer_type(arg.annotation)
+            }
+            scanner = PointerUseScanner(candidates, array_fields)
+            for stmt in func.body:
+                scanner.visit(stmt)
+            inferred[id(func)] = candidates - scanner.disqualified
+            calls[id(func)] = scanner.calls
+
+        def accepts_const(callee: str | None, index: int) -> bool:
+            if callee in by_name:
+                for target in by_name[callee]:
+                    if index >= len(target.args.args):
+                        return False
+                    arg = target.args.args[index]
+                    if not (is_const_pointer_type(arg.annotation) or arg.arg in inferred[id(target)]):
+                        return False
+                return True
+            return index in CONST_POINTER_PARAMS.get(callee, ())
+
+        changed = True
+        while changed:
+            changed = False
+            for func in functions:
+                for callee, index, param in calls[id(func)]:
+                    if param in inferred[id(func)] and not accepts_const(callee, index):
+                        inferred[id(func)].discard(param)
+                        changed = True
+
+        return inferred
 
     def emit_macro(self, node: ast.FunctionDef):
         """Emit a C macro."""
@@ -1083,7 +2651,11 @@ class CTranspiler(ast.NodeVisitor):
             self.emit(f"{self.indent()}}} while(0)")
 
     def visit_ClassDef(self, node: ast.ClassDef):
-        """Handle class definition (struct/union/enum)."""
+        """Handle class definition (struct/union/enum/Protocol)."""
+        if self.is_protocol(node):
+            self.emit_protocol(node)
+            return
+
         class_name = node.name
 
         # Check base classes to determine type
@@ -1230,6 +2802,8 @@ class CTranspiler(ast.NodeVisitor):
                     field_name = stmt.target.id
                     field_type = self.emit_type(stmt.annotation, field_name)
                     self.emit(f"{self.indent()}{field_type};")
+                    for struct_name in {class_name, typedef_name or class_name}:
+                        self.fields.setdefault(struct_name, {})[field_name] = stmt.annotation
                 elif isinstance(stmt, ast.ClassDef):
                     # Nested struct
                     self.visit(stmt)
@@ -1252,21 +2826,341 @@ class CTranspiler(ast.NodeVisitor):
             else:
                 self.emit(f"{self.indent()}}};")
 
+        if composite_type == "struct" and not is_anonymous:
+            self.emit_methods(node)
+            self.emit_derived(node)
+        elif self.find_decorator(node, 'derive') is not None:
+            raise ValueError(f"@derive applies to structs: {class_name}")
+
+    # ========================================================================
+    # PROTOCOLS AND METHODS
+    # ========================================================================
+
+    @staticmethod
+    def is_protocol(node: ast.ClassDef) -> bool:
+        """True for class NAME(Protocol):"""
+        return any(isinstance(base, ast.Name) and base.id == 'Protocol' for base in node.bases)
+
+    @staticmethod
+    def method_function(class_name: str, method: ast.FunctionDef) -> ast.FunctionDef:
+        """
+        The C function for a method: def m(self, ...) in class T becomes
+        T_m(T *self, ...). An unannotated self is taken as -T.
+        """
+        args = list(method.args.args)
+        if args and args[0].arg == 'self' and args[0].annotation is None:
+            self_type = ast.UnaryOp(op=ast.USub(), operand=ast.Name(id=class_name))
+            args[0] = ast.copy_location(ast.arg(arg='self', annotation=self_type), args[0])
+        function = ast.FunctionDef(
+            name=f"{class_name}_{method.name}",
+            args=ast.arguments(posonlyargs=[], args=args, vararg=None, kwonlyargs=[],
+                               kw_defaults=[], kwarg=None, defaults=[]),
+            body=method.body, decorator_list=method.decorator_list,
+            returns=method.returns, type_params=[],
+        )
+        return ast.copy_location(function, method)
+
+    def emit_protocol(self, node: ast.ClassDef):
+        """
+        Emit class NAME(Protocol): a vtable struct of function pointers taking
+        void *self, the interface value {self, vtable}, and one static inline
+        dispatch helper per method.
+        """
+        name = node.name
+        methods = [stmt for stmt in node.body if isinstance(stmt, ast.FunctionDef)]
+        for method in methods:
+            if not method.args.args or method.args.args[0].arg != 'self':
+                raise ValueError(f"Protocol method needs self as first parameter: {name}.{method.name}")
+            if self.definition_kind(self.method_function(name, method)) != 'function':
+                raise ValueError(f"Protocol method needs full annotations: {name}.{method.name}")
+        self.protocol_types.add(name)
+        self.protocols[name] = methods
+
+        self.emit(f"{self.indent()}typedef struct {name}_vtable {{")
+        self.indent_level += 1
+        for method in methods:
+            params = ", ".join(["void *self"] + [self.emit_type(arg.annotation, arg.arg) for arg in method.args.args[1:]])
+            self.emit(f"{self.indent()}{self.emit_type(method.returns, '')} (*{method.name})({params});")
+        self.indent_level -= 1
+        self.emit(f"{self.indent()}}} {name}_vtable;")
+        self.emit(f"{self.indent()}typedef struct {name} {{")
+        self.emit(f"{self.indent()}    void *self;")
+        self.emit(f"{self.indent()}    const {name}_vtable *vtable;")
+        self.emit(f"{self.indent()}}} {name};")
+
+        for method in methods:
+            params = ", ".join([f"{name} obj"] + [self.emit_type(arg.annotation, arg.arg) for arg in method.args.args[1:]])
+            args = ", ".join(["obj.self"] + [arg.arg for arg in method.args.args[1:]])
+            ret = self.emit_type(method.returns, "")
+            result = "" if ret == "void" else "return "
+            self.emit(f"{self.indent()}static inline {ret} {name}_{method.name}({params}) {{")
+            self.emit(f"{self.indent()}    {result}obj.vtable->{method.name}({args});")
+            self.emit(f"{self.indent()}}}")
+
+    def emit_methods(self, node: ast.ClassDef):
+        """
+        Emit the methods of a struct as T_m(T *self, ...), then for each
+        @implements(P) a vtable of thunks and T_as_P(T *self) -> P.
+        """
+        methods = {stmt.name: stmt for stmt in node.body if isinstance(stmt, ast.FunctionDef)}
+        self.methods[node.name] = tuple(methods)
+        for method in methods.values():
+            self.visit_FunctionDef(self.method_function(node.name, method))
+
+        decorator = self.find_decorator(node, 'implements')
+        if decorator is None:
+            return
+        if not isinstance(decorator, ast.Call) or not decorator.args:
+            raise ValueError(f"@implements needs protocol names: {node.name}")
+        type_name = self.emit_type(ast.Name(id=node.name), "")
+        for protocol in decorator.args:
+            if not isinstance(protocol, ast.Name) or protocol.id not in self.protocols:
+                raise ValueError(f"@implements: unknown protocol {ast.unparse(protocol)} for {node.name}")
+            self.emit_vtable(node.name, type_name, protocol.id, methods)
+
+    def emit_vtable(self, class_name: str, type_name: str, protocol: str, methods: dict[str, ast.FunctionDef]):
+        """Emit the vtable of class_name for protocol and its conversion function."""
+        thunks = []
+        for signature in self.protocols[protocol]:
+            method = methods.get(signature.name)
+            if method is None or len(method.args.args) != len(signature.args.args):
+                raise ValueError(f"{class_name} does not implement {protocol}.{signature.name}")
+            # Thunks take void *self, so the vtable holds correctly typed pointers
+            thunk = f"{class_name}_{protocol}_{signature.name}"
+            params = ", ".join(["void *self"] + [self.emit_type(arg.annotation, arg.arg) for arg in signature.args.args[1:]])
+            args = ", ".join([f"({type_name} *)self"] + [arg.arg for arg in signature.args.args[1:]])
+            ret = self.emit_type(signature.returns, "")
+            result = "" if ret == "void" else "return "
+            self.emit(f"{self.indent()}static {ret} {thunk}({params}) {{")
+            self.emit(f"{self.indent()}    {result}{class_name}_{signature.name}({args});")
+            self.emit(f"{self.indent()}}}")
+            thunks.append(thunk)
+        self.emit(f"{self.indent()}static const {protocol}_vtable {class_name}_{protocol}_vtable = {{{', '.join(thunks)}}};")
+        self.emit(f"{self.indent()}static inline {protocol} {class_name}_as_{protocol}({type_name} *self) {{")
+        self.emit(f"{self.indent()}    return ({protocol}){{self, &{class_name}_{protocol}_vtable}};")
+        self.emit(f"{self.indent()}}}")
+
+    # ========================================================================
+    # DERIVED EQUALITY, HASHING AND ORDERING
+    # ========================================================================
+
+    def derive_field(self, struct: str, stmt: ast.AnnAssign) -> DerivedField:
+        """Classify a struct field for @derive."""
+        annotation = self.resolve_type(stmt.annotation)
+        count = None
+        if isinstance(annotation, ast.Subscript) and isinstance(annotation.value, ast.Name) \
+                and annotation.value.id == 'list' and isinstance(annotation.slice, ast.Tuple):
+            annotation, count = annotation.slice.elts[0], self.int_literal(annotation.slice.elts[1])
+        elif isinstance(annotation, ast.Subscript) and isinstance(annotation.slice, ast.Constant):
+            annotation, count = annotation.value, self.int_literal(annotation.slice)
+        name = stmt.target.id
+        if isinstance(annotation, ast.Subscript) and isinstance(annotation.value, ast.Name) \
+                and annotation.value.id == 'unsigned' and isinstance(annotation.slice, ast.Name):
+            annotation = annotation.slice
+        if isinstance(annotation, ast.UnaryOp) and isinstance(annotation.op, ast.USub):
+            return DerivedField(name, 'pointer', count, 8, 8, False)
+        if isinstance(annotation, ast.Name) and annotation.id in SCALAR_SIZES:
+            size = SCALAR_SIZES[annotation.id]
+            if annotation.id in ('float16', 'bfloat16'):
+                raise ValueError(f"@derive: storage type field {struct}.{name}; convert it first")
+            return DerivedField(name, 'scalar', count, size, size, annotation.id in FLOAT_TYPES)
+        if isinstance(annotation, ast.Name) and annotation.id in self.derived:
+            layout = self.derived[annotation.id]
+            return DerivedField(name, annotation.id, count, layout.size, layout.align, layout.has_float)
+        raise ValueError(f"@derive: cannot compare field {struct}.{name}: {ast.unparse(stmt.annotation)}")
+
+    def emit_derived(self, node: ast.ClassDef):
+        """
+        Emit @derive(eq, hash, cmp): static inline T_eq, T_hash and T_cmp
+        taking const T *. A struct whose layout is proven padding-free and
+        has no floating-point fields compares (and hashes) its bytes;
+        otherwise the functions go field by field.
+        """
+        decorator = self.find_decorator(node, 'derive')
+        if decorator is None:
+            return
+        traits = [arg.id for arg in decorator.args if isinstance(arg, ast.Name)] \
+            if isinstance(decorator, ast.Call) else []
+        if not traits or len(traits) != len(decorator.args) or any(t not in DERIVE_TRAITS for t in traits):
+            raise ValueError(f"@derive takes some of {', '.join(DERIVE_TRAITS)}: {node.name}")
+
+        fields = [self.derive_field(node.name, stmt) for stmt in node.body if isinstance(stmt, ast.AnnAssign)]
+        for field in fields:
+            if field.kind not in ('scalar', 'pointer') and not set(traits) <= self.derived[field.kind].traits:
+                raise ValueError(f"@derive: field {node.name}.{field.name} needs {field.kind} to derive {', '.join(traits)}")
+
+        # Layout: scalars align to their size, as on every ABI we target
+        offset, align, padded = 0, 1, False
+        for field in fields:
+            padded |= offset % field.align != 0
+            offset = -(-offset // field.align) * field.align
+            offset += field.size * (field.count or 1)
+            align = max(align, field.align)
+            padded |= self.derived.get(field.kind, DerivedLayout(set(), 0, 1, False, False)).padded
+        padded |= offset % align != 0
+        size = -(-offset // align) * align
+        has_float = any(field.has_float for field in fields)
+        self.derived[node.name] = DerivedLayout(set(traits), size, align, padded, has_float)
+        bytewise = not padded and not has_float and fields
+
+        type_name = self.emit_type(ast.Name(id=node.name), "")
+        self.require_include("stddef.h")
+        self.require_include("stdint.h")
+        self.require_include("string.h")
+        if bytewise:
+            self.emit(f'{self.indent()}_Static_assert(sizeof({type_name}) == {size}, "{node.name} has padding");')
+        for trait in DERIVE_TRAITS:
+            if trait in traits:
+                emitter = {'eq': self.emit_derived_eq, 'hash': self.emit_derived_hash, 'cmp': self.emit_derived_cmp}[trait]
+                emitter(node.name, type_name, fields, size if bytewise else None)
+
+    def emit_field_loop(self, field: DerivedField, body: list[str]) -> list[str]:
+        """Lines for body over a field: a[.f] directly, or in a loop over its elements."""
+        access = f"{field.name}[i]" if field.count else field.name
+        lines = [line.replace("FIELD", access) for line in body]
+        if field.count:
+            return [f"for (size_t i = 0; i < {field.count}; i++) {{", *(f"    {line}" for line in lines), "}"]
+        return lines
+
+    def emit_derived_function(self, signature: str, lines: list[str]):
+        """Emit a derived static inline function with the given body lines."""
+        self.emit(f"{self.indent()}static inline {signature} {{")
+        for line in lines:
+            self.emit(f"{self.indent()}    {line}")
+        self.emit(f"{self.indent()}}}")
+
+    def emit_derived_eq(self, name: str, type_name: str, fields: list[DerivedField], size: int | None):
+        """T_eq(a, b): 1 if every field is equal, else 0."""
+        if size in (1, 2, 4, 8):
+            word = f"uint{size * 8}_t"
+            lines = [f"{word} x, y;", f"memcpy(&x, a, {size});", f"memcpy(&y, b, {size});", "return x == y;"]
+        elif size is not None:
+            lines = [f"return memcmp(a, b, {size}) == 0;"]
+        else:
+            lines = []
+            for field in fields:
+                if field.kind in ('scalar', 'pointer'):
+                    lines += self.emit_field_loop(field, ["if (a->FIELD != b->FIELD) return 0;"])
+                else:
+                    lines += self.emit_field_loop(field, [f"if (!{field.kind}_eq(&a->FIELD, &b->FIELD)) return 0;"])
+            lines.append("return 1;")
+        self.emit_derived_function(f"int {name}_eq(const {type_name} *a, const {type_name} *b)", lines)
+
+    def emit_derived_hash(self, name: str, type_name: str, fields: list[DerivedField], size: int | None):
+        """T_hash(a): 64-bit hash consistent with T_eq."""
+        self.require_runtime('hash_mix')
+        lines = ["uint64_t h = 0;"]
+        if size is not None:
+            lines.append("uint64_t w;")
+            for offset in range(0, size - size % 8, 8):
+                source = f"(const char *)a + {offset}" if offset else "a"
+                lines += [f"memcpy(&w, {source}, 8);", "h = arafura_hash_mix(h, w);"]
+            if size % 8:
+                source = f"(const char *)a + {size - size % 8}" if size >= 8 else "a"
+                lines += ["w = 0;", f"memcpy(&w, {source}, {size % 8});",
+                          "h = arafura_hash_mix(h, w);"]
+        else:
+            for field in fields:
+                if field.kind == 'pointer':
+                    value = "(uint64_t)(uintptr_t)a->FIELD"
+                elif field.kind != 'scalar':
+                    value = f"{field.kind}_hash(&a->FIELD)"
+                elif field.has_float:
+                    value = "arafura_double_bits(a->FIELD)"
+                else:
+                    value = "(uint64_t)a->FIELD"
+                lines += self.emit_field_loop(field, [f"h = arafura_hash_mix(h, {value});"])
+        lines.append("return arafura_hash_finish(h);")
+        self.emit_derived_function(f"uint64_t {name}_hash(const {type_name} *a)", lines)
+
+    def emit_derived_cmp(self, name: str, type_name: str, fields: list[DerivedField], size: int | None):
+        """T_cmp(a, b): -1, 0 or 1, comparing fields in declaration order."""
+        lines = []
+        for field in fields:
+            if field.kind in ('scalar', 'pointer'):
+                lines += self.emit_field_loop(field, ["if (a->FIELD != b->FIELD) return a->FIELD < b->FIELD ? -1 : 1;"])
+            else:
+                lines += self.emit_field_loop(field, [f"if ((c = {field.kind}_cmp(&a->FIELD, &b->FIELD)) != 0) return c;"])
+        if any(field.kind not in ('scalar', 'pointer') for field in fields):
+            lines.insert(0, "int c;")
+        lines.append("return 0;")
+        self.emit_derived_function(f"int {name}_cmp(const {type_name} *a, const {type_name} *b)", lines)
+
+    def receiver_type(self, node: ast.AST) -> ast.AST | None:
+        """Declared type of a method call receiver: x, p._ or a[i]."""
+        if isinstance(node, ast.Subscript):
+            element = self.element_type_name(node.value)
+            return ast.Name(id=element) if element else None
+        return self.static_type(node)
+
+    def emit_method_call(self, node: ast.Call) -> str | None:
+        """
+        recv.m(args) on a protocol value dispatches through P_m(recv, args);
+        on a struct (or pointer to one) with method m it calls T_m directly.
+        None if recv is neither.
+        """
+        receiver, method = node.func.value, node.func.attr
+        declared = self.receiver_type(receiver)
+        pointer = isinstance(declared, ast.UnaryOp) and isinstance(declared.op, ast.USub)
+        if pointer:
+            declared = self.resolve_type(declared.operand)
+        if not isinstance(declared, ast.Name):
+            return None
+        args = [self.emit_operand(arg, PREC_ASSIGN) for arg in node.args]
+        name = declared.id
+        if name in self.protocols and any(m.name == method for m in self.protocols[name]):
+            value = f"*{self.emit_operand(receiver, PREC_UNARY)}" if pointer else self.emit_operand(receiver, PREC_ASSIGN)
+            return f"{name}_{method}({', '.join([value] + args)})"
+        if method in self.methods.get(name, {}):
+            # Concrete type known here: direct call, no vtable
+            target = self.emit_operand(receiver, PREC_ASSIGN) if pointer else f"&{self.emit_operand(receiver, PREC_UNARY)}"
+            return f"{name}_{method}({', '.join([target] + args)})"
+        return None
+
+    def emit_protocol_conversion(self, node: ast.Call) -> str:
+        """P(ptr) for a pointer to a struct that implements P: T_as_P(ptr)."""
+        protocol = node.func.id
+        if len(node.args) == 1:
+            arg = node.args[0]
+            if isinstance(arg, ast.Attribute) and isinstance(arg.value, ast.Name) and arg.value.id == '_':
+                concrete = self.static_type(ast.Name(id=arg.attr))   # _.x is &x
+            else:
+                declared = self.static_type(arg)
+                concrete = None
+                if isinstance(declared, ast.Name) and declared.id == protocol:
+                    return self.emit_expr(arg)
+                if isinstance(declared, ast.UnaryOp) and isinstance(declared.op, ast.USub):
+                    concrete = self.resolve_type(declared.operand)
+            if isinstance(concrete, ast.Name):
+                return f"{concrete.id}_as_{protocol}({self.emit_operand(arg, PREC_ASSIGN)})"
+        raise ValueError(f"{protocol}(...) needs a pointer to a struct that implements {protocol}")
+
     def visit_TypeAlias(self, node):
         """Handle type alias (typedef)."""
         # type int_ptr = -int
         # In Python 3.12+, this is ast.TypeAlias
         name = node.name.id if isinstance(node.name, ast.Name) else node.name
         type_expr = node.value
+        self.type_aliases[name] = type_expr
 
         type_str = self.emit_type(type_expr, name)
         self.emit(f"{self.indent()}typedef {type_str};")
 
 
-def transpile(source_code: str) -> str:
-    """Transpile Python source to C."""
+def transpile(source_code: str, **options) -> str:
+    """
+    Transpile Python source to C.
+
+    Options are forwarded to CTranspiler:
+    - infer_const: emit read-only pointer parameters as const T *
+    - minimal_parens: emit only the parentheses C precedence requires
+    - precise_math: lower fast_exp/fast_log/rsqrt/fast_tanh to libm
+    - prelude, prelude_includes: include the prelude header first and skip
+      the system headers it already includes (see prelude.py)
+    - visibility: 'hidden' gives functions not marked @export hidden visibility
+    """
     tree = ast.parse(source_code)
-    transpiler = CTranspiler()
+    transpiler = CTranspiler(**options)
     transpiler.visit(tree)
     return transpiler.get_output()
 
@@ -0,0 +1,54 @@
+"""Cross-check generated C with the local C compiler."""
+
+import os
+import subprocess
+import tempfile
+from pathlib import Path
+
+from arafura.transpiler import transpile
+
+
+def dump_tree(c_code: str, cc: str = "cc") -> dict[str, str]:
+    """
+    Compile C code and return GCC's parsed tree (-fdump-tree-original) per function.
+    The dump does not record parentheses, so two spellings of the same
+    expression produce the same text.
+    """
+    with tempfile.TemporaryDirectory() as tmp:
+        src = Path(tmp) / "module.c"
+        dump = Path(tmp) / "module.tree"
+        src.write_text(c_code, encoding="utf-8")
+        result = subprocess.run(
+            [cc, "-w", "-c", "-o", os.devnull, f"-fdump-tree-original={dump}", str(src)],
+            capture_output=True,
+            text=True,
+        )
+        if result.returncode != 0:
+            raise ValueError(f"C compiler failed:\n{result.stderr}")
+        text = dump.read_text(encoding="utf-8")
+
+    functions = {}
+    for chunk in text.split(";; Function ")[1:]:
+        name = chunk.split(None, 1)[0]
+        functions[name] = chunk
+    return functions
+
+
+def verify_minimal_parens(source_code: str, cc: str = "cc", **options) -> str:
+    """
+    Transpile with and without minimal_parens, parse both with the C compiler
+    and check every function body has the same tree. Returns the minimal form.
+    Requires GCC (for -fdump-tree-original).
+    """
+    full = transpile(source_code, **{**options, "minimal_parens": False})
+    minimal = transpile(source_code, **{**options, "minimal_parens": True})
+
+    full_tree = dump_tree(full, cc)
+    minimal_tree = dump_tree(minimal, cc)
+    differing = sorted(
+        name for name in full_tree.keys() | minimal_tree.keys()
+        if full_tree.get(name) != minimal_tree.get(name)
+    )
+    if differing:
+        raise ValueError(f"Minimal parenthesization changes meaning of: {', '.join(differing)}")
+    return minimal
@@ -0,0 +1,41 @@
+# Throughput of the crc32c and hash64 builtins, in GB/s.
+# Run with: python scripts/run_benchmark.py benchmarks/checksum.py
+# Add -DARAFURA_NO_CPU_DISPATCH to measure the portable fallbacks.
+
+from stdio import *
+from stdlib import *
+from stdint import *
+from time import *
+
+SIZE: const[size_t] = 1 << 20
+ROUNDS: const[int] = 2000
+
+def seconds() -> double:
+    ts: type[timespec]
+    clock_gettime(CLOCK_MONOTONIC, _.ts)
+    return ts.tv_sec + ts.tv_nsec * 1e-9
+
+def report(name: -const[char], start: double, sink: uint64_t) -> void:
+    elapsed: double = seconds() - start
+    printf("%-8s %6.2f GB/s  (%016llx)\n", name, [double](SIZE) * ROUNDS / elapsed / 1e9, [unsigned[long[long]]](sink))
+
+def main() -> int:
+    buf: -unsigned[char] = malloc(SIZE)
+    for i in size_t(i := 0)(i < SIZE)(i ** _):
+        buf[i] = i * 2654435761 >> 13
+
+    crc: uint32_t = 0
+    start: double = seconds()
+    for r in int(r := 0)(r < ROUNDS)(r ** _):
+        crc = crc32c(buf, SIZE, crc)
+    report("crc32c", start, crc)
+
+    h: uint64_t = 0
+    start = seconds()
+    for r in int(r := 0)(r < ROUNDS)(r ** _):
+        buf[0] = h
+        h ^= hash64(buf, SIZE)
+    report("hash64", start, h)
+
+    free(buf)
+    return 0
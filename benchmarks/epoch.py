@@ -0,0 +1,68 @@
+# arafura.epoch read-side and retire costs, in ns per operation: an
+# epoch_enter/epoch_exit pair against a pthread rwlock read lock/unlock pair,
+# and epoch_retire of malloc'd nodes including their batched reclamation.
+# Run with: python scripts/run_benchmark.py benchmarks/epoch.py
+
+from stdio import *
+from stdlib import *
+from stdint import *
+from time import *
+from pthread import *
+from arafura.epoch import *
+
+OPS: const[size_t] = 10000000
+NODES: const[size_t] = 1000000
+
+@typedef(Node)
+class Node:
+    value: uint64_t
+    next: -type[Node]
+
+domain: epoch_domain
+
+def seconds() -> double:
+    ts: type[timespec]
+    clock_gettime(CLOCK_MONOTONIC, _.ts)
+    return ts.tv_sec + ts.tv_nsec * 1e-9
+
+def report(name: -const[char], count: size_t, start: double) -> void:
+    elapsed: double = seconds() - start
+    printf("%-14s %10zu ops %7.1f ns/op\n", name, count, elapsed / count * 1e9)
+
+def main() -> int:
+    epoch_init(_.domain)
+    t: -epoch_thread = epoch_register(_.domain)
+    shared: -volatile[Node] = calloc(1, sizeof(Node))
+    sink: uint64_t = 0
+
+    start: double = seconds()
+    for i in size_t(i := 0)(i < OPS)(i ** _):
+        epoch_enter(t)
+        sink += shared._.value
+        epoch_exit(t)
+    report("enter/exit", OPS, start)
+
+    lock: pthread_rwlock_t
+    pthread_rwlock_init(_.lock, NULL)
+    start = seconds()
+    for i in size_t(i := 0)(i < OPS)(i ** _):
+        pthread_rwlock_rdlock(_.lock)
+        sink += shared._.value
+        pthread_rwlock_unlock(_.lock)
+    report("rwlock read", OPS, start)
+    pthread_rwlock_destroy(_.lock)
+
+    nodes: --Node = malloc(NODES * sizeof(nodes._))
+    for i in size_t(i := 0)(i < NODES)(i ** _):
+        nodes[i] = malloc(sizeof(Node))
+    start = seconds()
+    for i in size_t(i := 0)(i < NODES)(i ** _):
+        epoch_retire(t, nodes[i], free)
+    report("retire+free", NODES, start)
+
+    printf("epoch %llu, sink %llu\n", [unsigned[long[long]]](domain.epoch), [unsigned[long[long]]](sink))
+    epoch_unregister(t)
+    epoch_destroy(_.domain)
+    free(nodes)
+    free([-void](shared))
+    return 0
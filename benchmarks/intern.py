@@ -0,0 +1,84 @@
+# arafura.intern from 1K to 1M distinct keys: cost of interning new strings,
+# re-interning known ones, and lock-free lookups from 1 and 4 threads, in ns
+# per string.
+# Run with: python scripts/run_benchmark.py benchmarks/intern.py
+
+from stdio import *
+from stdlib import *
+from string import *
+from stdint import *
+from time import *
+from pthread import *
+from arafura.intern import *
+
+QUERIES: const[size_t] = 1 << 20
+THREADS: macro = 4
+
+table: intern_table
+keys: -char                 # Strings of up to 15 bytes, 16 bytes apart
+lens: -uint8_t
+count: size_t
+
+def seconds() -> double:
+    ts: type[timespec]
+    clock_gettime(CLOCK_MONOTONIC, _.ts)
+    return ts.tv_sec + ts.tv_nsec * 1e-9
+
+def xorshift(s: -uint64_t) -> uint64_t:
+    s._ ^= s._ << 13
+    s._ ^= s._ >> 7
+    s._ ^= s._ << 17
+    return s._
+
+def report(name: -const[char], n: size_t, ops: size_t, start: double) -> void:
+    elapsed: double = seconds() - start
+    printf("%-12s %8zu keys %7.1f ns/string\n", name, n, elapsed / ops * 1e9)
+
+def finder(arg: -void) -> -void:
+    s: uint64_t = 88172645463325252 + [uintptr_t](arg)
+    sink: uint64_t = 0
+    for i in size_t(i := 0)(i < QUERIES)(i ** _):
+        k: size_t = xorshift(_.s) % count
+        sink += intern_find(_.table, keys + k * 16, lens[k])
+    return [-void]([uintptr_t](sink))
+
+def run(n: size_t) -> void:
+    count = n
+    keys = calloc(n, 16)
+    lens = malloc(n)
+    for i in size_t(i := 0)(i < n)(i ** _):
+        lens[i] = snprintf(keys + i * 16, 16, "user:%zu", i * 2654435761 % 1000000007)
+    intern_init(_.table)
+
+    start: double = seconds()
+    for i in size_t(i := 0)(i < n)(i ** _):
+        intern(_.table, keys + i * 16, lens[i])
+    report("intern new", n, n, start)
+
+    s: uint64_t = 88172645463325252
+    start = seconds()
+    for i in size_t(i := 0)(i < QUERIES)(i ** _):
+        k: size_t = xorshift(_.s) % n
+        intern(_.table, keys + k * 16, lens[k])
+    report("intern known", n, QUERIES, start)
+
+    start = seconds()
+    finder(NULL)
+    report("find x1", n, QUERIES, start)
+
+    threads: pthread_t[THREADS]
+    start = seconds()
+    for i in size_t(i := 0)(i < THREADS)(i ** _):
+        pthread_create(threads + i, NULL, finder, [-void](i))
+    for i in size_t(i := 0)(i < THREADS)(i ** _):
+        pthread_join(threads[i], NULL)
+    report("find x4", n, QUERIES * THREADS, start)
+
+    intern_destroy(_.table)
+    free(lens)
+    free(keys)
+
+def main() -> int:
+    for n in size_t(n := 1000)(n <= 1000000)(n := n * 10):
+        run(n)
+    return 0
@@ -0,0 +1,97 @@
+# Lookup latency in a static sorted int64_t table, in ns per lookup: libc
+# bsearch and a textbook lower bound on the sorted array, against the
+# arafura.search Eytzinger and B-tree layouts.
+# Run with: python scripts/run_benchmark.py benchmarks/search.py
+# Sizes go from 1K up to SEARCH_MAX_N keys (default 10M; 100M needs ~3 GB).
+
+from stdio import *
+from stdlib import *
+from stdint import *
+from time import *
+from arafura.search import *
+
+QUERIES: const[size_t] = 1 << 22
+
+def seconds() -> double:
+    ts: type[timespec]
+    clock_gettime(CLOCK_MONOTONIC, _.ts)
+    return ts.tv_sec + ts.tv_nsec * 1e-9
+
+def xorshift(s: -uint64_t) -> uint64_t:
+    s._ ^= s._ << 13
+    s._ ^= s._ >> 7
+    s._ ^= s._ << 17
+    return s._
+
+def compare_keys(a: -const[void], b: -const[void]) -> int:
+    x: int64_t = [-const[int64_t]](a)._
+    y: int64_t = [-const[int64_t]](b)._
+    return (x > y) - (x < y)
+
+def lower_bound(sorted: -const[int64_t], n: size_t, key: int64_t) -> size_t:
+    lo: size_t = 0
+    hi: size_t = n
+    while lo < hi:
+        mid: size_t = lo + (hi - lo) / 2
+        if sorted[mid] < key:
+            lo = mid + 1
+        else:
+            hi = mid
+    return lo
+
+def report(name: -const[char], n: size_t, start: double, sink: uint64_t) -> void:
+    elapsed: double = seconds() - start
+    printf("%-10s %10zu %8.1f ns  (%llx)\n", name, n, elapsed / QUERIES * 1e9, [unsigned[long[long]]](sink))
+
+def run(n: size_t) -> void:
+    # Keys are the even numbers; queries hit keys (for bsearch) in random order
+    sorted: -int64_t = malloc(n * sizeof(int64_t))
+    for i in size_t(i := 0)(i < n)(i ** _):
+        sorted[i] = 2 * [int64_t](i)
+    e: -int64_t = aligned_alloc(64, (eytzinger_size(n) * 8 + 63) / 64 * 64)
+    b: -int64_t = aligned_alloc(64, (btree_size(n) * 8 + 63) / 64 * 64)
+    eytzinger_build(sorted, n, e, NULL)
+    btree_build(sorted, n, b, NULL)
+    queries: -int64_t = malloc(QUERIES * sizeof(int64_t))
+    s: uint64_t = 88172645463325252
+    for i in size_t(i := 0)(i < QUERIES)(i ** _):
+        queries[i] = 2 * [int64_t](xorshift(_.s) % n)
+
+    sink: uint64_t = 0
+    start: double = seconds()
+    for i in size_t(i := 0)(i < QUERIES)(i ** _):
+        found: -int64_t = bsearch(queries + i, sorted, n, sizeof(int64_t), compare_keys)
+        sink += found - sorted
+    report("bsearch", n, start, sink)
+
+    sink = 0
+    start = seconds()
+    for i in size_t(i := 0)(i < QUERIES)(i ** _):
+        sink += lower_bound(sorted, n, queries[i])
+    report("binary", n, start, sink)
+
+    sink = 0
+    start = seconds()
+    for i in size_t(i := 0)(i < QUERIES)(i ** _):
+        sink += e[eytzinger_lower_bound(e, n, queries[i])]
+    report("eytzinger", n, start, sink)
+
+    sink = 0
+    start = seconds()
+    for i in size_t(i := 0)(i < QUERIES)(i ** _):
+        sink += b[btree_lower_bound(b, n, queries[i])]
+    report("btree", n, start, sink)
+
+    free(queries)
+    free(b)
+    free(e)
+    free(sorted)
+
+def main() -> int:
+    limit: size_t = 10000000
+    env: -char = getenv("SEARCH_MAX_N")
+    if env:
+        limit = strtoull(env, NULL, 10)
+    for n in size_t(n := 1000)(n <= limit)(n := n * 10):
+        run(n)
+    return 0
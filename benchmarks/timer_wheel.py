@@ -0,0 +1,74 @@
+# arafura.timer_wheel with 1M active timers: cost of arming, re-arming
+# (a keepalive reset), cancelling and expiring, in ns per timer.
+# Run with: python scripts/run_benchmark.py benchmarks/timer_wheel.py
+
+from stdio import *
+from stdlib import *
+from stdint import *
+from time import *
+from arafura.timer_wheel import *
+
+TIMERS: const[size_t] = 1000000
+SPAN: const[uint64_t] = 60000    # Deadlines within a minute of 1 ms ticks
+
+@typedef(connection)
+class connection:
+    fd: int
+    bytes: uint64_t
+    timeout: timer
+
+def seconds() -> double:
+    ts: type[timespec]
+    clock_gettime(CLOCK_MONOTONIC, _.ts)
+    return ts.tv_sec + ts.tv_nsec * 1e-9
+
+def xorshift(s: -uint64_t) -> uint64_t:
+    s._ ^= s._ << 13
+    s._ ^= s._ >> 7
+    s._ ^= s._ << 17
+    return s._
+
+def report(name: -const[char], count: size_t, start: double) -> void:
+    elapsed: double = seconds() - start
+    printf("%-8s %10zu timers %7.1f ns/timer\n", name, count, elapsed / count * 1e9)
+
+def main() -> int:
+    conns: -connection = calloc(TIMERS, sizeof(connection))
+    w: timer_wheel
+    timer_wheel_init(_.w, 0)
+    s: uint64_t = 88172645463325252
+    for i in size_t(i := 0)(i < TIMERS)(i ** _):
+        conns[i].fd = i
+        timer_init(_.conns[i].timeout)
+
+    start: double = seconds()
+    for i in size_t(i := 0)(i < TIMERS)(i ** _):
+        timer_add(_.w, _.conns[i].timeout, 1 + xorshift(_.s) % SPAN)
+    report("add", TIMERS, start)
+
+    start = seconds()
+    for i in size_t(i := 0)(i < TIMERS)(i ** _):
+        c: -connection = conns + xorshift(_.s) % TIMERS
+        timer_add(_.w, _.c._.timeout, w.now + 1 + xorshift(_.s) % SPAN)
+    report("re-arm", TIMERS, start)
+
+    start = seconds()
+    for i in size_t(i := 0)(i < TIMERS)(i := i + 2):
+        timer_cancel(_.w, _.conns[i].timeout)
+    report("cancel", TIMERS / 2, start)
+
+    # One tick at a time, as an event loop would
+    expired: size_t = 0
+    checksum: uint64_t = 0
+    start = seconds()
+    for tick in uint64_t(tick := 1)(tick <= SPAN + 1)(tick ** _):
+        t: -timer = timer_wheel_expire(_.w, tick)
+        while t:
+            c: -connection = timer_entry(t, connection, timeout)
+            checksum += c._.fd
+            expired += 1
+            t = t._.next
+    report("expire", expired, start)
+    printf("%zu left, checksum %llx\n", w.count, [unsigned[long[long]]](checksum))
+    free(conns)
+    return 0
@@ -0,0 +1,38 @@
+#!/usr/bin/env python3
+"""
+Transpile, compile and run a benchmark program.
+
+Usage:
+    python scripts/run_benchmark.py benchmarks/checksum.py [CFLAGS...]
+
+The program is built with `cc -O2` plus any extra flags given, for example
+-march=native or -DARAFURA_NO_CPU_DISPATCH.
+"""
+
+import subprocess
+import sys
+import tempfile
+from pathlib import Path
+
+sys.path.insert(0, str(Path(__file__).parent.parent))
+
+from arafura import transpile
+
+
+def main() -> int:
+    """Build and run one benchmark."""
+    if len(sys.argv) < 2:
+        print(__doc__, file=sys.stderr)
+        return 1
+
+    source = Path(sys.argv[1])
+    with tempfile.TemporaryDirectory() as tmp:
+        c_file = Path(tmp) / (source.stem + ".c")
+        exe = Path(tmp) / source.stem
+        c_file.write_text(transpile(source.read_text(encoding="utf-8")), encoding="utf-8")
+        subprocess.run(["cc", "-O2", *sys.argv[2:], "-o", str(exe), str(c_file), "-lm", "-lpthread"], check=True)
+        return subprocess.run([str(exe)]).returncode
+
+
+if __name__ == "__main__":
+    sys.exit(main())
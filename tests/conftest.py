@@ -1,5 +1,8 @@
 """Pytest configuration and shared fixtures."""
 
+import platform
+import shutil
+import subprocess
 from pathlib import Path
 
 import pytest
@@ -15,3 +18,51 @@ def fixtures_dir() -> Path:
 def golden_outputs_dir() -> Path:
     """Return the golden outputs directory path."""
     return Path(__file__).parent / "golden_outputs"
+
+
+@pytest.fixture
+def gcc() -> str:
+    """Return the GCC executable, skipping the test if it is not installed."""
+    path = shutil.which("gcc")
+    if path is None:
+        pytest.skip("gcc not available")
+    return path
+
+
+@pytest.fixture
+def run_c(gcc: str, tmp_path: Path):
+    """Return a helper that compiles C code with GCC, runs it, and returns stdout."""
+
+    def run(c_code: str, *args: str, flags: tuple[str, ...] = ("-O2",)) -> str:
+        src = tmp_path / "main.c"
+        exe = tmp_path / "main"
+        src.write_text(c_code, encoding="utf-8")
+        subprocess.run(
+            [gcc, *flags, "-o", str(exe), str(src), "-lm"],
+            check=True, capture_output=True, text=True,
+        )
+        result = subprocess.run([str(exe), *args], check=True, capture_output=True, text=True)
+        return result.stdout
+
+    return run
+
+
+@pytest.fixture
+def require_cpu(gcc: str, tmp_path: Path):
+    """Return a helper that skips the test unless this CPU runs code built with the given -m flags."""
+
+    def require(flags: tuple[str, ...]) -> None:
+        features = [flag.removeprefix("-m") for flag in flags if flag.startswith("-m")]
+        if not features:
+            return
+        if platform.machine() not in ("x86_64", "AMD64"):
+            pytest.skip("x86 only")
+        checks = " && ".join(f'__builtin_cpu_supports("{feature}")' for feature in features)
+        src = tmp_path / "cpu_probe.c"
+        exe = tmp_path / "cpu_probe"
+        src.write_text(f"int main(void) {{ __builtin_cpu_init(); return !({checks}); }}\n", encoding="utf-8")
+        subprocess.run([gcc, "-o", str(exe), str(src)], check=True, capture_output=True, text=True)
+        if subprocess.run([str(exe)]).returncode != 0:
+            pytest.skip(f"CPU lacks {', '.join(features)}")
+
+    return require
@@ -0,0 +1,565 @@
+"""Tests for the standard modules in arafura/lib."""
+
+import bisect
+
+import pytest
+
+from arafura import lib, transpile
+
+MASK64 = (1 << 64) - 1
+
+
+class TestLibraryImport:
+    """Test including standard modules."""
+
+    def test_module_included_once(self) -> None:
+        """Repeated imports include the module a single time."""
+        output = transpile("from arafura.random import *\nfrom arafura.random import *\n")
+        assert output.count("typedef struct xoshiro256 {") == 1
+        assert "static inline uint64_t xoshiro256_next(xoshiro256 *rng) {" in output
+
+    def test_unknown_module(self) -> None:
+        """Unknown modules are reported with the available names."""
+        with pytest.raises(ValueError, match="Unknown standard module: arafura.nope"):
+            transpile("from arafura.nope import *\n")
+        assert "random" in lib.names()
+
+
+class TestRandom:
+    """Test arafura.random against reference implementations."""
+
+    @staticmethod
+    def xoshiro_reference(seed: int, count: int, jumps: int = 0) -> list[int]:
+        def splitmix(x: int) -> tuple[int, int]:
+            x = (x + 0x9E3779B97F4A7C15) & MASK64
+            z = ((x ^ (x >> 30)) * 0xBF58476D1CE4E5B9) & MASK64
+            z = ((z ^ (z >> 27)) * 0x94D049BB133111EB) & MASK64
+            return x, z ^ (z >> 31)
+
+        def rotl(x: int, k: int) -> int:
+            return ((x << k) | (x >> (64 - k))) & MASK64
+
+        def step(s: list[int]) -> int:
+            result = (rotl((s[1] * 5) & MASK64, 7) * 9) & MASK64
+            t = (s[1] << 17) & MASK64
+            s[2] ^= s[0]
+            s[3] ^= s[1]
+            s[1] ^= s[2]
+            s[0] ^= s[3]
+            s[2] ^= t
+            s[3] = rotl(s[3], 45)
+            return result
+
+        s = []
+        for _ in range(4):
+            seed, word = splitmix(seed)
+            s.append(word)
+        for _ in range(jumps):
+            t = [0, 0, 0, 0]
+            for jump in (0x180EC6D33CFD0ABA, 0xD5A61266F0C9392C, 0xA9582618E03FC9AA, 0x39ABDC4529B1661C):
+                for b in range(64):
+                    if jump >> b & 1:
+                        t = [a ^ b for a, b in zip(t, s)]
+                    step(s)
+            s = t
+        return [step(s) for _ in range(count)]
+
+    def test_xoshiro256_and_jump(self, run_c) -> None:
+        """Outputs match the reference, before and after a jump."""
+        source = """
+from stdio import *
+from arafura.random import *
+
+def main() -> int:
+    rng: xoshiro256
+    xoshiro256_seed(_.rng, 12345)
+    for i in int(i := 0)(i < 4)(i ** _):
+        printf("%llu\\n", [unsigned[long[long]]](xoshiro256_next(_.rng)))
+    xoshiro256_seed(_.rng, 12345)
+    xoshiro256_jump(_.rng)
+    for i in int(i := 0)(i < 4)(i ** _):
+        printf("%llu\\n", [unsigned[long[long]]](xoshiro256_next(_.rng)))
+    return 0
+"""
+        expected = self.xoshiro_reference(12345, 4) + self.xoshiro_reference(12345, 4, jumps=1)
+        assert [int(x) for x in run_c(transpile(source)).split()] == expected
+
+    @pytest.mark.parametrize("flags", [("-O2",), ("-O3", "-march=native")])
+    def test_four_lanes_are_jumped_streams(self, run_c, flags) -> None:
+        """Lane k of the bulk generator is the seed's stream after k jumps."""
+        source = """
+from stdio import *
+from arafura.random import *
+
+def main() -> int:
+    rng: xoshiro256x4
+    xoshiro256x4_seed(_.rng, 7)
+    out: uint64_t[10]
+    fill_u64(_.rng, out, 10)
+    for i in int(i := 0)(i < 10)(i ** _):
+        printf("%llu\\n", [unsigned[long[long]]](out[i]))
+    return 0
+"""
+        values = [int(x) for x in run_c(transpile(source), flags=flags).split()]
+        lanes = [self.xoshiro_reference(7, 3, jumps=k) for k in range(4)]
+        assert values == [lanes[i % 4][i // 4] for i in range(10)]
+
+    def test_fill_uniform_range_and_mean(self, run_c) -> None:
+        """Doubles lie in [0, 1) with mean near one half, including a partial tail."""
+        source = """
+from stdio import *
+from stdlib import *
+from arafura.random import *
+
+def main() -> int:
+    n: size_t = 1000003
+    buf: -double = malloc(n * sizeof(double))
+    rng: xoshiro256x4
+    xoshiro256x4_seed(_.rng, 99)
+    fill_uniform(_.rng, buf, n)
+    total: double = 0
+    lo: double = 1
+    hi: double = 0
+    for i in size_t(i := 0)(i < n)(i ** _):
+        total += buf[i]
+        lo = buf[i] if buf[i] < lo else lo
+        hi = buf[i] if buf[i] > hi else hi
+    printf("%.17g %.17g %.17g", total / n, lo, hi)
+    free(buf)
+    return 0
+"""
+        mean, lo, hi = map(float, run_c(transpile(source)).split())
+        assert abs(mean - 0.5) < 0.002
+        assert 0 <= lo < 0.001 and 0.999 < hi < 1
+
+    def test_pcg32_known_answers_and_advance(self, run_c) -> None:
+        """pcg32 matches the reference demo output; advance(n) skips n outputs."""
+        source = """
+from stdio import *
+from arafura.random import *
+
+def main() -> int:
+    rng: pcg32
+    pcg32_seed(_.rng, 42, 54)
+    for i in int(i := 0)(i < 6)(i ** _):
+        printf("%08x ", pcg32_next(_.rng))
+    other: pcg32
+    pcg32_seed(_.other, 42, 54)
+    pcg32_advance(_.other, 1000000)
+    for i in int(i := 0)(i < 999994)(i ** _):
+        pcg32_next(_.rng)
+    printf("%d ", pcg32_next(_.rng) == pcg32_next(_.other))
+    worst: uint32_t = 0
+    for i in int(i := 0)(i < 100000)(i ** _):
+        r: uint32_t = pcg32_bounded(_.rng, 7)
+        worst = r if r > worst else worst
+    printf("%u", worst)
+    return 0
+"""
+        output = run_c(transpile(source)).split()
+        assert output == ["a15c02b7", "7b47f409", "ba1d3330", "83d2f293", "bfa4784b", "cbed606e", "1", "6"]
+
+
+class TestSearch:
+    """Test arafura.search layouts against bisect."""
+
+    SOURCE = """
+from stdio import *
+from stdlib import *
+from arafura.search import *
+
+def check(n: size_t, spread: int64_t) -> void:
+    # Sorted keys with duplicates; every query from below the first to past the last
+    sorted: -int64_t = malloc((n + 1) * sizeof(int64_t))
+    for i in size_t(i := 0)(i < n)(i ** _):
+        sorted[i] = [int64_t](i) * spread / 3 - 5
+    e: -int64_t = aligned_alloc(64, (eytzinger_size(n) * 8 + 63) / 64 * 64)
+    er: -size_t = malloc(eytzinger_size(n) * sizeof(size_t))
+    b: -int64_t = aligned_alloc(64, (btree_size(n) * 8 + 63) / 64 * 64)
+    br: -size_t = malloc(btree_size(n) * sizeof(size_t))
+    eytzinger_build(sorted, n, e, er)
+    btree_build(sorted, n, b, br)
+    for q in int64_t(q := -7)(q < [int64_t](n) * spread / 3 + 2)(q ** _):
+        es: size_t = eytzinger_lower_bound(e, n, q)
+        bs: size_t = btree_lower_bound(b, n, q)
+        printf("%zu %zu %d %d\\n", er[es], br[bs], e[es] == (sorted[er[es]] if er[es] < n else SEARCH_NONE),
+               b[bs] == (sorted[br[bs]] if br[bs] < n else SEARCH_NONE))
+    free(sorted)
+    free(e)
+    free(er)
+    free(b)
+    free(br)
+
+def main() -> int:
+    sizes: size_t[9] = [0, 1, 2, 7, 8, 9, 80, 81, 1000]
+    for i in int(i := 0)(i < 9)(i ** _):
+        check(sizes[i], 1 + i % 3 * 2)
+    return 0
+"""
+
+    def test_lower_bound_matches_bisect(self, run_c) -> None:
+        """Both layouts give bisect_left's rank and the key at it, for sizes around node boundaries."""
+        lines = iter(run_c(transpile(self.SOURCE)).splitlines())
+        for i, n in enumerate([0, 1, 2, 7, 8, 9, 80, 81, 1000]):
+            spread = 1 + i % 3 * 2
+            keys = [k * spread // 3 - 5 for k in range(n)]
+            for q in range(-7, n * spread // 3 + 2):
+                rank = bisect.bisect_left(keys, q)
+                assert next(lines) == f"{rank} {rank} 1 1", (n, q)
+        assert next(lines, None) is None
+
+
+class TestTimerWheel:
+    """Test arafura.timer_wheel against a per-timer model of deadlines."""
+
+    SOURCE = """
+from stdio import *
+from stdlib import *
+from arafura.timer_wheel import *
+
+N: macro = 3000
+
+@typedef(conn)
+class conn:
+    id: int
+    deadline: uint64_t    # Effective deadline if armed, else 0
+    fired: int
+    t: timer
+
+def xorshift(s: -uint64_t) -> uint64_t:
+    s._ ^= s._ << 13
+    s._ ^= s._ >> 7
+    s._ ^= s._ << 17
+    return s._
+
+def main() -> int:
+    conns: -conn = calloc(N, sizeof(conn))
+    w: timer_wheel
+    timer_wheel_init(_.w, 1000)
+    s: uint64_t = 88172645463325252
+    errors: int = 0
+    fired: int = 0
+    for i in int(i := 0)(i < N)(i ** _):
+        conns[i].id = i
+        timer_init(_.conns[i].t)
+    for step in int(step := 0)(step < 4000)(step ** _):
+        # Arm, re-arm or cancel a few timers, with deadlines at every level
+        for k in int(k := 0)(k < 3)(k ** _):
+            c: -conn = conns + xorshift(_.s) % N
+            r: uint64_t = xorshift(_.s)
+            if r % 5 == 0:
+                timer_cancel(_.w, _.c._.t)
+                c._.deadline = 0
+            else:
+                delay: uint64_t = r >> 8 & (1 << (r % 24)) - 1
+                if r % 97 == 0:
+                    delay = [uint64_t](1) << 37    # Beyond the last level
+                timer_add(_.w, _.c._.t, w.now + delay)
+                c._.deadline = w.now + (delay if delay else 1)
+        earliest: uint64_t = UINT64_MAX
+        for i in int(i := 0)(i < N)(i ** _):
+            if conns[i].deadline and conns[i].deadline < earliest:
+                earliest = conns[i].deadline
+        next: uint64_t = timer_wheel_next_expiry(_.w)
+        errors += not (next == earliest if earliest == UINT64_MAX else w.now < next and next <= earliest)
+        before: uint64_t = w.now
+        t: -timer = timer_wheel_expire(_.w, w.now + xorshift(_.s) % 300)
+        while t:
+            c: -conn = timer_entry(t, conn, t)
+            errors += timer_pending(t) or not (before < c._.deadline and c._.deadline <= w.now)
+            c._.deadline = 0
+            c._.fired += 1
+            fired += 1
+            t = t._.next
+    # Everything still armed fires by the end of time
+    last: -timer = timer_wheel_expire(_.w, w.now + ([uint64_t](1) << 38))
+    while last:
+        c: -conn = timer_entry(last, conn, t)
+        errors += c._.deadline == 0
+        c._.deadline = 0
+        fired += 1
+        last = last._.next
+    for i in int(i := 0)(i < N)(i ** _):
+        errors += conns[i].deadline != 0
+    printf("%d %d %zu", errors, fired > 5000, w.count)
+    free(conns)
+    return 0
+"""
+
+    def test_expiry_matches_model(self, run_c) -> None:
+        """Timers fire at the first advance past their deadline, never after cancel, at every level."""
+        assert run_c(transpile(self.SOURCE)) == "0 1 0"
+
+    def test_exact_tick(self, run_c) -> None:
+        """Stepping one tick at a time, each timer fires exactly at its deadline, also after cascades."""
+        source = """
+from stdio import *
+from arafura.timer_wheel import *
+
+def main() -> int:
+    deadlines: uint64_t[6] = [4160, 4096, 128, 71, 262208, 266303]
+    timers: timer[6]
+    w: timer_wheel
+    timer_wheel_init(_.w, 0)
+    timer_wheel_expire(_.w, 70)
+    for i in int(i := 0)(i < 6)(i ** _):
+        timer_init(timers + i)
+        timer_add(_.w, timers + i, deadlines[i])
+    errors: int = 0
+    while w.count:
+        t: -timer = timer_wheel_expire(_.w, w.now + 1)
+        while t:
+            errors += t._.expires != w.now
+            t = t._.next
+    printf("%d %llu", errors, [unsigned[long[long]]](w.now))
+    return 0
+"""
+        assert run_c(transpile(source)) == "0 266303"
+
+
+class TestIntern:
+    """Test arafura.intern, alone and with concurrent readers and writers."""
+
+    SOURCE = """
+from stdio import *
+from stdlib import *
+from string import *
+from arafura.intern import *
+
+def main() -> int:
+    t: intern_table
+    intern_init(_.t)
+    errors: int = 0
+    key: char[32]
+    first: -const[char] = intern_str(_.t, intern_cstr(_.t, "first"))
+    # IDs are dense and handed out in order of first appearance
+    for i in int(i := 0)(i < 30000)(i ** _):
+        n: int = snprintf(key, sizeof(key), "key%d", i % 9000)
+        id: uint32_t = intern(_.t, key, n)
+        errors += id != (i % 9000) + 1
+        errors += strcmp(intern_str(_.t, id), key) != 0 or intern_len(_.t, id) != n
+    errors += intern_count(_.t) != 9001
+    # Growth moved neither IDs nor strings
+    errors += intern_cstr(_.t, "first") != 0 or intern_str(_.t, 0) != first
+    errors += intern_find(_.t, "key9000", 7) != INTERN_NONE
+    errors += intern_find(_.t, "key8999", 7) != 9000
+    # Lengths, not NULs, delimit strings
+    a: uint32_t = intern(_.t, "a\\0b", 3)
+    errors += a == intern(_.t, "a", 1) or a != intern(_.t, "a\\0b", 3)
+    errors += intern(_.t, "", 0) != intern_cstr(_.t, "")
+    # A string larger than an arena block
+    big: -char = malloc(100000)
+    memset(big, 'x', 100000)
+    b: uint32_t = intern(_.t, big, 100000)
+    errors += intern_len(_.t, b) != 100000 or memcmp(intern_str(_.t, b), big, 100000) != 0
+    errors += intern(_.t, big, 100000) != b or intern_str(_.t, b)[100000] != 0
+    printf("%d %u", errors, intern_count(_.t))
+    free(big)
+    intern_destroy(_.t)
+    return 0
+"""
+
+    THREADS = """
+from stdio import *
+from stdlib import *
+from string import *
+from pthread import *
+from arafura.intern import *
+
+KEYS: macro = 50000
+WRITERS: macro = 4
+READERS: macro = 4
+
+table: intern_table
+ids: uint32_t[WRITERS][KEYS]
+reader_errors: int[READERS]
+found: size_t[READERS]
+done: int
+
+def writer(arg: -void) -> -void:
+    w: size_t = [size_t](arg)
+    key: char[32]
+    # Every writer interns every key, each in its own order
+    for i in size_t(i := 0)(i < KEYS)(i ** _):
+        k: size_t = (i * 7919 + w * 12345) % KEYS
+        n: int = snprintf(key, sizeof(key), "k%zu", k)
+        ids[w][k] = intern(_.table, key, n)
+    return NULL
+
+def reader(arg: -void) -> -void:
+    r: size_t = [size_t](arg)
+    key: char[32]
+    s: uint64_t = 88172645463325252 + r
+    while not ____atomic_load_n(_.done, ____ATOMIC_ACQUIRE):
+        s ^= s << 13
+        s ^= s >> 7
+        s ^= s << 17
+        n: int = snprintf(key, sizeof(key), "k%zu", [size_t](s % KEYS))
+        id: uint32_t = intern_find(_.table, key, n)
+        if id != INTERN_NONE:
+            found[r] += 1
+            reader_errors[r] += id >= intern_count(_.table) or strcmp(intern_str(_.table, id), key) != 0
+    return NULL
+
+def main() -> int:
+    intern_init(_.table)
+    writers: pthread_t[WRITERS]
+    readers: pthread_t[READERS]
+    for r in size_t(r := 0)(r < READERS)(r ** _):
+        pthread_create(readers + r, NULL, reader, [-void](r))
+    for w in size_t(w := 0)(w < WRITERS)(w ** _):
+        pthread_create(writers + w, NULL, writer, [-void](w))
+    for w in size_t(w := 0)(w < WRITERS)(w ** _):
+        pthread_join(writers[w], NULL)
+    ____atomic_store_n(_.done, 1, ____ATOMIC_RELEASE)
+    errors: int = 0
+    total: size_t = 0
+    for r in size_t(r := 0)(r < READERS)(r ** _):
+        pthread_join(readers[r], NULL)
+        errors += reader_errors[r]
+        total += found[r]
+    # All writers agree on every ID, and each key was stored once
+    for k in size_t(k := 0)(k < KEYS)(k ** _):
+        for w in size_t(w := 1)(w < WRITERS)(w ** _):
+            errors += ids[w][k] != ids[0][k]
+    printf("%d %u %d", errors, intern_count(_.table), total > 0)
+    intern_destroy(_.table)
+    return 0
+"""
+
+    def test_ids_are_dense_and_stable(self, run_c) -> None:
+        """Equal strings get equal IDs in order of first appearance; growth moves nothing."""
+        assert run_c(transpile(self.SOURCE)) == "0 9005"
+
+    def test_concurrent_readers_and_writers(self, run_c) -> None:
+        """Lock-free lookups only see complete entries while writers race to intern."""
+        assert run_c(transpile(self.THREADS), flags=("-O2", "-pthread")) == "0 50000 1"
+
+
+class TestEpoch:
+    """Stress arafura.epoch with readers walking a lock-free stack that writers pop from and refill."""
+
+    SOURCE = """
+from stdio import *
+from stdlib import *
+from pthread import *
+from sched import *
+from arafura.epoch import *
+
+LIVE: macro = 0x1ead
+DEAD: macro = 0xdead
+WRITERS: macro = 2
+READERS: macro = 2
+ROUNDS: macro = 2000
+BURST: macro = 100
+
+@typedef(Node)
+class Node:
+    magic: uint64_t
+    value: uint64_t
+    next: -type[Node]
+    grave: -type[Node]  # Reclaimed nodes are kept until the end, so reuse cannot hide a stale read
+
+domain: epoch_domain
+head: -Node
+graveyard: -Node
+popped_total: uint64_t
+reclaimed: uint64_t
+errors: int
+writers_done: int
+
+def node_new(value: uint64_t) -> -Node:
+    n: -Node = malloc(sizeof(Node))
+    n._.magic = LIVE
+    n._.value = value
+    return n
+
+def node_reclaim(p: -void) -> void:
+    n: -Node = p
+    n._.magic = DEAD
+    n._.grave = ____atomic_load_n(_.graveyard, ____ATOMIC_RELAXED)
+    while not ____atomic_compare_exchange_n(_.graveyard, _.n._.grave, n, 1, ____ATOMIC_RELAXED, ____ATOMIC_RELAXED):
+        pass
+    ____atomic_fetch_add(_.reclaimed, 1, ____ATOMIC_RELAXED)
+
+def push(n: -Node) -> void:
+    n._.next = ____atomic_load_n(_.head, ____ATOMIC_RELAXED)
+    while not ____atomic_compare_exchange_n(_.head, _.n._.next, n, 1, ____ATOMIC_RELEASE, ____ATOMIC_RELAXED):
+        pass
+
+def writer(arg: -void) -> -void:
+    # Pops a burst deeper than where readers pause, then pushes it back new
+    t: -epoch_thread = epoch_register(_.domain)
+    popped: list[-Node, BURST]
+    for i in int(i := 0)(i < ROUNDS)(i ** _):
+        count: int = 0
+        epoch_enter(t)
+        for k in int(k := 0)(k < BURST)(k ** _):
+            top: -Node = ____atomic_load_n(_.head, ____ATOMIC_ACQUIRE)
+            while top and not ____atomic_compare_exchange_n(_.head, _.top, top._.next, 1, ____ATOMIC_ACQUIRE, ____ATOMIC_ACQUIRE):
+                pass
+            if top:
+                popped[count] = top
+                count += 1
+        for k in int(k := 0)(k < BURST)(k ** _):
+            push(node_new(k))
+        epoch_exit(t)
+        ____atomic_fetch_add(_.popped_total, count, ____ATOMIC_RELAXED)
+        for k in int(k := 0)(k < count)(k ** _):
+            epoch_retire(t, popped[k], node_reclaim)
+    epoch_unregister(t)
+    return arg
+
+def reader(arg: -void) -> -void:
+    t: -epoch_thread = epoch_register(_.domain)
+    walks: -uint64_t = arg
+    while not ____atomic_load_n(_.writers_done, ____ATOMIC_ACQUIRE):
+        epoch_enter(t)
+        n: -Node = ____atomic_load_n(_.head, ____ATOMIC_ACQUIRE)
+        depth: int = 0
+        while n:
+            if n._.magic != LIVE:
+                ____atomic_fetch_add(_.errors, 1, ____ATOMIC_RELAXED)
+            depth += 1
+            if depth == BURST / 4:
+                sched_yield()    # Let writers pop the rest of the walk meanwhile
+            n = n._.next
+        epoch_exit(t)
+        walks._ += 1
+    epoch_unregister(t)
+    return NULL
+
+def main() -> int:
+    epoch_init(_.domain)
+    for i in int(i := 0)(i < BURST)(i ** _):
+        push(node_new(i))
+    walks: uint64_t[READERS] = [0]
+    w: pthread_t[WRITERS]
+    r: pthread_t[READERS]
+    for i in int(i := 0)(i < READERS)(i ** _):
+        pthread_create(r + i, NULL, reader, walks + i)
+    for i in int(i := 0)(i < WRITERS)(i ** _):
+        pthread_create(w + i, NULL, writer, NULL)
+    for i in int(i := 0)(i < WRITERS)(i ** _):
+        pthread_join(w[i], NULL)
+    ____atomic_store_n(_.writers_done, 1, ____ATOMIC_RELEASE)
+    for i in int(i := 0)(i < READERS)(i ** _):
+        pthread_join(r[i], NULL)
+    during: uint64_t = reclaimed
+    epoch_destroy(_.domain)
+    # Every popped node is reclaimed exactly once; most before the end
+    printf("%d %d %d %d", errors, reclaimed == popped_total, during > popped_total / 2, walks[0] > 0)
+    while graveyard:
+        n: -Node = graveyard
+        graveyard = n._.grave
+        free(n)
+    while head:
+        n: -Node = head
+        head = n._.next
+        free(n)
+    return 0
+"""
+
+    def test_readers_never_see_reclaimed_nodes(self, run_c) -> None:
+        """Popped nodes are reclaimed in batches, never while a reader in a critical section can reach them."""
+        assert run_c(transpile(self.SOURCE), flags=("-O2", "-pthread")) == "0 1 1 1"
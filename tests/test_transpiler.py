@@ -1,10 +1,23 @@
 """Unit tests for specific transpiler features."""
 
 import ast
+import io
+import os
+import random
+import re
+import struct
+import subprocess
+import tracemalloc
 
 import pytest
 
-from arafura import CTranspiler, transpile
+from arafura import CTranspiler, lib, transpile
+from arafura.check import check
+from arafura.chunked import toplevel_chunks, transpile_chunked, transpile_source_chunked
+from arafura.prelude import make_prelude, read_prelude
+from arafura.report import format_report, parse_stack_usage, size_report
+from arafura.shard import balance, transpile_sharded
+from arafura.verify import dump_tree, verify_minimal_parens
 
 
 class TestTypeEmission:
@@ -31,6 +44,14 @@ class TestTypeEmission:
         result = transpiler.emit_type(node, "arr")
         assert "int" in result and "[10]" in result
 
+    def test_inline_qualifier(self) -> None:
+        """Test that inline[...] is a qualifier like static[...], not an array."""
+        transpiler = CTranspiler()
+        node = ast.parse("static[inline[int]]").body[0].value
+        assert transpiler.emit_type(node, "square") == "static inline int square"
+        output = transpile("def square(x: int) -> static[inline[int]]:\n    return x * x")
+        assert "static inline int square(int x) {" in output
+
 
 class TestExpressionEmission:
     """Test expression emission functionality."""
@@ -42,6 +63,15 @@ class TestExpressionEmission:
         assert transpiler.emit_expr(ast.Constant(3.14)) == "3.14"
         assert transpiler.emit_expr(ast.Constant("hello")) == '"hello"'
 
+    def test_unsigned_64bit_constants(self) -> None:
+        """Test that only constants past INT64_MAX get a ull suffix."""
+        transpiler = CTranspiler()
+        assert transpiler.emit_expr(ast.Constant(0x7FFFFFFFFFFFFFFF)) == "9223372036854775807"
+        assert transpiler.emit_expr(ast.Constant(0x8000000000000000)) == "9223372036854775808ull"
+        output = transpile("m: uint64_t = 0xFFFFFFFFFFFFFFFF\nk: uint64_t = m * 0x9E3779B97F4A7C15")
+        assert "uint64_t m = 18446744073709551615ull;" in output
+        assert "uint64_t k = (m * 11400714819323198485ull);" in output
+
     def test_none_to_null(self) -> None:
         """Test None -> NULL conversion."""
         transpiler = CTranspiler()
@@ -76,6 +106,31 @@ _ // x
         assert "x--;" in output
         assert "--x;" in output
 
+    def test_comparison_operands(self) -> None:
+        """Test that a comparison used as an arithmetic operand keeps its parentheses."""
+        source = """
+def f(k: int, a: int, b: int) -> int:
+    return 2 * k + (a < b) - -(a == b)
+"""
+        assert "return (((2 * k) + (a < b)) - -(a == b));" in transpile(source)
+
+    def test_comparison_operands_of_bitwise(self, gcc, tmp_path) -> None:
+        """Test that comparisons inside & ^ | keep the parentheses -Wparentheses asks for."""
+        source = """
+def f(a: int, b: int, c: int) -> int:
+    x: int = (a == b) & c
+    x = x | (a < b) ^ (b != c)
+    x = (a < b) << c
+    return x - (a != c)
+"""
+        output = transpile(source)
+        assert "int x = ((a == b) & c);" in output
+        assert "x = (x | ((a < b) ^ (b != c)));" in output
+        assert "x = ((a < b) << c);" in output
+        assert "return (x - (a != c));" in output
+        (tmp_path / "compare.c").write_text(output)
+        subprocess.run([gcc, "-Wall", "-Werror", "-c", "compare.c"], cwd=tmp_path, check=True)
+
 
 class TestStatements:
     """Test statement transpilation."""
@@ -232,3 +287,1559 @@ class TestErrorHandling:
         lambda_node = ast.parse("lambda x: x + 1").body[0].value
         with pytest.raises(ValueError, match="Unhandled expression"):
             transpiler.emit_expr(lambda_node)
+
+
+class TestConstInference:
+    """Test opt-in const inference for pointer parameters."""
+
+    def test_read_only_pointer_becomes_const(self) -> None:
+        """Pointers that are only read through are emitted as const T *."""
+        source = """
+def total(a: -int, n: int) -> int:
+    s: int = 0
+    for i in int(i := 0)(i < n)(i ** _):
+        s += a[i]
+    return s
+"""
+        assert "int total(const int *a, int n)" in transpile(source, infer_const=True)
+        assert "int total(int *a, int n)" in transpile(source)
+
+    def test_written_or_escaping_pointer_stays_mutable(self) -> None:
+        """Stores through the pointer and escapes disqualify it."""
+        source = """
+def store(a: -int, node: -Node) -> void:
+    a[0] = node._.data
+    node._.data ** _
+
+def leak(a: -int) -> -int:
+    return a
+"""
+        output = transpile(source, infer_const=True)
+        assert "void store(int *a, Node *node)" in output
+        assert "leak(int *a)" in output
+
+    def test_calls_follow_callee_signature(self) -> None:
+        """Passing a pointer on keeps it const only if the callee takes const."""
+        source = """
+def reader(p: -char) -> int:
+    return strlen(p)
+
+def forward(p: -char) -> int:
+    return reader(p)
+
+def unknown(p: -char) -> void:
+    external(p)
+
+def recurse(p: -char, n: int) -> int:
+    if n == 0:
+        return p[0]
+    return recurse(p, n - 1)
+"""
+        output = transpile(source, infer_const=True)
+        assert "int reader(const char *p)" in output
+        assert "int forward(const char *p)" in output
+        assert "void unknown(char *p)" in output
+        assert "int recurse(const char *p, int n)" in output
+
+
+    def test_array_fields_escape(self, gcc, tmp_path) -> None:
+        """An array field reached through the pointer is a pointer into it: it may only be indexed."""
+        source = """
+@typedef(S)
+class S:
+    arr: int[4]
+    n: int
+
+def touch(q: -int) -> void:
+    q[1] = 1
+
+def alias(p: -S) -> void:
+    q: -int = p._.arr
+    q[0] = 5
+
+def call(p: -S) -> void:
+    touch(p._.arr)
+
+def read(p: -S, i: int) -> int:
+    return p._.arr[i] + p[0].arr[1] + p._.n
+"""
+        output = transpile(source, infer_const=True)
+        assert "void alias(S *p)" in output and "void call(S *p)" in output
+        assert "int read(const S *p, int i)" in output
+        (tmp_path / "fields.c").write_text(output)
+        subprocess.run([gcc, "-Wall", "-Werror", "-c", "fields.c"], cwd=tmp_path, check=True)
+
+
+class TestMinimalParens:
+    """Test precedence-aware parenthesization."""
+
+    def test_only_required_parentheses(self) -> None:
+        """Parentheses appear only where precedence or associativity needs them."""
+        source = """
+def f(a: int, b: int, c: int, p: -int) -> int:
+    return a + b * c - (a - b) + (a + b) * c + p._ + (p + 1)._
+"""
+        output = transpile(source, minimal_parens=True)
+        assert "return a + b * c - (a - b) + (a + b) * c + *p + *(p + 1);" in output
+
+    def test_boolean_and_ternary(self) -> None:
+        """Boolean operators and ternaries drop redundant wrapping."""
+        source = """
+def f(a: int, b: int, c: int) -> int:
+    return (a if b else c) + (1 if a or b and c else 2)
+"""
+        output = transpile(source, minimal_parens=True)
+        assert "return (b ? a : c) + (a || (b && c) ? 1 : 2);" in output
+
+    def test_keeps_wparentheses_groupings(self) -> None:
+        """Groupings GCC warns about are kept even when redundant."""
+        source = """
+def f(a: int, b: int, c: int) -> int:
+    return (a + b << c) | (a & b) ^ c
+"""
+        output = transpile(source, minimal_parens=True)
+        assert "return (a + b) << c | ((a & b) ^ c);" in output
+
+    def test_verify_against_compiler(self, gcc: str) -> None:
+        """Both forms parse to the same tree with the C compiler."""
+        source = """
+def f(a: int, b: int, c: int, p: -int) -> int:
+    x: int = (a + b) * c << 2 | a & b ^ c
+    x = [long](a + b) * 2 + -p._ + (x := a - (b - c))
+    return x if a < b == (c > a) else (a and b) or c
+"""
+        output = verify_minimal_parens(source, cc=gcc)
+        assert "x = (long)(a + b) * 2 + -*p + (x = a - (b - c));" in output
+
+    def test_dump_tree_distinguishes_meaning(self, gcc: str) -> None:
+        """The compiler check sees through parentheses but not regrouping."""
+        same = dump_tree("int f(int a, int b) { return ((a) + (b)) * 2; }", gcc)
+        assert same == dump_tree("int f(int a, int b) { return (a + b) * 2; }", gcc)
+        assert same != dump_tree("int f(int a, int b) { return a + b * 2; }", gcc)
+
+
+class TestAliasVersioned:
+    """Test @alias_versioned runtime alias checks."""
+
+    SOURCE = """
+from stdio import *
+
+@alias_versioned(n)
+def shift_add(y: -int, x: -int, n: int) -> void:
+    for i in int(i := 0)(i < n)(i ** _):
+        y[i] += x[i]
+
+def main() -> int:
+    buf: int[9] = [1, 2, 3, 4, 5, 6, 7, 8, 9]
+    other: int[4] = [10, 20, 30, 40]
+    shift_add(buf, other, 4)
+    shift_add(buf + 1, buf, 8)
+    for i in int(i := 0)(i < 9)(i ** _):
+        printf("%d ", buf[i])
+    return 0
+"""
+
+    def test_emits_restrict_clone_and_check(self) -> None:
+        """The clone is restrict-qualified and guarded by an overlap check."""
+        output = transpile(self.SOURCE)
+        assert "#include <stdint.h>" in output
+        assert "static void shift_add_restrict(int *restrict y, int *restrict x, int n) {" in output
+        assert "void shift_add(int *y, int *x, int n) {" in output
+        assert "if ((uintptr_t)(y + n) <= (uintptr_t)x || (uintptr_t)(x + n) <= (uintptr_t)y) {" in output
+        assert "shift_add_restrict(y, x, n);" in output
+
+    def test_read_only_pairs_need_no_check(self) -> None:
+        """Pointers that are both read-only are not checked against each other."""
+        source = """
+@alias_versioned(n)
+def add3(out: -int, a: -const[int], b: -const[int], n: int) -> void:
+    out[0] = a[0] + b[0]
+"""
+        output = transpile(source)
+        assert "(out + n) <= (uintptr_t)a" in output
+        assert "(out + n) <= (uintptr_t)b" in output
+        assert "(a + n) <= (uintptr_t)b" not in output
+
+    def test_requires_extents(self) -> None:
+        """A bare decorator has no extents to check."""
+        source = """
+@alias_versioned
+def f(a: -int, b: -int) -> void:
+    a[0] = b[0]
+"""
+        with pytest.raises(ValueError, match="needs pointer extents"):
+            transpile(source)
+
+    def test_qualified_void_return(self) -> None:
+        """A void return under static[...] calls the clone without returning its value."""
+        output = transpile(self.SOURCE.replace("n: int) -> void:", "n: int) -> static[void]:"))
+        assert "        shift_add_restrict(y, x, n);\n        return;" in output
+        assert "return shift_add_restrict" not in output
+
+    def test_rejects_static_locals(self) -> None:
+        """The body is duplicated, so a static local would have two copies."""
+        source = """
+@alias_versioned(n)
+def f(a: -int, b: -int, n: int) -> void:
+    calls: static[int] = 0
+    calls += 1
+    a[0] = b[0]
+"""
+        with pytest.raises(ValueError, match="static local calls of f"):
+            transpile(source)
+
+    def test_overlapping_calls_take_fallback(self, run_c) -> None:
+        """Overlapping ranges produce the same results as the plain loop."""
+        output = run_c(transpile(self.SOURCE), flags=("-O3",))
+        assert output.split() == ["11", "33", "66", "110", "115", "121", "128", "136", "145"]
+
+
+class TestMatchLookupTable:
+    """Test lookup-table conversion of value-returning match statements."""
+
+    def test_dense_constant_match_becomes_table(self) -> None:
+        """Dense constant-to-constant cases emit a table and one bounds check."""
+        source = """
+def classify(c: int) -> int:
+    match c:
+        case -1:
+            return 7
+        case 0:
+            return 10
+        case 1:
+            return 20
+        case 3:
+            return 40
+        case _:
+            return -1
+"""
+        output = transpile(source)
+        assert "switch" not in output
+        assert "static const int lut0[5] = {7, 10, 20, -1, 40};" in output
+        assert "if ((unsigned long long)c + 1 < 5) {" in output
+        assert "return lut0[c + 1];" in output
+        assert output.strip().endswith("return -1;\n}")
+
+    def test_other_shapes_stay_switch(self) -> None:
+        """Sparse keys, statements, or holes without default keep the switch."""
+        sparse = """
+def f(c: int) -> int:
+    match c:
+        case 0:
+            return 1
+        case 100:
+            return 2
+        case 200:
+            return 3
+        case 300:
+            return 4
+        case _:
+            return 0
+"""
+        holes = """
+def f(c: int) -> int:
+    match c:
+        case 0:
+            return 1
+        case 1:
+            return 2
+        case 2:
+            return 3
+        case 4:
+            return 4
+"""
+        assert "switch (c)" in transpile(sparse)
+        assert "switch (c)" in transpile(holes)
+
+    def test_table_matches_switch(self, run_c) -> None:
+        """The table returns the same values as the switch would."""
+        source = """
+from stdio import *
+
+def name(c: int) -> -char:
+    match c:
+        case 0:
+            return "zero"
+        case 1:
+            return "one"
+        case 2:
+            return "two"
+        case 3:
+            return "three"
+        case _:
+            return "many"
+
+def main() -> int:
+    for i in int(i := -2)(i < 6)(i ** _):
+        printf("%s ", name(i))
+    return 0
+"""
+        output = transpile(source)
+        assert "static char *const lut0[4]" in output
+        assert run_c(output).split() == ["many", "many", "zero", "one", "two", "three", "many", "many"]
+
+
+class TestNdview:
+    """Test strided multi-dimensional array views."""
+
+    def test_view_type_and_indexing(self) -> None:
+        """ndview[T, N] is a struct; v[i, j] uses its strides."""
+        source = """
+def get(v: ndview[float, 2], i: int, j: int) -> float:
+    return v[i, j]
+
+def get_row_major(v: -ndview[float, 2, contiguous], i: int, j: int) -> float:
+    return v._[i, j]
+"""
+        output = transpile(source)
+        assert "typedef struct {\n    float *data;\n    ptrdiff_t shape[2];\n    ptrdiff_t strides[2];\n} ndview_float_2;" in output
+        assert "ptrdiff_t strides[1];\n} ndview_float_2c;" in output
+        assert "return v.data[i * v.strides[0] + j * v.strides[1]];" in output
+        assert "return v->data[i * v->strides[0] + j];" in output
+
+    def test_slices_are_zero_copy_views(self) -> None:
+        """Slicing builds a view over the same data."""
+        source = """
+def f(m: ndview[int, 2], r: int) -> void:
+    sub: ndview[int, 2] = m[1:3, ::2]
+    row: ndview[int, 1, contiguous] = ndview(m.data, 8)
+"""
+        output = transpile(source)
+        assert ("ndview_int_2 sub = (ndview_int_2){.data = m.data + 1 * m.strides[0], "
+                ".shape = {3 - 1, (m.shape[1] + 2 - 1) / 2}, .strides = {m.strides[0], 2 * m.strides[1]}};") in output
+        assert "ndview_int_1c row = (ndview_int_1c){.data = m.data, .shape = {8}};" in output
+
+    def test_stride_products_keep_grouping(self) -> None:
+        """An extent like x / y stays one factor of the strides, also with minimal parentheses."""
+        source = """
+def f(buf: -int, a: int, x: int, y: int) -> void:
+    v: ndview[int, 3] = ndview(buf, a, a, x / y)
+"""
+        output = transpile(source, minimal_parens=True)
+        assert ".strides = {a * (x / y), x / y, 1}" in output
+
+    def test_negative_step(self) -> None:
+        """A step that is not positive would give a wrong extent."""
+        for step in ("-1", "0", "-k"):
+            with pytest.raises(ValueError, match="steps must be positive"):
+                transpile(f"def f(m: ndview[int, 1], k: int) -> void:\n    s: ndview[int, 1] = m[::{step}]\n")
+
+    def test_strided_slice_is_not_contiguous(self) -> None:
+        """A contiguous target needs a unit inner stride."""
+        source = """
+def f(m: ndview[int, 2, contiguous]) -> void:
+    sub: ndview[int, 2, contiguous] = m[:, ::2]
+"""
+        with pytest.raises(ValueError, match="not contiguous"):
+            transpile(source)
+
+    def test_views_share_data(self, run_c) -> None:
+        """Writes through a sub-view are visible in the parent view."""
+        source = """
+from stdio import *
+
+def main() -> int:
+    buf: int[24]
+    for i in int(i := 0)(i < 24)(i ** _):
+        buf[i] = i
+    m: ndview[int, 2, contiguous] = ndview(buf, 4, 6)
+    sub: ndview[int, 2, contiguous] = m[1:3, 2:5]
+    sub[1, 2] = 100
+    every: ndview[int, 2] = m[::2, ::3]
+    col: ndview[int, 1] = m[:, 4]
+    printf("%d %d %d %d %d", buf[16], every[1, 1], col[2,], sub.shape[0], sub.shape[1])
+    return 0
+"""
+        assert run_c(transpile(source)).split() == ["100", "15", "100", "2", "3"]
+
+
+class TestHalfPrecision:
+    """Test float16/bfloat16 storage types and conversions."""
+
+    # Round-to-even ties, subnormals, overflow and infinities; more than 16
+    # values so the vector loops run
+    VALUES = [0.0, -0.0, 1.0, -2.5, 0.1, 3.14159, 65504.0, 65519.0, 65520.0, 1e6,
+              1e-7, 5.96e-8, 2.98e-8, 1e-10, 1.0009765625, 1.00048828125, 1.00146484375,
+              2049.0, 2051.0, -1e-5, 6.1e-5, 1.5e-38, 1e38, 3e38, 12345.678, -0.33333334,
+              float("inf"), float("-inf")] * 2
+
+    @staticmethod
+    def float32(value: float) -> float:
+        return struct.unpack("<f", struct.pack("<f", value))[0]
+
+    def program(self, dst: str) -> str:
+        literals = ", ".join("1e39" if v == float("inf") else "-1e39" if v == float("-inf")
+                             else repr(self.float32(v)) for v in self.VALUES)
+        n = len(self.VALUES)
+        return f"""
+from stdio import *
+from string import *
+
+def main() -> int:
+    src: float[{n}] = [{literals}]
+    h: {dst}[{n}]
+    back: float[{n}]
+    bits: unsigned[short]
+    convert(h, src, {n})
+    convert(back, h, {n})
+    for i in int(i := 0)(i < {n})(i ** _):
+        memcpy(_.bits, _.h[i], 2)
+        printf("%u %a %a\\n", bits, back[i], convert[float, {dst}](convert[{dst}](src[i])))
+    return 0
+"""
+
+    def run(self, run_c, dst: str, flags: tuple[str, ...]) -> list[tuple[int, float, float]]:
+        output = run_c(transpile(self.program(dst)), flags=("-O2", *flags))
+        rows = [line.split() for line in output.splitlines()]
+        return [(int(bits), float.fromhex(bulk), float.fromhex(scalar)) for bits, bulk, scalar in rows]
+
+    @pytest.mark.parametrize("flags", [(), ("-DARAFURA_NO_NATIVE_FLOAT16",), ("-mf16c",), ("-mavx512f",)])
+    def test_float16_rounds_to_nearest_even(self, run_c, require_cpu, flags) -> None:
+        """Every code path agrees with IEEE binary16 rounding."""
+        require_cpu(flags)
+        for value, (bits, bulk, scalar) in zip(self.VALUES, self.run(run_c, "float16", flags)):
+            try:
+                expected = struct.pack("<e", self.float32(value))
+            except OverflowError:
+                expected = struct.pack("<e", float("inf") if value > 0 else float("-inf"))
+            assert bits == struct.unpack("<H", expected)[0], value
+            assert bulk == scalar == struct.unpack("<e", expected)[0], value
+
+    @pytest.mark.parametrize("flags", [(), ("-DARAFURA_NO_NATIVE_FLOAT16",)])
+    def test_bfloat16_rounds_to_nearest_even(self, run_c, flags) -> None:
+        """bfloat16 keeps the top 16 bits of the rounded binary32."""
+        for value, (bits, bulk, scalar) in zip(self.VALUES, self.run(run_c, "bfloat16", flags)):
+            u = struct.unpack("<I", struct.pack("<f", self.float32(value)))[0]
+            expected = (u + 0x7FFF + ((u >> 16) & 1)) >> 16
+            assert bits == expected, value
+            assert bulk == scalar == struct.unpack("<f", struct.pack("<I", expected << 16))[0], value
+
+    def test_storage_types_pull_in_runtime_once(self) -> None:
+        """The type names map to runtime typedefs, emitted once."""
+        source = """
+def f(a: -float16, b: -bfloat16, n: size_t) -> size_t:
+    return sizeof(float16) * n + sizeof(bfloat16)
+
+def g(h: float16) -> float:
+    return convert[float](h)
+"""
+        output = transpile(source)
+        assert output.count("typedef _Float16 arafura_f16;") == 1
+        assert "size_t f(arafura_f16 *a, arafura_bf16 *b, size_t n) {" in output
+        assert "return ((sizeof(arafura_f16) * n) + sizeof(arafura_bf16));" in output
+        assert "return arafura_f16_to_f32(h);" in output
+
+    def test_unknown_conversion_rejected(self) -> None:
+        """convert needs a float <-> storage type pair."""
+        source = """
+def f(dst: -int, src: -float, n: int) -> void:
+    convert(dst, src, n)
+"""
+        with pytest.raises(ValueError, match="No conversion from float to int"):
+            transpile(source)
+
+
+class TestByteSearch:
+    """Test the SIMD byte search builtins."""
+
+    TEXT = "alpha,beta;gamma\nsecond line with x and more words, to pass 64 bytes\nthird;line\n\n"
+
+    def test_builtins_lower_to_runtime(self) -> None:
+        """Single-byte strings become char constants; literal sets carry their length."""
+        source = """
+def f(p: -char, n: size_t) -> size_t:
+    return find_byte(p, n, "\\n") + find_any(p, n, " \\t") + count_byte(p, n, 0)
+"""
+        output = transpile(source)
+        assert "static inline size_t arafura_find_byte(" in output
+        assert "_mm256_movemask_epi8" in output
+        assert "arafura_find_byte(p, n, '\\n')" in output
+        assert "arafura_find_any(p, n, \" \\t\", 2)" in output
+        assert "arafura_count_byte(p, n, 0)" in output
+
+    def test_find_any_needs_length(self) -> None:
+        """A non-literal set needs an explicit length."""
+        with pytest.raises(ValueError, match="string literal set"):
+            transpile("def f(p: -char, s: -char) -> size_t:\n    return find_any(p, 10, s)\n")
+
+    @pytest.mark.parametrize("flags", [(), ("-U__SSE2__",), ("-mavx2",)])
+    def test_search_matches_python(self, run_c, require_cpu, flags) -> None:
+        """Every prefix length agrees with Python on each code path."""
+        require_cpu(flags)
+        source = f"""
+from stdio import *
+
+def main() -> int:
+    text: -char = {self.TEXT!r}
+    for n in int(n := 0)(n <= {len(self.TEXT)})(n ** _):
+        printf("%zu %zu %zu %zu\\n", find_byte(text, n, "x"), find_any(text, n, ",;\\n"),
+               count_byte(text, n, "\\n"), find_any(text, n, "qzyx!?+-~", 9))
+    return 0
+"""
+        def find(prefix: str, chars: str) -> int:
+            return min((prefix.index(c) for c in chars if c in prefix), default=len(prefix))
+
+        expected = [" ".join(map(str, (find(p, "x"), find(p, ",;\n"), p.count("\n"), find(p, "qzyx!?+-~"))))
+                    for p in (self.TEXT[:n] for n in range(len(self.TEXT) + 1))]
+        assert run_c(transpile(source), flags=("-O2", *flags)).splitlines() == expected
+
+    @pytest.mark.parametrize("flags", [(), ("-U__SSE2__",), ("-mavx2",)])
+    def test_count_long_buffer(self, run_c, require_cpu, flags) -> None:
+        """Counts past the 255-block accumulator limit."""
+        require_cpu(flags)
+        source = """
+from stdio import *
+
+def main() -> int:
+    buf: char[20011]
+    for i in int(i := 0)(i < 20011)(i ** _):
+        buf[i] = 10 if i % 7 == 0 or i % 11 == 0 else 65
+    printf("%zu %zu", count_byte(buf, 20011, "\\n"), find_byte(buf + 1, 20010, "\\n"))
+    return 0
+"""
+        expected = sum(1 for i in range(20011) if i % 7 == 0 or i % 11 == 0)
+        assert run_c(transpile(source), flags=("-O2", *flags)).split() == [str(expected), "6"]
+
+
+class TestChecksums:
+    """Test the crc32c and hash64 builtins."""
+
+    SOURCE = """
+from stdio import *
+
+def main() -> int:
+    buf: list[unsigned[char], 300]
+    for i in int(i := 0)(i < 300)(i ** _):
+        buf[i] = i * 7 + 3
+    for n in int(n := 0)(n <= 300)(n := n + 13):
+        printf("%u %llu\\n", crc32c(buf, n, 0), [unsigned[long[long]]](hash64(buf, n)))
+    return 0
+"""
+
+    @staticmethod
+    def crc32c(data: bytes, crc: int = 0) -> int:
+        crc ^= 0xFFFFFFFF
+        for byte in data:
+            crc ^= byte
+            for _ in range(8):
+                crc = (crc >> 1) ^ (0x82F63B78 if crc & 1 else 0)
+        return crc ^ 0xFFFFFFFF
+
+    def test_builtins_lower_to_dispatch(self) -> None:
+        """Calls go through the dispatching runtime functions."""
+        output = transpile("def f(p: -char, n: size_t) -> uint64_t:\n    return crc32c(p, n, 0) ^ hash64(p, n)\n")
+        assert "return (arafura_crc32c(p, n, 0) ^ arafura_hash64(p, n));" in output
+        assert '__attribute__((target("sse4.2")))' in output
+        assert '__builtin_cpu_supports("aes")' in output
+        assert output.count("#define ARAFURA_X86_DISPATCH 1") == 1
+
+    def test_crc32c_check_value_and_chaining(self, run_c) -> None:
+        """The standard check value, and a seed continues a previous CRC."""
+        source = """
+from stdio import *
+
+def main() -> int:
+    text: -char = "123456789"
+    printf("%x %x", crc32c(text, 9, 0), crc32c(text + 4, 5, crc32c(text, 4, 0)))
+    return 0
+"""
+        assert run_c(transpile(source)).split() == ["e3069283", "e3069283"]
+
+    @pytest.mark.parametrize("flags", [(), ("-DARAFURA_NO_CPU_DISPATCH",)])
+    def test_crc32c_matches_reference(self, run_c, flags) -> None:
+        """Hardware and table paths agree with a bitwise CRC32C."""
+        data = bytes((i * 7 + 3) & 0xFF for i in range(300))
+        rows = run_c(transpile(self.SOURCE), flags=("-O2", *flags)).splitlines()
+        assert [int(row.split()[0]) for row in rows] == [self.crc32c(data[:n]) for n in range(0, 301, 13)]
+
+    def test_hash64_is_the_same_everywhere(self, run_c) -> None:
+        """The portable AES round computes exactly what AES-NI does."""
+        dispatched = run_c(transpile(self.SOURCE))
+        portable = run_c(transpile(self.SOURCE), flags=("-O2", "-DARAFURA_NO_CPU_DISPATCH"))
+        assert dispatched == portable
+        hashes = [row.split()[1] for row in portable.splitlines()]
+        assert len(set(hashes)) == len(hashes)
+
+    def test_hash64_avalanche(self, run_c) -> None:
+        """Flipping any input bit flips about half the output bits."""
+        source = """
+from stdio import *
+from string import *
+
+def main() -> int:
+    buf: list[unsigned[char], 40]
+    memset(buf, 0, 40)
+    base: uint64_t = hash64(buf, 40)
+    total: int = 0
+    for bit in int(bit := 0)(bit < 320)(bit ** _):
+        buf[bit / 8] ^= 1 << bit % 8
+        total += ____builtin_popcountll(hash64(buf, 40) ^ base)
+        buf[bit / 8] ^= 1 << bit % 8
+    printf("%d", total)
+    return 0
+"""
+        average = int(run_c(transpile(source))) / 320
+        assert 30 < average < 34
+
+
+class TestFastMath:
+    """Test the approximate math builtins."""
+
+    def test_lowering_and_precise_math(self) -> None:
+        """Builtins use the runtime approximations, or libm with precise_math."""
+        source = "def f(x: float) -> float:\n    return fast_exp(x) + fast_log(x) * rsqrt(x) - fast_tanh(x)\n"
+        fast = transpile(source)
+        assert "static inline float arafura_fast_exp(float x) {" in fast
+        assert "return ((arafura_fast_exp(x) + (arafura_fast_log(x) * arafura_rsqrt(x))) - arafura_fast_tanh(x));" in fast
+        precise = transpile(source, precise_math=True)
+        assert "#include <math.h>" in precise
+        assert "arafura_fast_exp" not in precise
+        assert "return ((expf(x) + (logf(x) * arafura_rsqrt_precise(x))) - tanhf(x));" in precise
+
+    def test_documented_error_bounds(self, run_c) -> None:
+        """Maximum errors over a sweep of all finite floats stay within DESIGN.md's bounds."""
+        source = """
+from stdio import *
+from string import *
+from math import *
+
+def rel(a: double, b: double) -> double:
+    return fabs(a - b) / fabs(b)
+
+def main() -> int:
+    worst: double[4] = [0, 0, 0, 0]
+    for u in uint32_t(u := 0)(u < 0x7F800000)(u := u + 4099):
+        x: float
+        memcpy(_.x, _.u, 4)
+        for sign in int(sign := 0)(sign < 2)(sign ** _):
+            v: float = -x if sign else x
+            e: double = exp(v)
+            if e > 1.2e-38 and e < 3.4e38:
+                worst[0] = fmax(worst[0], rel(fast_exp(v), e))
+            if v != 0:
+                worst[3] = fmax(worst[3], rel(fast_tanh(v), tanh(v)))
+        if x > 0:
+            worst[1] = fmax(worst[1], fabs(fast_log(x) - log(x)) / fmax(1, fabs(log(x))))
+            worst[2] = fmax(worst[2], rel(rsqrt(x), 1 / sqrt(x)))
+    printf("%g %g %g %g", worst[0], worst[1], worst[2], worst[3])
+    return 0
+"""
+        exp_err, log_err, rsqrt_err, tanh_err = map(float, run_c(transpile(source)).split())
+        assert exp_err < 3e-7
+        assert log_err < 2e-7
+        assert rsqrt_err < 5e-6
+        assert tanh_err < 3e-7
+
+    def test_special_values(self, run_c) -> None:
+        """Overflow, underflow, zero and negative inputs follow libm."""
+        source = """
+from stdio import *
+
+def main() -> int:
+    printf("%g %g %g %g %g %g %g ", fast_exp(100), fast_exp(-110), fast_log(0), fast_log(-1),
+           rsqrt(0), fast_tanh(30), fast_tanh(-30))
+    printf("%g %g %g", rsqrt(-0.0), rsqrt(-4), rsqrt(fast_exp(100)))
+    return 0
+"""
+        assert run_c(transpile(source)).split() == ["inf", "0", "-inf", "nan", "inf", "1", "-1", "-inf", "nan", "0"]
+
+    def test_loops_vectorize(self, gcc, tmp_path) -> None:
+        """A loop over the approximations is vectorized by GCC."""
+        source = """
+def kernel(out: -float, x: -float, n: int) -> void:
+    for i in int(i := 0)(i < n)(i ** _):
+        out[i] = fast_exp(x[i]) * rsqrt(x[i]) + fast_log(x[i]) + fast_tanh(x[i])
+"""
+        c_file = tmp_path / "kernel.c"
+        c_file.write_text(transpile(source), encoding="utf-8")
+        result = subprocess.run([gcc, "-O3", "-c", "-fopt-info-vec-optimized", "-o", str(tmp_path / "kernel.o"), str(c_file)],
+                                check=True, capture_output=True, text=True)
+        assert "loop vectorized" in result.stderr
+
+
+class TestCheck:
+    """Test the validation-only structural checker."""
+
+    BROKEN = "\n".join([
+        "def mixed(a: int, b):",            # 1: annotation mismatch
+        "    pass",
+        "def main() -> int:",
+        "    for i in range(10):",          # 4: not TYPES(INIT)(COND)(STEP)
+        "        pass",
+        "    match x:",
+        "        case [a, b]:",             # 7: not a switch pattern
+        "            pass",
+        "    raise f(1)",                   # 9: goto needs a label
+        "    del a.b",                      # 10: #undef needs a name
+        "    x = a @ b",                    # 11: no C operator
+        "    return 0",
+    ])
+
+    def test_fixtures_and_modules_pass(self, fixtures_dir) -> None:
+        """Test that everything the transpiler accepts passes the check."""
+        for fixture in sorted(fixtures_dir.glob("*.py")):
+            assert check(fixture.read_text()) == [], fixture.name
+        for name in lib.names():
+            assert check(lib.source(name)) == [], name
+
+    def test_reports_all_errors(self) -> None:
+        """Test that one pass reports every error, in line order."""
+        errors = check(self.BROKEN)
+        assert [e.line for e in errors] == [1, 4, 7, 9, 10, 11]
+        assert "Invalid function/macro definition: mixed" in errors[0].message
+        assert "Invalid for loop pattern" in errors[1].message
+        assert "MatchSequence" in errors[2].message
+        assert errors[5].format("x.py") == "x.py:11:9: error: Unsupported binary operator: MatMult"
+
+    @pytest.mark.parametrize("source", [
+        "def mixed(a: int, b):\n    pass",
+        "def main() -> int:\n    for i in range(10):\n        pass",
+        "def main() -> int:\n    match x:\n        case [a, b]:\n            pass",
+        "def main() -> int:\n    raise f(1)",
+        "def main() -> int:\n    del a.b",
+        "def main() -> int:\n    x = a @ b",
+        "if [DEBUG]:\n    x = 1\nelif y:\n    x = 2",
+    ])
+    def test_agrees_with_transpiler(self, source) -> None:
+        """Test that each reported error is one the transpiler raises on."""
+        assert len(check(source)) == 1
+        with pytest.raises(ValueError):
+            transpile(source)
+
+    def test_reports_type_dependent_errors(self) -> None:
+        """Test that errors depending on declarations are reported at their expression."""
+        source = "\n".join([
+            "def f(p: -char, m: ndview[int, 2], h: uint64_t, d: fastdiv[uint32_t], s: -char) -> uint32_t:",
+            "    c: uint32_t = crc32c(p)",                 # 2: wrong arity
+            "    x: int = m[1]",                            # 3: rank 2 indexed once
+            "    v: ndview[int, 1] = m[0:2, 0:2]",          # 4: rank 2 slice to rank 1
+            "    a: int = find_any(p, 4, s)",               # 5: set is not a literal
+            "    b: float16[4]",
+            "    q: int[4]",
+            "    convert(b, q, 4)",                         # 8: no int -> float16 conversion
+            "    return h % d",                             # 9: 64-bit dividend
+            "@alias_versioned",
+            "def g(a: -int, b: -int) -> void:",             # 11: no extents
+            "    a[0] = b[0]",
+            "w: ndview[int, 2, rowmajor]",                  # 13: unknown layout
+        ])
+        errors = check(source)
+        assert [e.line for e in errors] == [2, 3, 4, 5, 8, 9, 11, 13]
+        messages = ["crc32c takes 3 arguments", "rank 2 indexed with 1 subscripts", "slice of rank 2 assigned to rank 1",
+                    "needs a string literal set", "No conversion from int to float16", "cannot divide a uint64_t",
+                    "needs pointer extents: g", "Unknown ndview layout"]
+        lines = source.splitlines()
+        for error, message in zip(errors, messages, strict=True):
+            assert message in error.message
+            with pytest.raises(ValueError, match=re.escape(message)):
+                transpile(source)
+            # The transpiler stops at the first error: drop that line (or decorator) and go on
+            line = lines[error.line - 1]
+            if line.startswith("def g"):
+                source = source.replace("@alias_versioned\n", "")
+            else:
+                source = source.replace(line, "    pass" if line.startswith("    ") else "", 1)
+
+    def test_builds_no_output(self, fixtures_dir, monkeypatch) -> None:
+        """Test that valid input never reaches the emitter."""
+        def fail(*args) -> None:
+            raise AssertionError("check() emitted code")
+        monkeypatch.setattr(CTranspiler, "emit", fail)
+        monkeypatch.setattr(CTranspiler, "emit_expr", fail)
+        for fixture in sorted(fixtures_dir.glob("*.py")):
+            assert check(fixture.read_text()) == [], fixture.name
+        assert check(TestShards.SOURCE) == [] and check(TestProtocol.SOURCE) == []
+        assert check("from arafura.search import *\nfrom arafura.timer_wheel import *\n") == []
+
+    def test_mixed_preprocessor_chain(self) -> None:
+        """Test that a regular elif after #if is reported."""
+        errors = check("if [DEBUG]:\n    x = 1\nelif y:\n    x = 2\n")
+        assert [(e.line, e.message) for e in errors] == [
+            (3, "Mixed regular and preprocessor conditionals in elif chain")]
+
+    def test_syntax_error(self) -> None:
+        """Test that a syntax error is reported as one error."""
+        errors = check("def invalid syntax")
+        assert len(errors) == 1 and errors[0].message.startswith("Syntax error")
+
+    def test_unknown_module(self) -> None:
+        """Test that an unknown standard module is reported."""
+        errors = check("from arafura.nope import *")
+        assert errors[0].message == "Unknown standard module: arafura.nope"
+
+
+class TestChunked:
+    """Test transpiling one top-level statement at a time."""
+
+    def test_matches_transpile(self, fixtures_dir) -> None:
+        """Test that chunked output equals whole-module output."""
+        for fixture in sorted(fixtures_dir.glob("*.py")):
+            source = fixture.read_text()
+            assert transpile_source_chunked(source) == transpile(source), fixture.name
+        for name in lib.names():
+            assert transpile_source_chunked(lib.source(name)) == transpile(lib.source(name)), name
+
+    def test_chunk_boundaries(self) -> None:
+        """Test that decorators and elif/else stay with their statement."""
+        source = "\n".join([
+            "# leading comment",
+            "@packed",
+            "@aligned(8)",
+            "class P:",
+            "    x: int",
+            "",
+            "if [A]:",
+            "    x: int",
+            "else:",
+            "    y: int",
+            "z: int = (1 +",
+            "          2); w: int",
+        ]) + "\n"
+        chunks = list(toplevel_chunks(io.StringIO(source).readline))
+        assert [lineno for lineno, _ in chunks] == [1, 2, 7, 11]
+        assert chunks[1][1].startswith("@packed\n@aligned(8)\nclass P:")
+        assert chunks[2][1].endswith("    y: int\n")
+
+    def test_types_defined_later(self) -> None:
+        """Test that struct names are known before their definition is reached."""
+        source = "def f() -> int:\n    p: Point = Point(1, 2)\n    return p.x\n\nclass Point:\n    x: int\n    y: int\n"
+        assert transpile_source_chunked(source) == transpile(source)
+        assert "Point p = {1, 2};" in transpile_source_chunked(source)
+
+    def test_syntax_error_line(self) -> None:
+        """Test that syntax errors report the line in the whole file."""
+        with pytest.raises(SyntaxError) as e:
+            transpile_source_chunked("x: int\ny: int\nz: int = )\n")
+        assert e.value.lineno == 3
+
+    def test_peak_memory(self) -> None:
+        """Test that peak memory follows the largest statement, not the file."""
+        source = "".join(
+            f"def f{i}(a: int, b: -int) -> int:\n"
+            f"    x: int = a * {i}\n"
+            "    for j in int(j := 0)(j < a)(j ** _):\n"
+            "        x = x + b[j]\n"
+            "    return x\n\n"
+            for i in range(500))
+        peaks = []
+        for run in (lambda: transpile(source),
+                    lambda: transpile_chunked(lambda: io.StringIO(source), io.StringIO())):
+            tracemalloc.start()
+            run()
+            peaks.append(tracemalloc.get_traced_memory()[1])
+            tracemalloc.stop()
+        assert peaks[1] * 5 < peaks[0]
+
+    def test_method_bodies_released(self, tmp_path) -> None:
+        """Test that struct method bodies are not kept after their struct is emitted."""
+        def source(count: int) -> str:
+            return "".join(
+                f"@typedef(S{i})\n"
+                f"class S{i}:\n"
+                "    v: int\n"
+                "    def get(self, a: int) -> int:\n"
+                f"        x: int = self._.v * {i}\n"
+                "        for j in int(j := 0)(j < a)(j ** _):\n"
+                "            x = x + self._.v * j - (x >> 3) + (j << 2)\n"
+                "        return x\n\n"
+                for i in range(count))
+        peaks = []
+        for count in (50, 500):
+            path = tmp_path / f"structs_{count}.py"
+            path.write_text(source(count))
+            with open(os.devnull, "w") as out:
+                tracemalloc.start()
+                transpile_chunked(lambda: open(path), out)
+                peaks.append(tracemalloc.get_traced_memory()[1])
+                tracemalloc.stop()
+        # Only declarations (type, field and method names) stay: far less than a method body
+        assert (peaks[1] - peaks[0]) / 450 < 2000
+
+    def test_infer_const_rejected(self) -> None:
+        """Test that const inference, which needs the whole module, is refused."""
+        with pytest.raises(ValueError, match="infer_const"):
+            transpile_source_chunked("x: int", infer_const=True)
+
+
+class TestPrelude:
+    """Test the shared prelude header of system includes."""
+
+    MODULE_A = "from stdio import *\nfrom stdint import *\nimport mylib\n"
+    MODULE_B = "\n".join([
+        "from stdio import *",
+        "from math import *",
+        "if [DEBUG]:",
+        "    from signal import *",
+        "def main() -> int:",
+        '    printf("%.1f %u\\n", sqrt(2.25), crc32c("abc", 3, 0))',
+        "    return 0",
+    ])
+
+    def test_make_prelude(self) -> None:
+        """Test that the prelude has each unconditional system include once, in order."""
+        prelude = make_prelude([self.MODULE_A, self.MODULE_B])
+        assert read_prelude(prelude) == ["stdio.h", "stdint.h", "math.h"]
+        assert prelude.startswith("/* Generated by arafura")
+        assert "#ifndef ARAFURA_PRELUDE_H" in prelude
+
+    def test_module_includes_prelude_first(self) -> None:
+        """Test that covered system headers are omitted and the rest kept."""
+        output = transpile(self.MODULE_B, prelude="prelude.h", prelude_includes=["stdio.h", "stdint.h", "math.h"])
+        lines = output.split("\n")
+        assert lines[0] == '#include "prelude.h"'
+        assert "#include <stdio.h>" not in lines and "#include <math.h>" not in lines
+        assert "#include <stdint.h>" not in lines  # also required by the crc32c runtime
+        assert "#include <signal.h>" in lines      # conditional, not in the prelude
+        assert "#include <string.h>" in lines      # runtime header the prelude lacks
+
+    def test_precompiled(self, gcc, tmp_path) -> None:
+        """Test that GCC uses the precompiled prelude and the program runs."""
+        prelude = make_prelude([self.MODULE_A, self.MODULE_B])
+        (tmp_path / "prelude.h").write_text(prelude)
+        (tmp_path / "main.c").write_text(
+            transpile(self.MODULE_B, prelude="prelude.h", prelude_includes=read_prelude(prelude)))
+        subprocess.run([gcc, "-O2", "-x", "c-header", "prelude.h"], cwd=tmp_path, check=True)
+        result = subprocess.run([gcc, "-O2", "-Winvalid-pch", "-H", "-o", "main", "main.c", "-lm"],
+                                cwd=tmp_path, check=True, capture_output=True, text=True)
+        assert "! prelude.h.gch" in result.stderr
+        output = subprocess.run([str(tmp_path / "main")], check=True, capture_output=True, text=True).stdout
+        assert output == f"1.5 {int.from_bytes(bytes.fromhex('364b3fb7'), 'big')}\n"
+
+
+class TestVisibility:
+    """Test symbol visibility control and @export."""
+
+    SOURCE = "\n".join([
+        "def helper(x: int) -> int:",
+        "    return x * 3",
+        "def local(x: int) -> static[int]:",
+        "    return x + 1",
+        "@export",
+        "def api(x: int) -> int:",
+        "    return helper(local(x))",
+    ])
+
+    def test_default(self) -> None:
+        """Test that only @export functions are annotated by default."""
+        output = transpile(self.SOURCE)
+        assert 'int helper(int x) {' in output.split("\n")
+        assert '__attribute__((visibility("default"))) int api(int x) {' in output
+
+    def test_hidden(self) -> None:
+        """Test that hidden visibility applies to non-static, non-exported functions."""
+        output = transpile(self.SOURCE, visibility="hidden")
+        assert '__attribute__((visibility("hidden"))) int helper(int x) {' in output
+        assert 'static int local(int x) {' in output.split("\n")
+        assert '__attribute__((visibility("default"))) int api(int x) {' in output
+
+    def test_errors(self) -> None:
+        """Test that static @export functions and unknown visibilities are rejected."""
+        with pytest.raises(ValueError, match="cannot be static"):
+            transpile("@export\ndef f() -> static[int]:\n    return 0")
+        with pytest.raises(ValueError, match="Unknown visibility"):
+            transpile("", visibility="protected")
+
+    def test_shared_library(self, gcc, tmp_path) -> None:
+        """Test that only @export is in the dynamic symbol table and internal calls skip the PLT."""
+        (tmp_path / "lib.c").write_text(transpile(self.SOURCE, visibility="hidden"))
+        subprocess.run([gcc, "-O0", "-fPIC", "-shared", "-o", "lib.so", "lib.c"], cwd=tmp_path, check=True)
+        symbols = subprocess.run(["nm", "-D", "--defined-only", "lib.so"], cwd=tmp_path,
+                                 check=True, capture_output=True, text=True).stdout
+        assert " api" in symbols and "helper" not in symbols
+        disassembly = subprocess.run(["objdump", "-d", "lib.so"], cwd=tmp_path,
+                                     check=True, capture_output=True, text=True).stdout
+        assert "<helper>" in disassembly and "helper@plt" not in disassembly
+
+
+class TestShards:
+    """Test splitting a module into several compilation units."""
+
+    SOURCE = "\n".join([
+        "from stdio import *",
+        "calls: int = 0",
+        "scale: static[int] = 10",
+        "@typedef(Point)",
+        "class Point:",
+        "    x: int",
+        "    y: int",
+        "def norm1(p: -Point) -> static[int]:",
+        "    return p._.x + p._.y",
+        "def ident(x: int) -> static[int]:",
+        "    return x",
+        "def sq(x: int) -> static[inline[int]]:",
+        "    return x * x",
+        "def total(n: int) -> int:",
+        "    s: int = 0",
+        "    for i in int(i := 0)(i < n)(i ** _):",
+        "        s = s + sq(i) * scale + ident(i)",
+        "        calls = calls + 1",
+        "    return s",
+        "def point(n: int) -> int:",
+        "    p: Point = Point(n, 2)",
+        "    calls = calls + 1",
+        "    return norm1(_.p)",
+        "def main() -> int:",
+        "    t: int = total(4)",
+        "    q: int = point(5)",
+        '    printf("%d %d %d\\n", t, q, calls)',
+        "    return 0",
+    ])
+
+    def test_balance(self) -> None:
+        """Test that items go largest first into the smallest shard."""
+        assert balance([5, 1, 4, 3, 3], 2) == [0, 1, 1, 1, 0]
+        assert balance([7], 3) == [0]
+
+    def test_layout(self) -> None:
+        """Test what goes to the header and to the shards."""
+        header, shards = transpile_sharded(self.SOURCE, 3, "big.h")
+        assert header.startswith("#ifndef BIG_H\n#define BIG_H\n#include <stdio.h>")
+        assert "extern int calls;" in header
+        assert '__attribute__((visibility("hidden"))) extern int scale;' in header
+        assert "static inline int sq(int x) {" in header
+        assert "int total(int n);" in header and "int main(void);" in header
+        assert all(shard.startswith('#include "big.h"\n') for shard in shards)
+        assert sum("int calls = 0;" in shard for shard in shards) == 1
+        assert not any("sq(int x) {" in shard for shard in shards)
+
+    def test_static_promotion(self) -> None:
+        """Test that only static functions used from another shard become hidden."""
+        header, shards = transpile_sharded(self.SOURCE, 3, "big.h")
+        # ident lands apart from its caller total; norm1 shares a shard with point
+        assert '__attribute__((visibility("hidden"))) int ident(int x);' in header
+        assert '__attribute__((visibility("hidden"))) int ident(int x) {' in shards[1]
+        assert "static int norm1(Point *p) {" in shards[2] and "int point(int n) {" in shards[2]
+        assert "norm1" not in header
+        # With one shard nothing crosses a shard boundary
+        header, (shard,) = transpile_sharded(self.SOURCE, 1, "big.h")
+        assert "static int ident(int x) {" in shard and "ident" not in header
+
+    @staticmethod
+    def build_and_run(gcc, tmp_path, header: str, shards: list[str], flags=()) -> str:
+        """Compile each shard separately, link them and return the program's output."""
+        (tmp_path / "big.h").write_text(header)
+        objects = []
+        for index, shard in enumerate(shards):
+            (tmp_path / f"big_{index}.c").write_text(shard)
+            subprocess.run([gcc, "-Wall", "-Werror", "-O2", *flags, "-c", f"big_{index}.c"], cwd=tmp_path, check=True)
+            objects.append(f"big_{index}.o")
+        subprocess.run([gcc, "-o", "big", *objects], cwd=tmp_path, check=True)
+        return subprocess.run([str(tmp_path / "big")], check=True, capture_output=True, text=True).stdout
+
+    def test_runs_like_single_unit(self, gcc, tmp_path) -> None:
+        """Test that the shards compile separately and behave like the single file."""
+        expected = None
+        for count in (1, 2, 3, 4):
+            header, shards = transpile_sharded(self.SOURCE, count, "big.h")
+            output = self.build_and_run(gcc, tmp_path, header, shards)
+            assert output == (expected := expected or output)
+        assert expected == "146 7 5\n"
+
+    def test_preprocessor_blocks(self, gcc, tmp_path) -> None:
+        """Test that definitions inside if [X]: are split like top-level ones."""
+        source = "\n".join([
+            "from stdio import *",
+            "if [DEBUG]:",
+            "    counter: int = 0",
+            "    def trace(x: int) -> int:",
+            "        counter = counter + 1",
+            "        return x",
+            "else:",
+            "    def trace(x: int) -> int:",
+            "        return x",
+            "def twice(x: int) -> int:",
+            "    return trace(x) + trace(x)",
+            "def main() -> int:",
+            "    t: int = twice(3) + trace(4)",
+            "    if [DEBUG]:",
+            '        printf("%d %d\\n", t, counter)',
+            "    else:",
+            '        printf("%d\\n", t)',
+            "    return 0",
+        ])
+        header, shards = transpile_sharded(source, 2, "big.h")
+        assert "extern int counter;" in header and "int trace(int x);" in header
+        assert "int trace(int x) {" not in header and "int counter = 0;" not in header
+        assert sum(shard.count("int trace(int x) {") for shard in shards) == 2
+        assert self.build_and_run(gcc, tmp_path, header, shards) == "10\n"
+        assert self.build_and_run(gcc, tmp_path, header, shards, ("-DDEBUG",)) == "10 3\n"
+
+    def test_promoted_alias_versioned(self, gcc, tmp_path) -> None:
+        """Test that a promoted @alias_versioned function loses static on its definition."""
+        source = "\n".join([
+            "from stdio import *",
+            "@alias_versioned(n)",
+            "def add(y: -int, x: -int, n: int) -> static[void]:",
+            "    for i in int(i := 0)(i < n)(i ** _):",
+            "        y[i] += x[i]",
+            "def main() -> int:",
+            "    buf: int[4] = [1, 2, 3, 4]",
+            "    add(buf + 1, buf, 3)",
+            '    printf("%d %d\\n", buf[2], buf[3])',
+            "    return 0",
+        ])
+        header, shards = transpile_sharded(source, 2, "big.h")
+        assert '__attribute__((visibility("hidden"))) void add(int *y, int *x, int n);' in header
+        assert '__attribute__((visibility("hidden"))) void add(int *y, int *x, int n) {' in "".join(shards)
+        assert self.build_and_run(gcc, tmp_path, header, shards) == "6 10\n"
+
+    @pytest.mark.parametrize("name", lib.names())
+    def test_standard_modules(self, gcc, tmp_path, name) -> None:
+        """Test that the shards of a module importing a standard module compile cleanly."""
+        source = f"from arafura.{name} import *\ndef main() -> int:\n    return 0\n"
+        header, shards = transpile_sharded(source, 2, "big.h")
+        (tmp_path / "big.h").write_text(header)
+        for index, shard in enumerate(shards):
+            (tmp_path / f"big_{index}.c").write_text(shard)
+            subprocess.run([gcc, "-Wall", "-Werror", "-O2", "-c", f"big_{index}.c"], cwd=tmp_path, check=True)
+
+    def test_methods(self, gcc, tmp_path) -> None:
+        """Test that methods are functions placed in shards, not in the header."""
+        header, shards = transpile_sharded(TestProtocol.SOURCE, 3, "big.h")
+        assert "double Circle_area(Circle *self);" in header
+        assert "double Circle_area(Circle *self) {" not in header
+        assert sum("double Circle_area(Circle *self) {" in shard for shard in shards) == 1
+        assert self.build_and_run(gcc, tmp_path, header, shards) == "27.0 3.0 24.0\n"
+
+
+class TestProtocol:
+    """Test Protocol interfaces, methods and devirtualized calls."""
+
+    SOURCE = "\n".join([
+        "from stdio import *",
+        "class Shape(Protocol):",
+        "    def area(self) -> double: ...",
+        "    def scale(self, k: double) -> void: ...",
+        "@implements(Shape)",
+        "@typedef(Circle)",
+        "class Circle:",
+        "    r: double",
+        "    def area(self) -> double:",
+        "        return 3.0 * self._.r * self._.r",
+        "    def scale(self, k: double) -> void:",
+        "        self._.r = self._.r * k",
+        "@implements(Shape)",
+        "@typedef(Rect)",
+        "class Rect:",
+        "    w: double",
+        "    h: double",
+        "    def area(self) -> double:",
+        "        return self._.w * self._.h",
+        "    def scale(self, k: double) -> void:",
+        "        self._.w = self._.w * k",
+        "        self._.h = self._.h * k",
+        "def total(shapes: -Shape, n: int) -> double:",
+        "    s: double = 0.0",
+        "    for i in int(i := 0)(i < n)(i ** _):",
+        "        s = s + shapes[i].area()",
+        "    return s",
+        "def main() -> int:",
+        "    c: Circle = Circle(1.0)",
+        "    r: Rect = Rect(2.0, 3.0)",
+        "    pr: -Rect = _.r",
+        "    shapes: Shape[2] = [Shape(_.c), Shape(pr)]",
+        "    shapes[1].scale(2.0)",
+        '    printf("%.1f %.1f %.1f\\n", total(shapes, 2), c.area(), pr.area())',
+        "    return 0",
+    ])
+
+    def test_vtable(self) -> None:
+        """Test the vtable, interface value and dispatch helpers."""
+        output = transpile(self.SOURCE)
+        assert "    double (*area)(void *self);\n    void (*scale)(void *self, double k);\n} Shape_vtable;" in output
+        assert "    void *self;\n    const Shape_vtable *vtable;\n} Shape;" in output
+        assert "static inline double Shape_area(Shape obj) {\n    return obj.vtable->area(obj.self);\n}" in output
+        assert "static const Shape_vtable Circle_Shape_vtable = {Circle_Shape_area, Circle_Shape_scale};" in output
+
+    def test_methods_and_calls(self) -> None:
+        """Test method emission, dispatch and direct calls on known types."""
+        output = transpile(self.SOURCE)
+        assert "double Circle_area(Circle *self) {" in output
+        assert "s = (s + Shape_area(shapes[i]));" in output
+        assert "Shape shapes[2] = {Circle_as_Shape(&c), Rect_as_Shape(pr)};" in output
+        # Concrete types are annotated: direct calls, no vtable
+        assert "Circle_area(&c), Rect_area(pr));" in output
+
+    def test_runs(self, run_c) -> None:
+        """Test that dispatch reaches the right implementation."""
+        assert run_c(transpile(self.SOURCE)) == "27.0 3.0 24.0\n"
+
+    def test_check_accepts_methods(self) -> None:
+        """Test that methods with an implicit self pass the structural check."""
+        assert check(self.SOURCE) == []
+
+    def test_errors(self) -> None:
+        """Test missing methods, unknown protocols and bad conversions."""
+        protocol = "class Shape(Protocol):\n    def area(self) -> double: ...\n"
+        with pytest.raises(ValueError, match="does not implement Shape.area"):
+            transpile(protocol + "@implements(Shape)\nclass Sq:\n    a: double\n")
+        with pytest.raises(ValueError, match="unknown protocol"):
+            transpile("@implements(Nope)\nclass Sq:\n    a: double\n")
+        with pytest.raises(ValueError, match="needs a pointer"):
+            transpile(protocol + "def f(x: int) -> int:\n    s: Shape = Shape(x)\n    return 0\n")
+
+
+class TestDerive:
+    """Test @derive(eq, hash, cmp) on structs."""
+
+    STRUCTS = "\n".join([
+        "from stdio import *",
+        "from string import *",
+        "@derive(eq, hash, cmp)",
+        "@typedef(Key)",
+        "class Key:",
+        "    a: int32_t",
+        "    b: int32_t",
+        "    tag: uint64_t",
+        "@derive(eq, hash, cmp)",
+        "@typedef(Padded)",
+        "class Padded:",
+        "    c: char",
+        "    x: int",
+        "    v: int16_t[2]",
+        "@derive(eq, hash)",
+        "@typedef(Pt)",
+        "class Pt:",
+        "    x: double",
+        "    y: double",
+        "@derive(eq, cmp)",
+        "@typedef(Outer)",
+        "class Outer:",
+        "    k: Key",
+        "    n: uint32_t",
+        "    m: uint32_t",
+    ])
+
+    def test_bytewise_when_padding_free(self) -> None:
+        """Test that padding-free integer structs compare their bytes."""
+        output = transpile(self.STRUCTS)
+        assert '_Static_assert(sizeof(Key) == 16, "Key has padding");' in output
+        assert "static inline int Key_eq(const Key *a, const Key *b) {\n    return memcmp(a, b, 16) == 0;\n}" in output
+        assert '_Static_assert(sizeof(Outer) == 24, "Outer has padding");' in output
+        # Padding (after c) and floating point (-0.0 == 0.0) go field by field
+        assert "Padded has padding" not in output and "Pt has padding" not in output
+        assert "    if (a->x != b->x) return 0;" in output
+        assert "h = arafura_hash_mix(h, arafura_double_bits(a->x));" in output
+        # Ordering is always field-wise, nested structs through their own cmp
+        assert "if ((c = Key_cmp(&a->k, &b->k)) != 0) return c;" in output
+
+    def test_word_compare(self) -> None:
+        """Test that an 8-byte padding-free struct compares one word."""
+        output = transpile("@derive(eq)\n@typedef(P)\nclass P:\n    x: int32_t\n    y: int32_t\n")
+        assert "    uint64_t x, y;\n    memcpy(&x, a, 8);\n    memcpy(&y, b, 8);\n    return x == y;" in output
+
+    def test_matches_python(self, run_c) -> None:
+        """Test eq, cmp and hash consistency against Python tuple semantics, with garbage in padding."""
+        main = "\n".join([
+            "def main() -> int:",
+            "    values: int[3] = [-1, 0, 2]",
+            "    p: Padded[27]",
+            "    q: Padded[27]",
+            "    memset(p, 255, sizeof(p))",
+            "    memset(q, 0, sizeof(q))",
+            "    for i in int(i := 0)(i < 27)(i ** _):",
+            "        p[i].c = values[i % 3]",
+            "        p[i].x = values[i / 3 % 3]",
+            "        p[i].v[0] = 0",
+            "        p[i].v[1] = values[i / 9]",
+            "        q[i].c = p[i].c",
+            "        q[i].x = p[i].x",
+            "        q[i].v[0] = 0",
+            "        q[i].v[1] = p[i].v[1]",
+            "    for i in int(i := 0)(i < 27)(i ** _):",
+            "        for j in int(j := 0)(j < 27)(j ** _):",
+            '            printf("%d%d", Padded_eq(p + i, q + j), Padded_cmp(p + i, q + j) + 1)',
+            '        printf(" %d\\n", Padded_hash(p + i) == Padded_hash(q + i))',
+            "    return 0",
+        ])
+        lines = run_c(transpile(self.STRUCTS + "\n" + main)).split("\n")[:-1]
+        values = [-1, 0, 2]
+        keys = [(values[i % 3], values[i // 3 % 3], values[i // 9]) for i in range(27)]
+        for i, line in enumerate(lines):
+            pairs, same_hash = line.split(" ")
+            expected = "".join(f"{int(keys[i] == keys[j])}{(keys[i] > keys[j]) - (keys[i] < keys[j]) + 1}"
+                               for j in range(27))
+            assert (pairs, same_hash) == (expected, "1")
+
+    def test_errors(self) -> None:
+        """Test unknown traits, underived nested structs and non-structs."""
+        with pytest.raises(ValueError, match="@derive takes"):
+            transpile("@derive(order)\nclass P:\n    x: int\n")
+        with pytest.raises(ValueError, match="needs Q to derive"):
+            transpile("@derive(eq)\nclass Q:\n    x: int\n@derive(eq, hash)\nclass P:\n    q: Q\n")
+        with pytest.raises(ValueError, match="cannot compare field P.u"):
+            transpile("class U(Union):\n    x: int\n@derive(eq)\nclass P:\n    u: U\n")
+        with pytest.raises(ValueError, match="applies to structs"):
+            transpile("@derive(eq)\nclass U(Union):\n    x: int\n")
+
+
+class TestRegex:
+    """Test re_match and re_search compiled to DFAs."""
+
+    PATTERNS = [
+        r"abc", r"a*b", r"^ab+c?$", r"(a|bc)*d", r"[a-c]{2,3}x", r"\d+\.\d*", r"^\w+@\w+\.(com|org)$",
+        r"x$", r"[^ab]c", r".a", r"(?:ab|a)b{1,}", r"", r"^$", r"colou?r", r"a.*b.*c$", r"[-x]\s\S",
+        r"a{,2}b", r"\$\.", r"^a|b", r"a|b$", r"^x|^a$|c\$",
+    ]
+
+    def test_matches_python(self, run_c) -> None:
+        """Test every pattern on generated subjects against Python's re.match and re.search."""
+        rng = random.Random(118)
+        subjects = ["", "ab\n", "colour", "color", "x@y.com", "x@y.org\n", "12.5", "$."]
+        subjects += ["".join(rng.choice("abcdrx.@ $-0\n") for _ in range(rng.randint(1, 9))) for _ in range(150)]
+        lines = ["from stdio import *", "from string import *"]
+        for k, pattern in enumerate(self.PATTERNS):
+            lines += [f"def check{k}(s: -char) -> void:",
+                      f'    printf("%d%d", re_match({pattern!r}, s, strlen(s)), re_search({pattern!r}, s, strlen(s)))']
+        lines += ["def main() -> int:"]
+        for subject in subjects:
+            lines += [f"    check{k}({subject!r})" for k in range(len(self.PATTERNS))] + ['    printf("\\n")']
+        lines += ["    return 0"]
+        output = run_c(transpile("\n".join(lines))).split("\n")[:-1]
+        for subject, line in zip(subjects, output, strict=True):
+            expected = "".join(f"{int(re.match(p, subject) is not None)}{int(re.search(p, subject) is not None)}"
+                               for p in self.PATTERNS)
+            assert line == expected, subject
+
+    def test_one_matcher_per_pattern(self) -> None:
+        """Test that repeated patterns share their matcher and the loop stops at the sinks."""
+        output = transpile("def f(s: -char, n: size_t) -> int:\n"
+                           "    return re_search('a+b', s, n) + re_search('a+b', s, n) + re_match('a+b', s, n)\n")
+        assert "return ((arafura_re_0(s, n) + arafura_re_0(s, n)) + arafura_re_1(s, n));" in output
+        assert output.count("static inline int arafura_re_") == 2
+        assert "for (size_t i = 0; i < n && state > 1; i++) {" in output
+
+    def test_errors(self) -> None:
+        """Test that patterns a DFA cannot express are rejected, also by check."""
+        with pytest.raises(ValueError, match=r"unsupported escape \\1"):
+            transpile("def f(s: -char) -> int:\n    return re_match('(a)\\\\1', s, 2)\n")
+        with pytest.raises(ValueError, match="only .*groups"):
+            transpile("def f(s: -char) -> int:\n    return re_search('a(?=b)', s, 2)\n")
+        with pytest.raises(ValueError, match="string literal pattern"):
+            transpile("def f(p: -char, s: -char) -> int:\n    return re_search(p, s, 2)\n")
+        errors = check("def f(s: -char) -> int:\n    return re_match('a)', s, 2)\n")
+        assert [e.message for e in errors] == ["Regex 'a)' at 1: unbalanced )"]
+
+
+class TestReport:
+    """Test the stack usage and code size report."""
+
+    SOURCE = "\n".join([
+        "def deep(n: int) -> int:",
+        "    buf: char[8192]",
+        "    buf[n % 8192] = n",
+        "    if n == 0:",
+        "        return buf[0]",
+        "    return deep(n - 1) + buf[n % 100]",
+        "def vla(n: int) -> int:",
+        "    a: list[int, n]",
+        "    a[0] = n",
+        "    return a[n - 1]",
+        "@typedef(P)",
+        "class P:",
+        "    x: int",
+        "    def twice(self) -> int:",
+        "        return self._.x * 2",
+    ])
+
+    def test_parse_stack_usage(self) -> None:
+        """Test reading GCC's .su format."""
+        text = "module.c:3:5:deep\t8224\tstatic\nmodule.c:9:5:vla\t48\tdynamic,bounded\n"
+        assert parse_stack_usage(text) == {"deep": (8224, "static"), "vla": (48, "dynamic,bounded")}
+
+    def test_report(self, gcc) -> None:
+        """Test that functions map to their def lines and large or dynamic frames are flagged."""
+        report = {function.name: function for function in size_report(self.SOURCE, gcc)}
+        assert report["deep"].line == 1 and report["deep"].stack > 8192 and report["deep"].code > 0
+        assert report["vla"].line == 7 and report["vla"].stack_kind.startswith("dynamic")
+        assert report["P_twice"].line == 14
+        lines, warnings = format_report(list(report.values()), "m.py", max_stack=4096)
+        assert warnings == 2
+        assert any(line.startswith("m.py:1: warning: deep uses ") for line in lines)
+        assert "m.py:7: warning: vla has an unbounded dynamic stack frame" in lines
+        assert format_report(list(report.values()), "m.py", max_stack=1 << 20, max_code=1 << 20)[1] == 1
+
+
+class TestFastdiv:
+    """Test division by runtime-invariant divisors through fastdiv[T]."""
+
+    def test_lowering(self) -> None:
+        """Test that /, // and % by a fastdiv operand (also a struct field) become calls."""
+        source = "\n".join([
+            "@typedef(Table)",
+            "class Table:",
+            "    mod: fastdiv[uint32_t]",
+            "def f(t: -Table, h: uint32_t, d: fastdiv[uint64_t], x: uint64_t) -> uint64_t:",
+            "    x //= d",
+            "    return h % t._.mod + x / d * 2 + h / 3",
+        ])
+        output = transpile(source)
+        assert "    arafura_fastdiv_u32 mod;" in output
+        assert "uint64_t f(Table *t, uint32_t h, arafura_fastdiv_u64 d, uint64_t x) {" in output
+        assert "    x = arafura_fastdiv_u64_div(x, d);" in output
+        assert "arafura_fastdiv_u32_mod(h, t->mod) + (arafura_fastdiv_u64_div(x, d) * 2)" in output
+        assert "(h / 3)" in output
+        assert "arafura_fastdiv_u32_make(" in transpile("x: fastdiv[uint32_t] = fastdiv[uint32_t](10)")
+        with pytest.raises(ValueError, match="fastdiv takes uint32_t or uint64_t"):
+            transpile("x: fastdiv[int]")
+
+    def test_rejects_wider_dividend(self) -> None:
+        """Test that a 64-bit dividend is not silently truncated by a 32-bit divisor."""
+        source = "\n".join([
+            "def f(h: uint64_t, d: fastdiv[uint32_t]) -> uint32_t:",
+            "    return h % d",
+        ])
+        with pytest.raises(ValueError, match="fastdiv\\[uint32_t\\] cannot divide a uint64_t"):
+            transpile(source)
+        with pytest.raises(ValueError, match="cannot divide a size_t"):
+            transpile("def f(h: size_t, d: fastdiv[uint32_t]) -> void:\n    h //= d")
+        assert "arafura_fastdiv_u32_mod(((uint32_t)(h)), d)" in transpile(source.replace("h % d", "[uint32_t](h) % d"))
+
+    def test_compound_dividend(self) -> None:
+        """Test that a compound dividend is checked by the type of its arithmetic, and rejected if unknown."""
+        source = "\n".join([
+            "def f(a: int64_t, b: int64_t, d: fastdiv[uint32_t]) -> uint32_t:",
+            "    return (a + b) / d",
+        ])
+        with pytest.raises(ValueError, match="cannot divide a 64-bit value"):
+            transpile(source)
+        with pytest.raises(ValueError, match="cannot divide a 64-bit value"):
+            transpile(source.replace("(a + b)", "(b + 5000000000)").replace("a: int64_t", "a: uint32_t"))
+        with pytest.raises(ValueError, match="needs a dividend of a known type"):
+            transpile(source.replace("(a + b)", "g(a)"))
+        with pytest.raises(ValueError, match="needs a dividend of a known type"):
+            transpile(source.replace("(a + b)", "(a if b else 1)").replace("int64_t", "uint32_t"))
+        assert "arafura_fastdiv_u32_div(((uint32_t)((a + b))), d)" in transpile(
+            source.replace("(a + b)", "[uint32_t](a + b)"))
+        narrow = source.replace("int64_t", "uint32_t")
+        assert "arafura_fastdiv_u32_div((a + b), d)" in transpile(narrow)
+        assert "arafura_fastdiv_u32_div(((a << 2) + 7), d)" in transpile(narrow.replace("(a + b)", "((a << 2) + 7)"))
+        assert "arafura_fastdiv_u32_mod(p[i], d)" in transpile(
+            "def f(p: -uint16_t, i: int, d: fastdiv[uint32_t]) -> uint32_t:\n    return p[i] % d")
+        assert check(source)[0].line == 2
+
+    def test_matches_division(self, run_c) -> None:
+        """Test every dividend and divisor below 2^12, and 64-bit edge and random values, against / and %."""
+        source = "\n".join([
+            "from stdio import *",
+            "from stdint import *",
+            "def next(s: -uint64_t) -> uint64_t:",
+            "    s._ ^= s._ << 13",
+            "    s._ ^= s._ >> 7",
+            "    s._ ^= s._ << 17",
+            "    return s._",
+            "def check32(d: uint32_t, a: uint32_t) -> int:",
+            "    if d == 0:",
+            "        return 0",
+            "    f: fastdiv[uint32_t] = fastdiv[uint32_t](d)",
+            "    return a / f != a / d or a % f != a % d",
+            "def check64(d: uint64_t, a: uint64_t) -> int:",
+            "    f: fastdiv[uint64_t] = fastdiv[uint64_t](d)",
+            "    return a / f != a / d or a % f != a % d",
+            "def main() -> int:",
+            "    bad: int = 0",
+            "    checked: int = 0",
+            "    for d in uint32_t(d := 1)(d < 4096)(d ** _):",
+            "        for a in uint32_t(a := 0)(a < 4096)(a ** _):",
+            "            bad += check32(d, a) + check64(d, a)",
+            "            checked += 1",
+            "    edges: uint64_t[10] = [1, 2, 3, 7, 641, 65535, 4294967295, 4294967296, 9223372036854775808, 18446744073709551615]",
+            "    s: uint64_t = 88172645463325252",
+            "    for i in int(i := 0)(i < 10)(i ** _):",
+            "        for j in int(j := 0)(j < 10)(j ** _):",
+            "            bad += check64(edges[i], edges[j]) + check64(edges[i], edges[j] - 1)",
+            "            bad += check32(edges[i], edges[j]) + check32(edges[i], edges[j] - 1)",
+            "    for i in int(i := 0)(i < 1000000)(i ** _):",
+            "        d: uint64_t = next(_.s) >> (next(_.s) % 64)",
+            "        a: uint64_t = next(_.s)",
+            "        if d != 0:",
+            "            bad += check64(d, a) + check32(d, a)",
+            '    printf("%d %d\\n", bad, checked)',
+            "    return 0",
+        ])
+        assert run_c(transpile(source)) == "0 16773120\n"
+
+
+class TestSeqlock:
+    """Test seqlock[T]: writer exclusion and torn-read retries."""
+
+    def test_lowering(self) -> None:
+        """Test the generated struct and that s, p._ and s.f are passed by address."""
+        source = "\n".join([
+            "@typedef(Quote)",
+            "class Quote:",
+            "    bid: int64_t",
+            "    ask: int64_t",
+            "@typedef(Book)",
+            "class Book:",
+            "    top: seqlock[Quote]",
+            "q: seqlock[Quote]",
+            "def f(p: -seqlock[Quote], b: -Book, v: Quote) -> Quote:",
+            "    seqlock_store(q, v)",
+            "    v = seqlock_write_begin(p._)",
+            "    seqlock_write_end(p._, v)",
+            "    return seqlock_load(b._.top)",
+        ])
+        output = transpile(source)
+        assert "    _Atomic uint32_t seq;\n    _Atomic uint64_t words[(sizeof(Quote) + 7) / 8];\n} seqlock_Quote;" in output
+        assert output.count("} seqlock_Quote;") == 1
+        assert "    seqlock_Quote top;" in output
+        assert "Quote f(seqlock_Quote *p, Book *b, Quote v) {" in output
+        assert "    seqlock_Quote_store(&q, v);" in output
+        assert "    v = seqlock_Quote_write_begin(p);" in output
+        assert "    seqlock_Quote_write_end(p, v);" in output
+        assert "    return seqlock_Quote_load(&b->top);" in output
+        with pytest.raises(ValueError, match="seqlock_load takes a variable"):
+            transpile("def f(x: int) -> int:\n    return seqlock_load(x)")
+        with pytest.raises(ValueError, match="seqlock_store takes 2 arguments"):
+            transpile("q: seqlock[int]\ndef f() -> void:\n    seqlock_store(q)")
+
+    def test_concurrent_snapshots(self, run_c) -> None:
+        """Test that readers only see whole updates and that writers do not lose each other's."""
+        source = "\n".join([
+            "from stdio import *",
+            "from stdint import *",
+            "from pthread import *",
+            "from sched import *",
+            "WORDS: macro = 32",
+            "@typedef(Block)",
+            "class Block:",
+            "    v: uint64_t[WORDS]",
+            "shared: seqlock[Block]",
+            "torn: int[2]",
+            "writers_done: int",
+            "def writer(arg: -void) -> -void:",
+            "    for i in int(i := 0)(i < 20000)(i ** _):",
+            "        b: Block = seqlock_write_begin(shared)",
+            "        for k in int(k := 0)(k < WORDS)(k ** _):",
+            "            b.v[k] += 1",
+            "        if i % 500 == 0:",
+            "            sched_yield()    # Let the other writer try to get in",
+            "        seqlock_write_end(shared, b)",
+            "    return arg",
+            "def reader(arg: -void) -> -void:",
+            "    bad: -int = arg",
+            "    while not ____atomic_load_n(_.writers_done, ____ATOMIC_ACQUIRE):",
+            "        b: Block = seqlock_load(shared)",
+            "        for k in int(k := 1)(k < WORDS)(k ** _):",
+            "            bad._ += b.v[k] != b.v[0]",
+            "    return NULL",
+            "def main() -> int:",
+            "    zero: Block = [0]",
+            "    seqlock_init(shared, zero)",
+            "    w: pthread_t[2]",
+            "    r: pthread_t[2]",
+            "    for i in int(i := 0)(i < 2)(i ** _):",
+            "        pthread_create(r + i, NULL, reader, torn + i)",
+            "    for i in int(i := 0)(i < 2)(i ** _):",
+            "        pthread_create(w + i, NULL, writer, NULL)",
+            "    for i in int(i := 0)(i < 2)(i ** _):",
+            "        pthread_join(w[i], NULL)",
+            "    ____atomic_store_n(_.writers_done, 1, ____ATOMIC_RELEASE)",
+            "    for i in int(i := 0)(i < 2)(i ** _):",
+            "        pthread_join(r[i], NULL)",
+            "    last: Block = seqlock_load(shared)",
+            "    printf(\"%d %llu\", torn[0] + torn[1], [unsigned[long[long]]](last.v[WORDS - 1]))",
+            "    return 0",
+        ])
+        assert run_c(transpile(source), flags=("-O2", "-pthread")) == "0 40000"